@@ -0,0 +1,169 @@
+/**
+ * Runs every program image of a corpus through the interpreter and the simulator several times,
+ * and compares wall time and peak RSS against a checked-in baseline.
+ *
+ * Usage: bench <interpreter> <simulator> <corpus dir> <baseline file>
+ *              [--runs <n>] [--time-tolerance <ratio>] [--rss-tolerance <ratio>] [--update]
+ *   --runs            run each program n times and keep the fastest run (default 5)
+ *   --time-tolerance  a wall time above baseline * (1 + ratio) is a regression (default 0.10)
+ *   --rss-tolerance   a peak RSS above baseline * (1 + ratio) is a regression (default 0.10)
+ *   --update          rewrite the baseline file with the measured numbers
+ *
+ * The exit status is 1 if any program fails, the two executables disagree on its output,
+ * or a regression is found.
+ *
+ * The corpus images are assembled from the .s files next to them:
+ *   llvm-mc -triple=riscv32 -mattr=-relax,-c,+m -filetype=obj x.s -o x.o
+ *   llvm-objcopy -O binary -j .text x.o x.bin
+ * and the binary is dumped in hex after an `@00000000` line. A program opts into the compressed instructions with
+ * `.option rvc`.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "process.h"
+
+namespace {
+
+struct Measurement {
+    double             seconds     = 0; // the fastest run
+    long               peak_rss_kb = 0; // the largest run
+    unsigned long long cycles      = 0; // simulated cycles, 0 for the interpreter
+    std::string        output;
+    bool               ok = true;
+};
+
+struct Baseline_Entry {
+    double seconds     = 0;
+    long   peak_rss_kb = 0;
+};
+
+// Absolute slack on wall times, so that the shortest programs do not flag timer noise
+constexpr double kTimeSlack = 0.005;
+
+Measurement measure(const std::string& executable, const std::string& input, bool parse_cycles, int runs) {
+    Measurement result;
+    for (int i = 0; i < runs; ++i) {
+        auto run = run_program(executable, {}, input, parse_cycles);
+        if (!run.ok) result.ok = false;
+        if (i == 0 || run.seconds < result.seconds) result.seconds = run.seconds;
+        result.peak_rss_kb = std::max(result.peak_rss_kb, run.peak_rss_kb);
+        result.output      = std::move(run.output);
+        double cycles      = 0;
+        if (parse_cycles && find_stat(run.errors, "cpu cycle count", cycles)) result.cycles = cycles;
+    }
+    return result;
+}
+
+std::map<std::string, Baseline_Entry> load_baseline(const std::string& path) {
+    std::map<std::string, Baseline_Entry> baseline;
+    std::ifstream                         file(path);
+    for (std::string line; std::getline(file, line);) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream stream(line);
+        std::string        executable, name, rate;
+        Baseline_Entry     entry;
+        if (stream >> executable >> name >> entry.seconds >> rate >> entry.peak_rss_kb) {
+            baseline[executable + " " + name] = entry;
+        }
+    }
+    return baseline;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 5) {
+        std::cerr << "Usage: " << argv[0] << " <interpreter> <simulator> <corpus dir> <baseline file>"
+                  << " [--runs <n>] [--time-tolerance <ratio>] [--rss-tolerance <ratio>] [--update]" << std::endl;
+        return 1;
+    }
+    const std::string interpreter = argv[1], simulator = argv[2], corpus = argv[3], baseline_path = argv[4];
+    int               runs           = 5;
+    double            time_tolerance = 0.10, rss_tolerance = 0.10;
+    bool              update         = false;
+    for (int i = 5; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--time-tolerance") == 0 && i + 1 < argc) {
+            time_tolerance = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "--rss-tolerance") == 0 && i + 1 < argc) {
+            rss_tolerance = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "--update") == 0) {
+            update = true;
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::string> names;
+    for (const auto& entry : std::filesystem::directory_iterator(corpus)) {
+        if (entry.path().extension() == ".data") names.push_back(entry.path().stem().string());
+    }
+    std::sort(names.begin(), names.end());
+
+    auto baseline = load_baseline(baseline_path);
+    bool failed   = false;
+    std::ostringstream new_baseline;
+    new_baseline << "# Written by `bench --update` (cmake --build <dir> --target bench-update).\n"
+                 << "# Wall times depend on the machine: refresh the file on the machine that runs the comparison.\n"
+                 << "# executable  testcase  wall_seconds  cycles_per_second  peak_rss_kb\n";
+
+    std::printf("%-12s %-10s %10s %10s %14s %10s %10s  %s\n", "executable", "testcase", "seconds", "baseline",
+                "cycles/s", "rss (KiB)", "baseline", "verdict");
+    for (const auto& name : names) {
+        auto input = (std::filesystem::path(corpus) / (name + ".data")).string();
+        auto interp = measure(interpreter, input, false, runs);
+        auto sim    = measure(simulator, input, true, runs);
+        for (auto [label, result] : {std::pair{"interpreter", &interp}, std::pair{"simulator", &sim}}) {
+            std::string verdict = "ok";
+            double      rate    = result->cycles == 0 ? 0 : result->cycles / result->seconds;
+            auto        it      = baseline.find(std::string(label) + " " + name);
+            if (!result->ok) {
+                verdict = "FAILED";
+            } else if (result == &sim && sim.output != interp.output) {
+                verdict = "WRONG OUTPUT";
+            } else if (it != baseline.end() && !update) {
+                const auto& base = it->second;
+                if (result->seconds > base.seconds * (1 + time_tolerance) + kTimeSlack) verdict = "SLOWER";
+                else if (result->peak_rss_kb > base.peak_rss_kb * (1 + rss_tolerance)) verdict = "MORE MEMORY";
+                else if (result->seconds < base.seconds * (1 - time_tolerance) - kTimeSlack) verdict = "faster";
+            } else if (!update) {
+                verdict = "no baseline";
+            }
+            if (verdict == "FAILED" || verdict == "WRONG OUTPUT" || verdict == "SLOWER" || verdict == "MORE MEMORY") {
+                failed = true;
+            }
+
+            char rate_text[32] = "-";
+            if (rate != 0) std::snprintf(rate_text, sizeof(rate_text), "%.0f", rate);
+            std::printf("%-12s %-10s %10.4f %10.4f %14s %10ld %10ld  %s\n", label, name.c_str(), result->seconds,
+                        it == baseline.end() ? 0.0 : it->second.seconds, rate_text, result->peak_rss_kb,
+                        it == baseline.end() ? 0L : it->second.peak_rss_kb, verdict.c_str());
+
+            char line[256];
+            std::snprintf(line, sizeof(line), "%s %s %.4f %s %ld\n", label, name.c_str(), result->seconds, rate_text,
+                          result->peak_rss_kb);
+            new_baseline << line;
+        }
+    }
+
+    if (update && !failed) {
+        std::ofstream(baseline_path) << new_baseline.str();
+        std::printf("baseline written to %s\n", baseline_path.c_str());
+    } else if (update) {
+        std::printf("baseline not written, as some programs failed\n");
+    }
+    return failed ? 1 : 0;
+}
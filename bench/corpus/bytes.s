@@ -0,0 +1,71 @@
+# byte and half-word loads and stores, with sign and zero extension
+  .text
+_start:
+  lui sp, 0x20
+  li t0, 0x9000
+  li t1, 0
+  li t2, 300
+fill:
+  add t3, t0, t1
+  addi t4, t1, -77
+  sb t4, 0(t3)
+  addi t1, t1, 1
+  bne t1, t2, fill
+  # half stores over the top
+  li t1, 0
+  li t2, 100
+hfill:
+  slli t3, t1, 1
+  add t3, t3, t0
+  lhu t4, 0(t3)
+  addi t4, t4, 1234
+  sh t4, 0(t3)
+  lh t5, 0(t3)
+  add s2, s2, t5
+  addi t1, t1, 1
+  bltu t1, t2, hfill
+  # byte sum with sign and zero extension
+  li t1, 0
+  li t2, 300
+  li a0, 0
+bsum:
+  add t3, t0, t1
+  lb t4, 0(t3)
+  lbu t5, 0(t3)
+  add a0, a0, t4
+  xor a0, a0, t5
+  sltiu t6, t4, 5
+  add a0, a0, t6
+  slti t6, t4, -5
+  add a0, a0, t6
+  addi t1, t1, 1
+  blt t1, t2, bsum
+  add a0, a0, s2
+  # store-to-load aliasing: word store then byte loads
+  li t3, 0xdeadbeef
+  sw t3, 0(t0)
+  lbu t4, 1(t0)
+  lhu t5, 2(t0)
+  add a0, a0, t4
+  add a0, a0, t5
+  sb zero, 3(t0)
+  lw t4, 0(t0)
+  add a0, a0, t4
+  auipc t5, 0
+  andi t5, t5, 0xff
+  add a0, a0, t5
+  sra t6, t3, t1
+  srl t5, t3, t1
+  sub a0, a0, t6
+  or a0, a0, t5
+  and a0, a0, t3
+  slli t6, t3, 7
+  slt t5, t6, t3
+  sltu t4, t6, t3
+  add a0, a0, t5
+  add a0, a0, t4
+  srli t6, a0, 8
+  xor a0, a0, t6
+  nop
+  nop
+  li a0, 255
@@ -0,0 +1,35 @@
+# recursive fibonacci with calls through a function pointer (jalr)
+  .text
+_start:
+  lui sp, 0x20
+  li a0, 18
+  jal fib
+  mv s1, a0
+  # function pointer call via jalr
+  la t0, fib
+  li a0, 10
+  jalr ra, 0(t0)
+  add s1, s1, a0
+  mv a0, s1
+  nop
+  nop
+  li a0, 255
+fib:
+  li t0, 2
+  blt a0, t0, base
+  addi sp, sp, -12
+  sw ra, 8(sp)
+  sw s0, 4(sp)
+  sw a0, 0(sp)
+  addi a0, a0, -1
+  jal fib
+  mv s0, a0
+  lw a0, 0(sp)
+  addi a0, a0, -2
+  jal fib
+  add a0, a0, s0
+  lw s0, 4(sp)
+  lw ra, 8(sp)
+  addi sp, sp, 12
+base:
+  ret
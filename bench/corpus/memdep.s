@@ -0,0 +1,32 @@
+# stores immediately reloaded, aliasing and non-aliasing (memory dependences)
+  .text
+_start:
+  lui sp, 0x20
+  # linked-list-ish: a[i] = a[i-1] + a[i-2] stored and reloaded immediately (RAW through memory)
+  li s0, 0xb000
+  li t0, 1
+  sw t0, 0(s0)
+  sw t0, 4(s0)
+  li t1, 2
+  li t2, 500
+loop:
+  slli t3, t1, 2
+  add t3, t3, s0
+  lw t4, -4(t3)
+  lw t5, -8(t3)
+  add t6, t4, t5
+  sw t6, 0(t3)
+  # unrelated store to another region, then load back alias & non alias
+  sw t1, 0x400(t3)
+  lw a1, 0x400(t3)
+  add a2, a2, a1
+  andi a3, t6, 0x7c
+  add a3, a3, s0
+  lw a4, 0(a3)
+  add a2, a2, a4
+  addi t1, t1, 1
+  bne t1, t2, loop
+  mv a0, a2
+  nop
+  nop
+  li a0, 255
@@ -0,0 +1,140 @@
+# RV32M: the corner cases of the division, a multiplicative hash, decimal digit sums and signed gcds
+# The corner cases are checked here against their values in the spec: the first one to differ is printed (1 - 18),
+# otherwise the checksum of the rest is (228, see muldiv.out).
+  .text
+_start:
+  lui sp, 0x20
+  li s0, 0           # checksum
+  li s5, 0           # the corner case being checked
+  # the signed overflow does not trap
+  li t0, 0x80000000
+  li t1, -1
+  addi s5, s5, 1
+  div t2, t0, t1
+  li t3, 0x80000000
+  bne t2, t3, fail
+  addi s5, s5, 1
+  rem t2, t0, t1
+  bnez t2, fail
+  addi s5, s5, 1
+  mul t2, t0, t1
+  li t3, 0x80000000
+  bne t2, t3, fail
+  addi s5, s5, 1
+  mulh t2, t0, t0
+  li t3, 0x40000000
+  bne t2, t3, fail
+  addi s5, s5, 1
+  mulhsu t2, t0, t1
+  li t3, 0x80000000
+  bne t2, t3, fail
+  # the division by zero does not trap
+  li t1, 0
+  addi s5, s5, 1
+  div t2, t0, t1
+  li t3, -1
+  bne t2, t3, fail
+  addi s5, s5, 1
+  divu t2, t0, t1
+  bne t2, t3, fail
+  addi s5, s5, 1
+  rem t2, t0, t1     # the dividend
+  bne t2, t0, fail
+  addi s5, s5, 1
+  remu t2, t0, t1    # the dividend
+  bne t2, t0, fail
+  # the signed division rounds towards zero
+  li t0, -7
+  li t1, 2
+  addi s5, s5, 1
+  div t2, t0, t1
+  li t3, -3
+  bne t2, t3, fail
+  addi s5, s5, 1
+  rem t2, t0, t1
+  li t3, -1
+  bne t2, t3, fail
+  li t4, 7
+  li t5, -2
+  addi s5, s5, 1
+  div t2, t4, t5
+  li t3, -3
+  bne t2, t3, fail
+  addi s5, s5, 1
+  rem t2, t4, t5
+  li t3, 1
+  bne t2, t3, fail
+  # the unsigned division and the high halves of the products of -7
+  addi s5, s5, 1
+  divu t2, t0, t1
+  li t3, 0x7ffffffc
+  bne t2, t3, fail
+  addi s5, s5, 1
+  remu t2, t0, t1
+  li t3, 1
+  bne t2, t3, fail
+  addi s5, s5, 1
+  mulh t2, t0, t0
+  bnez t2, fail
+  addi s5, s5, 1
+  mulhsu t2, t0, t1
+  li t3, -1
+  bne t2, t3, fail
+  addi s5, s5, 1
+  mulhu t2, t0, t0   # 2^32 - 14
+  li t3, 0xfffffff2
+  bne t2, t3, fail
+  # h = h * 31 + i, with the high halves of products of it mixed in
+  li t0, 0
+  li s1, 300
+  li s2, 0x12345
+  li s3, 31
+hash:
+  mul s2, s2, s3
+  add s2, s2, t0
+  mulhu t1, s2, s2
+  xor s0, s0, t1
+  mulhsu t1, s2, t0
+  add s0, s0, t1
+  mulh t1, s2, s3
+  add s0, s0, t1
+  addi t0, t0, 1
+  blt t0, s1, hash
+  # the sum of the decimal digits of i * i * 977 for i in [1, 200]
+  li t0, 1
+  li s1, 200
+  li s3, 10
+  li s4, 977
+square:
+  mul t1, t0, t0
+  mul t1, t1, s4
+digit:
+  remu t2, t1, s3
+  add s0, s0, t2
+  divu t1, t1, s3
+  bnez t1, digit
+  addi t0, t0, 1
+  ble t0, s1, square
+  # gcd(-6930, i * i + 1) by the signed remainder for i in [1, 100]
+  li t0, 1
+  li s1, 100
+pair:
+  li t1, -6930
+  mul t2, t0, t0
+  addi t2, t2, 1
+gcd:
+  rem t3, t1, t2
+  mv t1, t2
+  mv t2, t3
+  bnez t2, gcd
+  add s0, s0, t1
+  addi t0, t0, 1
+  ble t0, s1, pair
+  mv a0, s0
+  j halt
+fail:
+  mv a0, s5
+halt:
+  nop
+  nop
+  li a0, 255
@@ -0,0 +1,118 @@
+# compressed code (RV32C): a xorshift fill, an insertion sort, a checksum and a recursive sum through a pointer,
+# with the 32-bit instructions left at either halfword of a word
+# Assembled without `.option rvc`, it has no compressed instruction and prints the same result (26, see rvc.out)
+# on the interpreter, which then expands nothing.
+  .option rvc
+  .text
+_start:
+  lui sp, 0x20
+  li s1, 0x9000        # the array
+  li a2, 100           # its length
+  mv a0, s1
+  mv a1, a2
+  jal fill
+  mv a0, s1
+  mv a1, a2
+  jal sort
+  # the sum of a[i] >> (i & 7) and of (a[i] ^ a[i + 1]) >> 3
+  li s0, 0
+  mv a0, s1
+  li a3, 0
+  nop                  # moves the next instruction across a line boundary
+  addi a1, a2, -1
+check:
+  lw a4, 0(a0)
+  andi a5, a3, 7
+  sra a4, a4, a5
+  add s0, s0, a4
+  lw a5, 4(a0)
+  xor a5, a5, a4
+  srli a5, a5, 3
+  add s0, s0, a5
+  addi a0, a0, 4
+  addi a3, a3, 1
+  blt a3, a1, check
+  # the sum of 1..20 through a function pointer
+  la a5, tri
+  li a0, 20
+  jalr a5
+  add s0, s0, a0
+  # a stack frame addressed through sp and through a pointer into it
+  addi sp, sp, -64
+  addi a0, sp, 16
+  sw s0, 0(a0)
+  lw a1, 16(sp)
+  sub a1, a1, s1
+  lui a4, 0x1f
+  or a1, a1, a4
+  srai a1, a1, 2
+  andi a1, a1, -17
+  and a1, a1, s0
+  add s0, s0, a1
+  addi sp, sp, 64
+  mv a0, s0
+  nop
+  nop
+  li a0, 255
+
+# fill(a0: array, a1: length) with xorshift32
+fill:
+  lui a5, 0x2545f
+  addi a5, a5, 0x491
+fill_loop:
+  beqz a1, fill_end
+  mv a4, a5
+  slli a4, a4, 13
+  xor a5, a5, a4
+  mv a4, a5
+  srli a4, a4, 17
+  xor a5, a5, a4
+  mv a4, a5
+  slli a4, a4, 5
+  xor a5, a5, a4
+  mv a4, a5
+  srli a4, a4, 8
+  sw a4, 0(a0)
+  addi a0, a0, 4
+  addi a1, a1, -1
+  j fill_loop
+fill_end:
+  ret
+
+# sort(a0: array, a1: length), ascending
+sort:
+  li a2, 1
+outer:
+  bge a2, a1, sort_end
+  slli a3, a2, 2
+  add a3, a3, a0
+  lw a4, 0(a3)
+inner:
+  beq a3, a0, place
+  lw a5, -4(a3)
+  bge a4, a5, place
+  sw a5, 0(a3)
+  addi a3, a3, -4
+  j inner
+place:
+  sw a4, 0(a3)
+  addi a2, a2, 1
+  j outer
+sort_end:
+  ret
+
+# tri(a0) = a0 + tri(a0 - 1), tri(0) = 0
+tri:
+  bnez a0, tri_step
+  ret
+tri_step:
+  addi sp, sp, -16
+  sw ra, 12(sp)
+  sw a0, 8(sp)
+  addi a0, a0, -1
+  jal tri
+  lw a1, 8(sp)
+  add a0, a0, a1
+  lw ra, 12(sp)
+  addi sp, sp, 16
+  ret
@@ -0,0 +1,46 @@
+# a scatter through an index table: store addresses known late (memory order speculation)
+  .text
+_start:
+  lui sp, 0x20
+  # scatter through an index table: the store addresses come from loads, so the younger loads run ahead of them,
+  # and the ones that read the counter just stored must be fetched again
+  li s0, 0xa000 # idx[i] = (i * 37) % 64 * 4
+  li s1, 0xc000 # counters
+  li t0, 0
+  li t2, 256
+init:
+  slli t3, t0, 5
+  slli t4, t0, 2
+  add t3, t3, t4
+  add t3, t3, t0
+  andi t3, t3, 63
+  slli t3, t3, 2
+  add t4, t4, s0
+  sw t3, 0(t4)
+  addi t0, t0, 1
+  bne t0, t2, init
+  li a2, 0
+  li s2, 8
+outer:
+  li t0, 0
+loop:
+  slli t4, t0, 2
+  add t4, t4, s0
+  lw t3, 0(t4)
+  add t3, t3, s1
+  lw t5, 0(t3)
+  addi t5, t5, 1
+  sw t5, 0(t3)
+  andi t6, t0, 63
+  slli t6, t6, 2
+  add t6, t6, s1
+  lw a1, 0(t6)
+  add a2, a2, a1
+  addi t0, t0, 1
+  bne t0, t2, loop
+  addi s2, s2, -1
+  bnez s2, outer
+  mv a0, a2
+  nop
+  nop
+  li a0, 255
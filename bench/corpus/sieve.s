@@ -0,0 +1,33 @@
+# sieve of eratosthenes over 2000 byte flags
+  .text
+_start:
+  lui sp, 0x20
+  li s0, 0xa000      # flags
+  li s1, 2000        # n
+  li t0, 0
+clr:
+  add t1, s0, t0
+  sb zero, 0(t1)
+  addi t0, t0, 1
+  blt t0, s1, clr
+  li t0, 2
+  li a0, 0
+outer:
+  add t1, s0, t0
+  lbu t2, 0(t1)
+  bnez t2, next
+  addi a0, a0, 1
+  add t3, t0, t0
+mark:
+  bge t3, s1, next
+  add t4, s0, t3
+  li t5, 1
+  sb t5, 0(t4)
+  add t3, t3, t0
+  j mark
+next:
+  addi t0, t0, 1
+  blt t0, s1, outer
+  nop
+  nop
+  li a0, 255
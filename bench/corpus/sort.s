@@ -0,0 +1,59 @@
+# bubble sort of 200 pseudo random words, then a checksum
+  .text
+  .globl _start
+_start:
+  lui sp, 0x20
+  # generate 200 pseudo random numbers into array at 0x8000
+  li t0, 0x8000
+  li t1, 200
+  li t2, 12345
+gen:
+  slli t3, t2, 13
+  xor t2, t2, t3
+  srli t3, t2, 17
+  xor t2, t2, t3
+  slli t3, t2, 5
+  xor t2, t2, t3
+  sw t2, 0(t0)
+  addi t0, t0, 4
+  addi t1, t1, -1
+  bnez t1, gen
+  # bubble sort (signed)
+  li a1, 200
+outer:
+  addi a1, a1, -1
+  blez a1, done
+  li t0, 0x8000
+  mv t1, a1
+inner:
+  lw t2, 0(t0)
+  lw t3, 4(t0)
+  bge t3, t2, noswap
+  sw t3, 0(t0)
+  sw t2, 4(t0)
+noswap:
+  addi t0, t0, 4
+  addi t1, t1, -1
+  bnez t1, inner
+  j outer
+done:
+  # checksum = sum (a[i] * (i+1) via xor/add mix)
+  li t0, 0x8000
+  li t1, 200
+  li a0, 0
+ck:
+  lw t2, 0(t0)
+  add a0, a0, t2
+  slli t4, a0, 3
+  srai t5, a0, 7
+  xor a0, t4, t5
+  addi t0, t0, 4
+  addi t1, t1, -1
+  bnez t1, ck
+  srli t6, a0, 8
+  xor a0, a0, t6
+  srli t6, a0, 16
+  xor a0, a0, t6
+  nop
+  nop
+  li a0, 255
@@ -0,0 +1,158 @@
+/**
+ * Micro-benchmarks of the dark framework primitives, which every module is built on.
+ * Prints one JSON object with the best time per operation of each benchmark, over several repetitions.
+ *
+ * Usage: bench_micro [--output <file>] [--repetitions <n>]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "decoder.h"
+#include "regfile.h"
+#include "reorder_buffer.h"
+
+namespace {
+
+/// Keeps the compiler from optimizing away a value or the stores to memory.
+template <typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Result {
+    std::string        name;
+    unsigned long long iterations;
+    double             ns_per_op;
+};
+
+/// Runs `body(i)` for `iterations` iterations `repetitions` times, and keeps the fastest repetition.
+template <typename Body>
+Result measure(const char* name, unsigned long long iterations, int repetitions, Body&& body) {
+    double best = 0;
+    for (int r = 0; r < repetitions; ++r) {
+        auto begin = std::chrono::steady_clock::now();
+        for (unsigned long long i = 0; i < iterations; ++i) body(static_cast<max_size_t>(i));
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+        double ns = elapsed.count() / iterations;
+        if (r == 0 || ns < best) best = ns;
+    }
+    return {name, iterations, best};
+}
+
+constexpr unsigned long long kIterations      = 1 << 24;
+constexpr unsigned long long kArrayIterations = 1 << 18;
+constexpr max_size_t         kChangedEntries  = 4; // the ROB entries written in a cycle, about the issue width
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const char* output_path = nullptr;
+    int         repetitions = 5;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+            repetitions = std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+
+    {
+        // A read in the same cycle hits the cache, the first read after a sync calls the function
+        max_size_t source = 0;
+        Wire<32>   wire   = [&] { return source; };
+        results.push_back(measure("wire_read_cached", kIterations, repetitions, [&](max_size_t) {
+            do_not_optimize(to_unsigned(wire));
+        }));
+        results.push_back(measure("wire_read_uncached", kIterations, repetitions, [&](max_size_t i) {
+            source = i;
+            sync_member(wire);
+            do_not_optimize(to_unsigned(wire));
+        }));
+    }
+
+    {
+        Register<32> reg;
+        results.push_back(measure("register_assign_sync", kIterations, repetitions, [&](max_size_t i) {
+            reg <= i;
+            sync_member(reg);
+            do_not_optimize(to_unsigned(reg));
+        }));
+    }
+
+    results.push_back(measure("bit_range", kIterations, repetitions, [&](max_size_t i) {
+        Bit<32> bits(i);
+        do_not_optimize(to_unsigned(bits.range<24, 20>()));
+    }));
+    results.push_back(measure("bit_sign_extend", kIterations, repetitions, [&](max_size_t i) {
+        Bit<12> bits(i);
+        do_not_optimize(to_unsigned(sign_extend(bits)));
+    }));
+
+    {
+        // The largest aggregate of Wires connected in Simulator
+        decoder::Input_From_Regfile from_regfile;
+        regfile::RegFile_Output     regfile_output;
+        results.push_back(measure("connect_regfile_to_decoder", kArrayIterations, repetitions, [&](max_size_t) {
+            dark::connect(from_regfile, regfile_output);
+            do_not_optimize(from_regfile);
+        }));
+    }
+
+    {
+        regfile::RegFile_Output regfile_output;
+        results.push_back(measure("sync_member_regfile_32", kArrayIterations, repetitions, [&](max_size_t i) {
+            regfile_output.data[i % 32] <= i;
+            sync_member(regfile_output);
+            do_not_optimize(regfile_output);
+        }));
+    }
+
+    {
+        // The ROB values read by the decoder, see dark::RegisterArray: connected once, then in each cycle the ROB
+        // writes the entries that changed, the sync copies those, and the decoder reads through the WireArray
+        decoder::Input_From_ROB from_rob;
+        rob::Output_To_Decoder  rob_output;
+        dark::connect(from_rob, rob_output);
+        results.push_back(measure("read_rob_from_decoder", kIterations, repetitions, [&](max_size_t i) {
+            do_not_optimize(to_unsigned(from_rob.value[i % ROB_SIZE]));
+        }));
+        results.push_back(measure("sync_member_rob_to_decoder", kIterations, repetitions, [&](max_size_t i) {
+            for (max_size_t k = 0; k < kChangedEntries; ++k) {
+                rob_output.value[(i * kChangedEntries + k) % ROB_SIZE] <= i;
+                rob_output.ready[(i * kChangedEntries + k) % ROB_SIZE] <= 1;
+            }
+            sync_member(rob_output);
+            do_not_optimize(to_unsigned(from_rob.value[i % ROB_SIZE]));
+        }));
+    }
+
+    std::string json = "{\n  \"rob_size\": " + std::to_string(ROB_SIZE) + ",\n  \"benchmarks\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        char line[256];
+        std::snprintf(line, sizeof(line), "    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f}%s\n",
+                      results[i].name.c_str(), results[i].iterations, results[i].ns_per_op,
+                      i + 1 == results.size() ? "" : ",");
+        json += line;
+    }
+    json += "  ]\n}\n";
+
+    std::FILE* output = output_path ? std::fopen(output_path, "w") : stdout;
+    if (!output) {
+        std::fprintf(stderr, "Failed to open %s\n", output_path);
+        return 1;
+    }
+    std::fputs(json.c_str(), output);
+    if (output != stdout) std::fclose(output);
+    return 0;
+}
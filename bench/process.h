@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/// The outcome of running a program image through the interpreter or the simulator once.
+struct Process_Result {
+    bool        ok          = false; // exited normally with status 0
+    double      seconds     = 0;     // wall time
+    long        peak_rss_kb = 0;
+    std::string output;
+    std::string errors; // empty unless captured
+};
+
+inline std::string read_all(std::FILE* file) {
+    std::string content;
+    char        buffer[4096];
+    std::rewind(file);
+    for (std::size_t n; (n = std::fread(buffer, 1, sizeof(buffer), file)) > 0;) content.append(buffer, n);
+    return content;
+}
+
+/**
+ * Runs `executable` with `arguments`, feeding it `input` as stdin.
+ * @param capture_errors keep stderr, which the interpreter floods with its trace.
+ */
+inline Process_Result run_program(const std::string& executable, const std::vector<std::string>& arguments,
+                                  const std::string& input, bool capture_errors) {
+    Process_Result result;
+    int            input_fd = open(input.c_str(), O_RDONLY);
+    if (input_fd < 0) return result;
+    std::FILE* out = std::tmpfile();
+    std::FILE* err = capture_errors ? std::tmpfile() : std::fopen("/dev/null", "w");
+
+    std::vector<char*> argv{const_cast<char*>(executable.c_str())};
+    for (const auto& argument : arguments) argv.push_back(const_cast<char*>(argument.c_str()));
+    argv.push_back(nullptr);
+
+    auto  begin = std::chrono::steady_clock::now();
+    pid_t pid   = fork();
+    if (pid == 0) {
+        dup2(input_fd, STDIN_FILENO);
+        dup2(fileno(out), STDOUT_FILENO);
+        dup2(fileno(err), STDERR_FILENO);
+        execv(executable.c_str(), argv.data());
+        _exit(127);
+    }
+    int           status = 0;
+    struct rusage usage  = {};
+    wait4(pid, &status, 0, &usage);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    close(input_fd);
+
+    result.ok          = pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    result.seconds     = elapsed.count();
+    result.peak_rss_kb = usage.ru_maxrss;
+    result.output      = read_all(out);
+    if (capture_errors) result.errors = read_all(err);
+    std::fclose(out);
+    std::fclose(err);
+    return result;
+}
+
+/// Reads a `name: value` line of the simulator report, e.g. `cpu cycle count: 1234`.
+inline bool find_stat(const std::string& report, const std::string& name, double& value) {
+    auto pos = report.find("\n" + name + ": ");
+    if (pos == std::string::npos) return false;
+    value = std::strtod(report.c_str() + pos + name.size() + 3, nullptr);
+    return true;
+}
@@ -0,0 +1,168 @@
+/**
+ * Checks the simulated timing against a checked-in table of golden results:
+ * cpu cycle count, branch count and branch prediction accuracy per configuration and testcase.
+ * The simulator is deterministic, so any drift means that a change altered the simulated timing.
+ * Each run must also print the result of the interpreter, so a configuration computing a wrong one fails. A program
+ * whose result is known independently of both, e.g. worked out by hand, keeps it in `<testcase>.out` next to its
+ * image, and the interpreter and the simulator must print it.
+ *
+ * Usage: regress <interpreter> <simulator> <corpus dir> <golden file>
+ *                [--config <name>] [--arg <simulator argument>]... [--tolerance <ratio>] [--update]
+ *   --config     the configuration the rows belong to (default `default`)
+ *   --arg        passed on to the simulator, e.g. to select a configuration at run time (repeatable)
+ *   --tolerance  relative drift of cycles and branches, and absolute drift of accuracy, allowed (default 0)
+ *   --update     rewrite the rows of this configuration with the measured results, keeping the others
+ *
+ * The exit status is 1 if any program fails, prints another result than the interpreter or its `.out` file, or
+ * drifts beyond the tolerance.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "process.h"
+
+namespace {
+
+struct Golden_Entry {
+    double cycles   = 0;
+    double branches = 0;
+    double accuracy = 0;
+};
+
+using Golden_Table = std::map<std::pair<std::string, std::string>, Golden_Entry>; // (config, testcase)
+
+Golden_Table load_golden(const std::string& path) {
+    Golden_Table  table;
+    std::ifstream file(path);
+    for (std::string line; std::getline(file, line);) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream stream(line);
+        std::string        config, name;
+        Golden_Entry       entry;
+        if (stream >> config >> name >> entry.cycles >> entry.branches >> entry.accuracy) {
+            table[{config, name}] = entry;
+        }
+    }
+    return table;
+}
+
+void save_golden(const std::string& path, const Golden_Table& table) {
+    std::ofstream file(path);
+    file << "# Written by `regress --update` (cmake --build <dir> --target regress-update).\n"
+         << "# config  testcase  cpu_cycle_count  branch_count  branch_prediction_accuracy\n";
+    for (const auto& [key, entry] : table) {
+        char line[256];
+        std::snprintf(line, sizeof(line), "%s %s %.0f %.0f %.6f\n", key.first.c_str(), key.second.c_str(),
+                      entry.cycles, entry.branches, entry.accuracy);
+        file << line;
+    }
+}
+
+/// The known output of a program, empty if it has no `.out` file.
+std::string load_expected_output(const std::filesystem::path& path) {
+    std::ifstream     file(path);
+    std::stringstream stream;
+    stream << file.rdbuf();
+    return stream.str();
+}
+
+bool drifted(double actual, double expected, double tolerance) {
+    return std::fabs(actual - expected) > std::fabs(expected) * tolerance;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 5) {
+        std::cerr << "Usage: " << argv[0] << " <interpreter> <simulator> <corpus dir> <golden file> [--config <name>]"
+                  << " [--arg <simulator argument>]... [--tolerance <ratio>] [--update]" << std::endl;
+        return 1;
+    }
+    const std::string        interpreter = argv[1], simulator = argv[2], corpus = argv[3], golden_path = argv[4];
+    std::string              config    = "default";
+    std::vector<std::string> arguments;
+    double                   tolerance = 0;
+    bool                     update    = false;
+    for (int i = 5; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            config = argv[++i];
+        } else if (std::strcmp(argv[i], "--arg") == 0 && i + 1 < argc) {
+            arguments.emplace_back(argv[++i]);
+        } else if (std::strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "--update") == 0) {
+            update = true;
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::string> names;
+    for (const auto& entry : std::filesystem::directory_iterator(corpus)) {
+        if (entry.path().extension() == ".data") names.push_back(entry.path().stem().string());
+    }
+    std::sort(names.begin(), names.end());
+
+    auto golden = load_golden(golden_path);
+    auto result = golden;
+    bool failed = false;
+
+    std::printf("%-10s %-10s %12s %12s %10s %10s %10s %10s  %s\n", "config", "testcase", "cycles", "golden",
+                "branches", "golden", "accuracy", "golden", "verdict");
+    for (const auto& name : names) {
+        auto input  = (std::filesystem::path(corpus) / (name + ".data")).string();
+        auto run    = run_program(simulator, arguments, input, true);
+        auto interp = run_program(interpreter, {}, input, false);
+        auto known  = load_expected_output(std::filesystem::path(corpus) / (name + ".out"));
+
+        Golden_Entry actual;
+        bool         parsed = find_stat(run.errors, "cpu cycle count", actual.cycles)
+                      && find_stat(run.errors, "branch count", actual.branches)
+                      && find_stat(run.errors, "branch prediction accuracy", actual.accuracy);
+        if (std::isnan(actual.accuracy)) actual.accuracy = 0; // no branches at all
+
+        auto        it       = golden.find({config, name});
+        const auto* expected = it == golden.end() ? nullptr : &it->second;
+        std::string verdict  = "ok";
+        if (!run.ok || !parsed || !interp.ok) {
+            verdict = "FAILED";
+        } else if (run.output != interp.output || (!known.empty() && run.output != known)) {
+            verdict = "WRONG OUTPUT";
+        } else if (update) {
+            result[{config, name}] = actual;
+            verdict                = expected ? "updated" : "added";
+        } else if (!expected) {
+            verdict = "no golden";
+        } else if (drifted(actual.cycles, expected->cycles, tolerance)
+                   || drifted(actual.branches, expected->branches, tolerance)
+                   || std::fabs(actual.accuracy - expected->accuracy) > tolerance + 1e-6) {
+            verdict = "DRIFTED";
+        }
+        if (verdict == "FAILED" || verdict == "WRONG OUTPUT" || verdict == "DRIFTED") failed = true;
+
+        std::printf("%-10s %-10s %12.0f %12.0f %10.0f %10.0f %10.6f %10.6f  %s\n", config.c_str(), name.c_str(),
+                    actual.cycles, expected ? expected->cycles : 0, actual.branches,
+                    expected ? expected->branches : 0, actual.accuracy, expected ? expected->accuracy : 0,
+                    verdict.c_str());
+    }
+
+    if (update && !failed) {
+        save_golden(golden_path, result);
+        std::printf("golden results written to %s\n", golden_path.c_str());
+    } else if (update) {
+        std::printf("golden results not written, as some programs failed\n");
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+/**
+ * Measures the host time per simulated cycle of simulators built with different window sizes, see src/constants.h,
+ * and how it grows with the number of ROB entries.
+ *
+ * Usage: window <corpus dir> --window <rob entries> <simulator>...
+ *               [--arg <simulator argument>]... [--runs <n>] [--max-exponent <x>]
+ *   --window        a simulator built with that many ROB entries, smallest first (repeatable)
+ *   --arg           passed on to every simulator, e.g. a wide configuration that fills the window (repeatable)
+ *   --runs          run each program n times and keep the fastest run (default 3)
+ *   --max-exponent  the host cost per cycle may grow as (ROB entries)^x at most (default 1, i.e. sub-linearly)
+ *
+ * The cost of a window is the geometric mean over the corpus of the wall time per simulated cycle, and its exponent
+ * is log(cost / smallest cost) / log(entries / smallest entries).
+ * The exit status is 1 if any program fails, the simulators disagree on its output, or an exponent is too large.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "process.h"
+
+namespace {
+
+struct Window {
+    unsigned    entries = 0;
+    std::string simulator;
+};
+
+struct Measurement {
+    double      seconds = 0; // the fastest run
+    double      cycles  = 0;
+    std::string output;
+    bool        ok = true;
+};
+
+Measurement measure(const std::string& simulator, const std::vector<std::string>& arguments,
+                    const std::string& input, int runs) {
+    Measurement result;
+    for (int i = 0; i < runs; ++i) {
+        auto run = run_program(simulator, arguments, input, true);
+        if (!run.ok || !find_stat(run.errors, "cpu cycle count", result.cycles)) result.ok = false;
+        if (i == 0 || run.seconds < result.seconds) result.seconds = run.seconds;
+        result.output = std::move(run.output);
+    }
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <corpus dir> --window <rob entries> <simulator>..."
+                  << " [--arg <simulator argument>]... [--runs <n>] [--max-exponent <x>]" << std::endl;
+        return 1;
+    }
+    const std::string        corpus = argv[1];
+    std::vector<Window>      windows;
+    std::vector<std::string> arguments;
+    int                      runs         = 3;
+    double                   max_exponent = 1;
+    for (int i = 2; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--window") == 0 && i + 2 < argc) {
+            unsigned entries = std::strtoul(argv[i + 1], nullptr, 10);
+            if (!windows.empty() && entries <= windows.back().entries) {
+                std::cerr << "The windows must be given smallest first" << std::endl;
+                return 1;
+            }
+            windows.push_back({entries, argv[i + 2]});
+            i += 2;
+        } else if (std::strcmp(argv[i], "--arg") == 0 && i + 1 < argc) {
+            arguments.emplace_back(argv[++i]);
+        } else if (std::strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--max-exponent") == 0 && i + 1 < argc) {
+            max_exponent = std::strtod(argv[++i], nullptr);
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (windows.empty()) {
+        std::cerr << "No simulator is given" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> names;
+    for (const auto& entry : std::filesystem::directory_iterator(corpus)) {
+        if (entry.path().extension() == ".data") names.push_back(entry.path().stem().string());
+    }
+    std::sort(names.begin(), names.end());
+
+    bool                     failed = false;
+    std::vector<std::string> outputs(names.size()); // of the smallest window
+    std::vector<double>      costs;                 // geometric mean of the nanoseconds per cycle, by window
+
+    std::printf("%-8s %-10s %12s %10s %12s  %s\n", "rob", "testcase", "cycles", "seconds", "ns/cycle", "verdict");
+    for (const auto& window : windows) {
+        double log_sum = 0;
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            auto input  = (std::filesystem::path(corpus) / (names[i] + ".data")).string();
+            auto result = measure(window.simulator, arguments, input, runs);
+            if (&window == &windows.front()) outputs[i] = result.output;
+
+            std::string verdict = "ok";
+            double      cost    = 0;
+            if (!result.ok || result.cycles == 0) {
+                verdict = "FAILED";
+            } else if (result.output != outputs[i]) {
+                verdict = "WRONG OUTPUT";
+            } else {
+                cost = result.seconds / result.cycles * 1e9;
+                log_sum += std::log(cost);
+            }
+            if (verdict != "ok") failed = true;
+            std::printf("%-8u %-10s %12.0f %10.4f %12.1f  %s\n", window.entries, names[i].c_str(), result.cycles,
+                        result.seconds, cost, verdict.c_str());
+        }
+        costs.push_back(std::exp(log_sum / names.size()));
+    }
+
+    std::printf("\n%-8s %12s %10s %10s  %s\n", "rob", "ns/cycle", "ratio", "exponent", "verdict");
+    for (std::size_t i = 0; i < windows.size(); ++i) {
+        double      ratio    = costs[i] / costs[0];
+        double      exponent = 0;
+        std::string verdict  = "baseline";
+        if (i != 0) {
+            exponent = std::log(ratio) / std::log(static_cast<double>(windows[i].entries) / windows[0].entries);
+            verdict  = exponent < max_exponent ? "ok" : "TOO STEEP";
+            if (exponent >= max_exponent) failed = true;
+        }
+        std::printf("%-8u %12.1f %10.3f %10.3f  %s\n", windows[i].entries, costs[i], ratio, exponent,
+                    verdict.c_str());
+    }
+    return failed ? 1 : 0;
+}
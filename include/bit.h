@@ -13,7 +13,11 @@ private:
 	static_assert(0 < _Nm && _Nm <= kMaxLength,
 				  "Bit: _Nm out of range. Should be in [1, kMaxLength]");
 
+#ifdef DARK_PACKED_STORAGE
 	max_size_t _M_data : _Nm = 0; // Real storage
+#else
+	max_size_t _M_data = 0; // Real storage, always truncated to _Nm bits
+#endif
 
 	template<std::size_t _Hi, std::size_t _Lo>
 	static constexpr void _M_range_check();
@@ -21,7 +25,7 @@ private:
 public:
 	static constexpr std::size_t _Bit_Len = _Nm;
 
-	constexpr Bit(max_size_t data = 0) : _M_data(data) {}
+	constexpr Bit(max_size_t data = 0) : _M_data(truncate<_Nm>(data)) {}
 
 	constexpr explicit operator max_size_t() const { return this->_M_data; }
 
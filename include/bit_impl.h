@@ -43,12 +43,12 @@ template<std::size_t _Nm>
 template<concepts::bit_type... _Tp>
 	requires((_Tp::_Bit_Len + ...) == _Nm)
 constexpr Bit<_Nm>::Bit(const _Tp &...args)
-	: _M_data(int_concat<_Tp::_Bit_Len...>(static_cast<max_size_t>(args)...)) {}
+	: _M_data(truncate<_Nm>(int_concat<_Tp::_Bit_Len...>(static_cast<max_size_t>(args)...))) {}
 
 template<std::size_t _Nm>
 template<concepts::bit_convertible<_Nm> _Tp>
 constexpr Bit<_Nm> &Bit<_Nm>::operator=(const _Tp &val) {
-	this->_M_data = static_cast<max_size_t>(val);
+	this->_M_data = truncate<_Nm>(static_cast<max_size_t>(val));
 	return *this;
 }
 
@@ -65,8 +65,8 @@ constexpr void Bit<_Nm>::set(const _Tp &val) {
 	this->_M_range_check<_Hi, _Lo>();
 	auto data = static_cast<max_size_t>(val);
 	constexpr auto _Length = _Hi - _Lo + 1;
-	auto mask = make_mask<_Length> << _Lo;
-	this->_M_data = (this->_M_data & ~mask) | ((data << _Lo) & mask);
+	auto mask = make_mask<_Length>() << _Lo;
+	this->_M_data = truncate<_Nm>((this->_M_data & ~mask) | ((data << _Lo) & mask));
 }
 
 template<std::size_t _Nm>
@@ -16,6 +16,18 @@ consteval max_size_t make_mask() {
 	return _Len == kMaxLength ? ~max_size_t(0) : (max_size_t(1) << _Len) - 1;
 }
 
+/**
+ * Bit, Register and Wire keep their values in full max_size_t fields by default,
+ * truncating them to their width on assignment, so that a read is a plain load.
+ * Define DARK_PACKED_STORAGE to keep them in bit-fields instead,
+ * which is smaller but pays for masking and shifting on every access.
+ * Either way, the stored value is always the low _Len bits of the assigned value.
+ */
+template<std::size_t _Len>
+constexpr max_size_t truncate(max_size_t value) {
+	return value & make_mask<_Len>();
+}
+
 template <std::size_t _Len>
 struct Wire;
 
@@ -25,6 +37,9 @@ struct Register;
 template <std::size_t _Len>
 struct Bit;
 
+template <std::size_t _Len, std::size_t _Num>
+struct RegisterArray;
+
 } // namespace dark
 
 namespace dark::concepts {
@@ -65,6 +80,11 @@ inline constexpr bool is_reg_v = false;
 template <std::size_t _Len>
 inline constexpr bool is_reg_v<Register<_Len>> = true;
 
+template <typename _Tp>
+inline constexpr bool is_reg_array_v = false;
+template <std::size_t _Len, std::size_t _Num>
+inline constexpr bool is_reg_array_v<RegisterArray<_Len, _Num>> = true;
+
 template <typename _Tp>
 inline constexpr bool is_wire_v = false;
 template <std::size_t _Len>
@@ -1,65 +1,180 @@
 #pragma once
+#include "debug.h"
 #include "module.h"
 #include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <memory>
+#include <numeric>
 #include <random>
+#include <string>
 #include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 namespace dark {
 
+struct ObserverBase {
+	virtual void observe(unsigned long long cycle) = 0;
+	virtual ~ObserverBase() = default;
+};
+
 class CPU {
 private:
 	std::vector<std::unique_ptr<ModuleBase>> mod_owned;
 	std::vector<ModuleBase *> modules;
+	std::vector<ObserverBase *> observers;
+	std::vector<std::size_t> order; // the order in which the modules work in this cycle
+
+	/* Host time spent in each module, accumulated over the sampled cycles only. */
+	struct HostTime {
+		std::string name;
+		unsigned long long work = 0;
+		unsigned long long sync = 0;
+	};
+	static constexpr unsigned long long kNotSampled = ~0ull;
+	std::vector<HostTime> host_time;
+	HostTime observer_time{"(observers)"};
+	unsigned long long sample_mask = kNotSampled; // a cycle is sampled iff (cycles & sample_mask) == 0
+	unsigned long long sampled_cycles = 0;
+	std::chrono::steady_clock::time_point start_time;
+	unsigned long long start_cycle = 0;
 
 public:
 	unsigned long long cycles = 0;
 
 private:
+	/* rdtsc where available, as the profiler reads the clock twice per module in each sampled cycle. */
+	static unsigned long long ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+	}
+
+	bool sampled() const { return sample_mask != kNotSampled && (cycles & sample_mask) == 0; }
+
 	void sync_all() {
 		for (auto &module: modules)
 			module->sync();
+		for (auto &observer: observers)
+			observer->observe(cycles);
+	}
+
+	void run_sampled() {
+		++sampled_cycles;
+		for (auto i: order) {
+			auto begin = ticks();
+			modules[i]->work();
+			host_time[i].work += ticks() - begin;
+		}
+		for (std::size_t i = 0; i < modules.size(); ++i) {
+			auto begin = ticks();
+			modules[i]->sync();
+			host_time[i].sync += ticks() - begin;
+		}
+		auto begin = ticks();
+		for (auto &observer: observers)
+			observer->observe(cycles);
+		observer_time.sync += ticks() - begin;
+	}
+
+	void register_module(ModuleBase *module, std::string name) {
+		if (name.empty()) name = "module " + std::to_string(modules.size());
+		modules.push_back(module);
+		order.push_back(order.size());
+		host_time.push_back({std::move(name)});
 	}
 
 public:
 	/// @attention the pointer will be moved. you SHOULD NOT use it after calling this function.
 	template<typename _Tp>
 		requires std::derived_from<_Tp, ModuleBase>
-	void add_module(std::unique_ptr<_Tp> &module) {
-		modules.push_back(module.get());
+	void add_module(std::unique_ptr<_Tp> &module, std::string name = {}) {
+		register_module(module.get(), std::move(name));
 		mod_owned.emplace_back(std::move(module));
 	}
-	void add_module(std::unique_ptr<ModuleBase> module) {
-		modules.push_back(module.get());
+	void add_module(std::unique_ptr<ModuleBase> module, std::string name = {}) {
+		register_module(module.get(), std::move(name));
 		mod_owned.emplace_back(std::move(module));
 	}
-	void add_module(ModuleBase *module) {
-		modules.push_back(module);
+	/// @param name only used in the host profile report.
+	void add_module(ModuleBase *module, std::string name = {}) {
+		register_module(module, std::move(name));
+	}
+	/// Observers are notified at the end of every cycle, after all modules are synchronized.
+	void add_observer(ObserverBase *observer) {
+		observers.push_back(observer);
+	}
+
+	/**
+	 * Measure the host time spent in work() and sync() of each module, in 1 of every `sample_period` cycles.
+	 * @param sample_period must be a power of 2. 1 times every cycle.
+	 */
+	void enable_host_profile(unsigned long long sample_period = 1024) {
+		debug::assert(sample_period != 0 && (sample_period & (sample_period - 1)) == 0,
+					  "CPU: the sample period must be a power of 2");
+		sample_mask = sample_period - 1;
 	}
 
 	void run_once() {
 		++cycles;
+		if (sampled()) return run_sampled();
 		for (auto &module: modules)
 			module->work();
 		sync_all();
 	}
 	void run_once_shuffle() {
 		static std::default_random_engine engine;
-		std::vector<ModuleBase *> shuffled = modules;
-		std::shuffle(shuffled.begin(), shuffled.end(), engine);
+		std::iota(order.begin(), order.end(), 0);
+		std::shuffle(order.begin(), order.end(), engine);
 
 		++cycles;
 		// std::cerr << "Cycle " << std::dec << cycles << std::endl;
-		for (auto &module: shuffled)
-			module->work();
+		if (sampled()) return run_sampled();
+		for (auto i: order)
+			modules[i]->work();
 		sync_all();
 	}
 	void run(unsigned long long max_cycles = 0, bool shuffle = false) {
+		start_time = std::chrono::steady_clock::now();
+		start_cycle = cycles;
+		std::iota(order.begin(), order.end(), 0);
 		auto func = shuffle ? &CPU::run_once_shuffle : &CPU::run_once;
 		while (max_cycles == 0 || cycles < max_cycles)
 			(this->*func)();
 	}
 	unsigned long long get_cycle_count() const { return cycles; }
+
+	/**
+	 * Print the simulation speed since run() was called, and the share of host time
+	 * spent in each module over the sampled cycles. Does nothing unless enable_host_profile was called.
+	 * @param instructions the number of instructions committed so far.
+	 */
+	void report_host_profile(unsigned long long instructions) const {
+		if (sample_mask == kNotSampled) return;
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+		double seconds = elapsed.count();
+		auto simulated = cycles - start_cycle;
+
+		unsigned long long total = observer_time.sync;
+		for (auto &time: host_time) total += time.work + time.sync;
+		auto share = [&](unsigned long long ticks) { return total == 0 ? 0.0 : 100.0 * ticks / total; };
+
+		std::fprintf(stderr, "host profile (%llu of %llu cycles sampled):\n", sampled_cycles, simulated);
+		std::fprintf(stderr, "  host time: %.3f s\n", seconds);
+		std::fprintf(stderr, "  simulated cycles per second: %.0f\n", simulated / seconds);
+		std::fprintf(stderr, "  committed instructions per second: %.0f\n", instructions / seconds);
+		std::fprintf(stderr, "  %-20s %8s %8s %8s\n", "module", "work", "sync", "total");
+		auto print = [&](const HostTime &time) {
+			std::fprintf(stderr, "  %-20s %7.2f%% %7.2f%% %7.2f%%\n", time.name.c_str(),
+						 share(time.work), share(time.sync), share(time.work + time.sync));
+		};
+		for (auto &time: host_time) print(time);
+		if (!observers.empty()) print(observer_time);
+	}
 };
 
 } // namespace dark
@@ -1,5 +1,6 @@
 #pragma once
 #include <concepts>
+#include <string_view>
 #include <tuple>
 
 namespace dark::reflect {
@@ -38,7 +39,7 @@ inline consteval auto member_size() -> std::size_t { return member_size_aux<_Tp>
 
 template<typename _Tp>
 	requires std::is_aggregate_v<_Tp>
-auto tuplify(_Tp &value) {
+constexpr auto tuplify(_Tp &value) {
 	constexpr auto size = member_size<_Tp>();
 	if constexpr (size == 1) {
 		auto &[x0] = value;
@@ -96,9 +97,52 @@ auto tuplify(_Tp &value) {
 		auto &[x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13] = value;
 		return std::forward_as_tuple(x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13);
 	}
+	else if constexpr (size == 15) {
+		auto &[x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14] = value;
+		return std::forward_as_tuple(x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14);
+	}
+	else if constexpr (size == 16) {
+		auto &[x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14, x15] = value;
+		return std::forward_as_tuple(x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14, x15);
+	}
 	else {
 		static_assert(sizeof(_Tp) == 0, "The struct has too many members.");
 	}
 }
 
+namespace details {
+
+	template<typename _Tp>
+	struct fake_wrapper { _Tp value; };
+
+	/* Never defined. Only the addresses of its members are used, in constant expressions. */
+	template<typename _Tp>
+	extern fake_wrapper<_Tp> fake_object;
+
+	template<typename _Tp>
+	struct member_pointer { const _Tp *ptr; };
+
+	template<typename _Tp, std::size_t _Index>
+	consteval auto get_member_pointer() {
+		auto &member = std::get<_Index>(tuplify(fake_object<_Tp>.value));
+		return member_pointer<std::remove_cvref_t<decltype(member)>>{&member};
+	}
+
+	/* The signature contains the member access expression, e.g. `& fake_object<A>.fake_wrapper<A>::value.A::name` */
+	template<auto _Ptr>
+	consteval std::string_view signature() { return __PRETTY_FUNCTION__; }
+
+} // namespace details
+
+/* Return the name of the _Index-th member of an aggregate type, e.g. `member_name<A, 0>() == "name"`. */
+template<typename _Tp, std::size_t _Index>
+	requires std::is_aggregate_v<_Tp>
+consteval auto member_name() -> std::string_view {
+	constexpr auto str = details::signature<details::get_member_pointer<_Tp, _Index>()>();
+	constexpr auto end = str.find("))}", str.find("fake_object<"));
+	static_assert(end != std::string_view::npos, "member_name: unsupported compiler");
+	constexpr auto begin = str.find_last_of(":.", end) + 1;
+	return str.substr(begin, end - begin);
+}
+
 } // namespace dark::reflect
@@ -12,8 +12,13 @@ private:
 
 	friend class Visitor;
 
+#ifdef DARK_PACKED_STORAGE
 	max_size_t _M_old : _Len = 0;
 	max_size_t _M_new : _Len = 0;
+#else
+	max_size_t _M_old = 0;
+	max_size_t _M_new = 0;
+#endif
 
 	[[no_unique_address]]
 	debug::DebugValue<bool, false> _M_assigned;
@@ -37,7 +42,7 @@ public:
 	void operator<=(const _Tp &value) {
 		debug::assert(!this->_M_assigned, "Register is double assigned in this cycle.");
 		this->_M_assigned = true;
-		this->_M_new = static_cast<max_size_t>(value);
+		this->_M_new = truncate<_Len>(static_cast<max_size_t>(value));
 	}
 
 	explicit operator max_size_t() const { return this->_M_old; }
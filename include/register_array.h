@@ -0,0 +1,113 @@
+#pragma once
+#include "bit.h"
+#include "concept.h"
+#include "debug.h"
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace dark {
+
+/**
+ * @brief _Num registers of _Len bits, e.g. one for each entry of a ROB.
+ * Each element behaves as a Register: it is assigned with `<=`, and the value is seen in the next cycle.
+ * Unlike std::array<Register<_Len>, _Num>, a sync only visits the elements assigned in the cycle,
+ * so a large array of which a few elements change in a cycle costs as much as those few.
+ * Another module reads it through a WireArray.
+ */
+template<std::size_t _Len, std::size_t _Num>
+struct RegisterArray {
+private:
+	static_assert(0 < _Len && _Len <= kMaxLength,
+				  "RegisterArray: _Len must be in range [1, kMaxLength].");
+
+	friend class Visitor;
+
+	std::array<max_size_t, _Num> _M_old = {};
+	std::array<max_size_t, _Num> _M_new = {};
+	std::vector<std::size_t> _M_assigned; // the elements assigned in this cycle
+
+	void sync() {
+		for (auto index: this->_M_assigned)
+			this->_M_old[index] = this->_M_new[index];
+		this->_M_assigned.clear();
+	}
+
+	void _M_assign(std::size_t index, max_size_t value) {
+#ifdef _DEBUG
+		debug::assert(std::find(this->_M_assigned.begin(), this->_M_assigned.end(), index) == this->_M_assigned.end(),
+					  "RegisterArray: an element is double assigned in this cycle.");
+#endif
+		this->_M_assigned.push_back(index);
+		this->_M_new[index] = truncate<_Len>(value);
+	}
+
+	struct Element {
+		static constexpr std::size_t _Bit_Len = _Len;
+
+		RegisterArray *array;
+		std::size_t index;
+
+		template<concepts::bit_convertible<_Len> _Tp>
+		void operator<=(const _Tp &value) { array->_M_assign(index, static_cast<max_size_t>(value)); }
+
+		explicit operator max_size_t() const { return array->_M_old[index]; }
+	};
+
+public:
+	static constexpr std::size_t _Bit_Len = _Len;
+
+	RegisterArray() { this->_M_assigned.reserve(_Num); }
+
+	RegisterArray(RegisterArray &&) = delete;
+	RegisterArray(const RegisterArray &) = delete;
+	RegisterArray &operator=(RegisterArray &&) = delete;
+	RegisterArray &operator=(const RegisterArray &) = delete;
+
+	static constexpr std::size_t size() { return _Num; }
+
+	Element operator[](std::size_t index) { return {this, index}; }
+	Bit<_Len> operator[](std::size_t index) const { return this->_M_old[index]; }
+
+	/// The current value of every element, e.g. for dumping.
+	const max_size_t *data() const { return this->_M_old.data(); }
+};
+
+/**
+ * @brief Reads the elements of a RegisterArray of another module, as a Wire reads a Register.
+ * Assign it the RegisterArray, or let connect() do so.
+ */
+template<std::size_t _Len, std::size_t _Num>
+struct WireArray {
+private:
+	friend class Visitor;
+
+	const RegisterArray<_Len, _Num> *_M_source = nullptr;
+
+	void sync() { /* nothing is cached */ }
+
+public:
+	static constexpr std::size_t _Bit_Len = _Len;
+
+	WireArray() = default;
+
+	WireArray(WireArray &&) = delete;
+	WireArray(const WireArray &) = delete;
+	WireArray &operator=(WireArray &&) = delete;
+	WireArray &operator=(const WireArray &) = delete;
+
+	WireArray &operator=(const RegisterArray<_Len, _Num> &source) {
+		debug::assert(this->_M_source == nullptr, "WireArray is assigned twice.");
+		this->_M_source = &source;
+		return *this;
+	}
+
+	static constexpr std::size_t size() { return _Num; }
+
+	Bit<_Len> operator[](std::size_t index) const {
+		debug::assert(this->_M_source != nullptr, "Empty wire array is read.");
+		return (*this->_M_source)[index];
+	}
+};
+
+} // namespace dark
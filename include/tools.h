@@ -3,11 +3,13 @@
 #include "bit_impl.h"
 #include "operator.h"
 #include "register.h"
+#include "register_array.h"
 #include "synchronize.h"
 #include "wire.h"
 #include "module.h"
 #include "misc.h"
 #include "cpu.h"
+#include "vcd.h"
 
 namespace dark {
 
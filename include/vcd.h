@@ -0,0 +1,267 @@
+#pragma once
+#include "concept.h"
+#include "cpu.h"
+#include "debug.h"
+#include "module.h"
+#include "reflect.h"
+#include "synchronize.h"
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace dark {
+
+/**
+ * @brief Dumps the output registers of modules into a VCD file.
+ * Signals are named after the members found by reflection, e.g. `rob.to_fetcher.pc`.
+ * Only the signals whose value changed are written at the end of each cycle.
+ *
+ * In ring mode, only the last N cycles are kept in memory.
+ * They are written out when the writer is closed, which also happens on std::exit,
+ * e.g. when an assertion fails.
+ */
+class VCDWriter final : public ObserverBase {
+private:
+	struct Signal {
+		std::string name;
+		std::size_t width;
+		const void *reg;
+		max_size_t (*read)(const void *);
+		max_size_t value;
+	};
+
+	struct Change {
+		std::size_t signal;
+		max_size_t value;
+	};
+
+	struct Cycle {
+		unsigned long long time;
+		std::vector<Change> changes;
+	};
+
+	static constexpr std::size_t kBufferSize = 1 << 20;
+
+	std::vector<Signal> signals;
+	std::vector<std::string> filters;
+	std::FILE *file = nullptr;
+	std::string buffer;
+	bool started = false;
+
+	std::size_t ring_cycles = 0; // 0 means streaming everything to the file
+	std::deque<Cycle> ring;
+	std::vector<max_size_t> base; // values right before the first cycle in the ring
+	unsigned long long base_time = 0;
+
+	static std::vector<VCDWriter *> &open_writers() {
+		static std::vector<VCDWriter *> writers;
+		return writers;
+	}
+
+	static bool glob(std::string_view pattern, std::string_view name) {
+		if (pattern.empty()) return name.empty();
+		if (pattern[0] == '*') {
+			for (std::size_t i = 0; i <= name.size(); ++i)
+				if (glob(pattern.substr(1), name.substr(i))) return true;
+			return false;
+		}
+		return !name.empty() && pattern[0] == name[0] && glob(pattern.substr(1), name.substr(1));
+	}
+
+	/* A filter selects the signals it matches, and everything below them. */
+	bool selected(const std::string &name) const {
+		if (filters.empty()) return true;
+		for (auto &filter: filters) {
+			if (glob(filter, name) || glob(filter + ".*", name) || glob(filter + "[*", name))
+				return true;
+		}
+		return false;
+	}
+
+	template<typename _Tp>
+	void walk(_Tp &value, const std::string &name) {
+		using _Vp = std::remove_const_t<_Tp>;
+		if constexpr (concepts::is_reg_v<_Vp>) {
+			if (!selected(name)) return;
+			auto read = [](const void *reg) {
+				return static_cast<max_size_t>(*static_cast<const _Vp *>(reg));
+			};
+			signals.push_back({name, _Vp::_Bit_Len, &value, read, 0});
+		}
+		else if constexpr (concepts::is_reg_array_v<_Vp>) {
+			auto read = [](const void *element) { return *static_cast<const max_size_t *>(element); };
+			for (std::size_t i = 0; i < value.size(); ++i) {
+				auto element = name + "[" + std::to_string(i) + "]";
+				if (selected(element)) signals.push_back({element, _Vp::_Bit_Len, value.data() + i, read, 0});
+			}
+		}
+		else if constexpr (concepts::is_std_array_v<_Vp>) {
+			for (std::size_t i = 0; i < value.size(); ++i)
+				walk(value[i], name + "[" + std::to_string(i) + "]");
+		}
+		else if constexpr (std::is_aggregate_v<_Vp> && !concepts::is_wire_v<_Vp>) {
+			walk_members(value, name, std::make_index_sequence<reflect::member_size<_Vp>()>{});
+		}
+		/* Wires, Bits and anything else are not dumped. */
+	}
+
+	template<typename _Tp, std::size_t... _Index>
+	void walk_members(_Tp &value, const std::string &name, std::index_sequence<_Index...>) {
+		using _Vp = std::remove_const_t<_Tp>;
+		auto tuple = reflect::tuplify(value);
+		(walk(std::get<_Index>(tuple), name + "." + std::string(reflect::member_name<_Vp, _Index>())), ...);
+	}
+
+	static std::string identifier(std::size_t index) {
+		std::string id;
+		do {
+			id += static_cast<char>('!' + index % 94);
+			index /= 94;
+		} while (index != 0);
+		return id;
+	}
+
+	void write_value(std::size_t index, max_size_t value) {
+		if (signals[index].width == 1) {
+			buffer += value ? '1' : '0';
+		} else {
+			buffer += 'b';
+			int bit = static_cast<int>(signals[index].width) - 1;
+			while (bit > 0 && !((value >> bit) & 1)) --bit;
+			for (; bit >= 0; --bit) buffer += ((value >> bit) & 1) ? '1' : '0';
+			buffer += ' ';
+		}
+		buffer += identifier(index);
+		buffer += '\n';
+		if (buffer.size() >= kBufferSize) flush();
+	}
+
+	void write_time(unsigned long long time) {
+		buffer += '#';
+		buffer += std::to_string(time);
+		buffer += '\n';
+	}
+
+	void write_header() {
+		buffer += "$timescale 1ns $end\n";
+		std::vector<std::string> scope;
+		for (std::size_t i = 0; i < signals.size(); ++i) {
+			std::vector<std::string> path;
+			std::string_view name = signals[i].name;
+			for (auto pos = name.find('.'); pos != std::string_view::npos; pos = name.find('.')) {
+				path.emplace_back(name.substr(0, pos));
+				name.remove_prefix(pos + 1);
+			}
+			std::size_t common = 0;
+			while (common < scope.size() && common < path.size() && scope[common] == path[common]) ++common;
+			for (std::size_t j = common; j < scope.size(); ++j) buffer += "$upscope $end\n";
+			for (std::size_t j = common; j < path.size(); ++j) buffer += "$scope module " + path[j] + " $end\n";
+			scope = std::move(path);
+			buffer += "$var wire " + std::to_string(signals[i].width) + " " + identifier(i) + " "
+					+ std::string(name) + " $end\n";
+		}
+		for (std::size_t j = 0; j < scope.size(); ++j) buffer += "$upscope $end\n";
+		buffer += "$enddefinitions $end\n";
+	}
+
+	void write_dumpvars(unsigned long long time, const std::vector<max_size_t> &values) {
+		write_time(time);
+		buffer += "$dumpvars\n";
+		for (std::size_t i = 0; i < signals.size(); ++i) write_value(i, values[i]);
+		buffer += "$end\n";
+	}
+
+	void flush() {
+		if (file) std::fwrite(buffer.data(), 1, buffer.size(), file);
+		buffer.clear();
+	}
+
+public:
+	VCDWriter() = default;
+	VCDWriter(const VCDWriter &) = delete;
+	VCDWriter &operator=(const VCDWriter &) = delete;
+	~VCDWriter() override { close(); }
+
+	/// Only the signals matching one of the glob patterns, or lying below them, are dumped. Call before add_module.
+	void add_filter(std::string pattern) { filters.emplace_back(std::move(pattern)); }
+
+	/// Registers the output registers of a module, named `name.member.member...`.
+	template<typename _Tinput, typename _Toutput, typename _Tprivate>
+	void add_module(const std::string &name, Module<_Tinput, _Toutput, _Tprivate> &module) {
+		walk(static_cast<_Toutput &>(module), name);
+	}
+
+	/**
+	 * @param ring 0 to stream every cycle into the file,
+	 * otherwise only the last `ring` cycles are kept and written out on close.
+	 */
+	void open(const char *path, std::size_t ring = 0) {
+		file = std::fopen(path, "w");
+		debug::assert(file != nullptr, "VCDWriter: failed to open the file");
+		ring_cycles = ring;
+		if (open_writers().empty()) {
+			std::atexit([] {
+				for (auto *writer: open_writers()) writer->close();
+			});
+		}
+		open_writers().push_back(this);
+	}
+
+	void observe(unsigned long long cycle) override {
+		if (!file) return;
+		if (!started) {
+			started = true;
+			base.resize(signals.size());
+			for (std::size_t i = 0; i < signals.size(); ++i)
+				base[i] = signals[i].value = signals[i].read(signals[i].reg);
+			base_time = cycle;
+			if (ring_cycles == 0) {
+				write_header();
+				write_dumpvars(cycle, base);
+			}
+			return;
+		}
+
+		Cycle record{cycle, {}};
+		for (std::size_t i = 0; i < signals.size(); ++i) {
+			auto value = signals[i].read(signals[i].reg);
+			if (value == signals[i].value) continue;
+			signals[i].value = value;
+			record.changes.push_back({i, value});
+		}
+
+		if (ring_cycles == 0) {
+			if (record.changes.empty()) return;
+			write_time(cycle);
+			for (auto &change: record.changes) write_value(change.signal, change.value);
+			return;
+		}
+
+		if (!record.changes.empty()) ring.push_back(std::move(record));
+		while (!ring.empty() && ring.front().time + ring_cycles <= cycle) {
+			for (auto &change: ring.front().changes) base[change.signal] = change.value;
+			base_time = ring.front().time;
+			ring.pop_front();
+		}
+	}
+
+	void close() {
+		if (!file) return;
+		if (ring_cycles != 0 && started) {
+			write_header();
+			write_dumpvars(base_time, base);
+			for (auto &record: ring) {
+				write_time(record.time);
+				for (auto &change: record.changes) write_value(change.signal, change.value);
+			}
+		}
+		flush();
+		std::fclose(file);
+		file = nullptr;
+		std::erase(open_writers(), this);
+	}
+};
+
+} // namespace dark
@@ -53,7 +53,11 @@ private:
 
 	_Manage_t _M_func = 0;
 
+#ifdef DARK_PACKED_STORAGE
 	mutable max_size_t _M_cache : _Len;
+#else
+	mutable max_size_t _M_cache;
+#endif
 	mutable bool _M_holds;
 
 	[[no_unique_address]]
@@ -82,7 +86,7 @@ public:
 	explicit operator max_size_t() const {
 		if (this->_M_holds == false) {
 			this->_M_holds = true;
-			this->_M_cache = this->_M_func->call();
+			this->_M_cache = truncate<_Len>(this->_M_func->call());
 		}
 		return this->_M_cache;
 	}
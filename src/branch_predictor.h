@@ -171,6 +171,10 @@ public:
         return table[index % size];
     }
 
+    const TAGEPredictionEntry& getEntry(uint32_t index) const {
+        return table[index % size];
+    }
+
     uint32_t getHistoryLength() const {
         return historyLength;
     }
@@ -191,32 +195,34 @@ public:
         tables.emplace_back(size, historyLength);
     }
 
+    /// Predicts with the global history, which holds the predicted directions of the branches fetched so far.
     bool predict(uint32_t pc) {
-        int providerTableIdx = -1;
-        for (size_t i = 0; i < tables.size(); ++i) {
-            uint32_t    index = get_index(pc, i);
-            const auto& entry = tables[i].getEntry(index);
-            if (entry.tag == get_tag(pc, i)) {
-                providerTableIdx = i;
-            }
-        }
+        return predict(pc, global_history);
+    }
 
-        if (providerTableIdx >= 0) {
-            const auto& entry = tables[providerTableIdx].getEntry(get_index(pc, providerTableIdx));
-            return entry.counter >= 0;
-        }
+    /// Shifts the predicted direction of a branch being fetched into the global history.
+    void speculate(bool taken) {
+        update_global_history(taken);
+    }
 
-        return base_predictor[pc % PREDICTOR_SIZE] >= 0; // Base predictor
+    /// The global history, to restore when the fetch is redirected to the instruction it was read before.
+    uint32_t history() const {
+        return global_history;
+    }
+
+    void restore(uint32_t history) {
+        global_history = history;
     }
 
-    void update(uint32_t pc, bool taken) {
-        bool pred             = predict(pc);
+    /// Trains the tables with the direction of a branch, and `history`, the global history it was predicted with.
+    void update(uint32_t pc, bool taken, uint32_t history) {
+        bool pred             = predict(pc, history);
         int  providerTableIdx = -1;
 
         for (size_t i = 0; i < tables.size(); ++i) {
-            uint32_t index = get_index(pc, i);
+            uint32_t index = get_index(pc, i, history);
             auto&    entry = tables[i].getEntry(index);
-            if (entry.tag == get_tag(pc, i)) {
+            if (entry.tag == get_tag(pc, i, history)) {
                 providerTableIdx = i;
                 break;
             }
@@ -224,7 +230,7 @@ public:
 
         // Update the provider
         if (providerTableIdx >= 0) {
-            auto& entry = tables[providerTableIdx].getEntry(get_index(pc, providerTableIdx));
+            auto& entry = tables[providerTableIdx].getEntry(get_index(pc, providerTableIdx, history));
             if (taken) {
                 if (entry.counter < 1) entry.counter++;
             } else {
@@ -243,17 +249,15 @@ public:
         // Allocate new entry if misprediction
         if (pred != taken && providerTableIdx < static_cast<int>(tables.size()) - 1) {
             for (size_t i = providerTableIdx + 1; i < tables.size(); ++i) {
-                uint32_t index = get_index(pc, i);
+                uint32_t index = get_index(pc, i, history);
                 auto&    entry = tables[i].getEntry(index);
                 if (entry.counter == -1 || entry.counter == 0) {
                     entry.counter = taken ? 0 : -1;
-                    entry.tag     = get_tag(pc, i);
+                    entry.tag     = get_tag(pc, i, history);
                     break;
                 }
             }
         }
-
-        update_global_history(taken);
     }
 
     void reset() {
@@ -272,13 +276,31 @@ private:
     int8_t                           base_predictor[PREDICTOR_SIZE]{};
     uint32_t                         global_history = 0;
 
-    uint32_t get_index(uint32_t pc, size_t tableIndex) const {
-        return (pc ^ (global_history & ((1 << tables[tableIndex].getHistoryLength()) - 1))) % tables[tableIndex].
+    bool predict(uint32_t pc, uint32_t history) const {
+        int providerTableIdx = -1;
+        for (size_t i = 0; i < tables.size(); ++i) {
+            uint32_t    index = get_index(pc, i, history);
+            const auto& entry = tables[i].getEntry(index);
+            if (entry.tag == get_tag(pc, i, history)) {
+                providerTableIdx = i;
+            }
+        }
+
+        if (providerTableIdx >= 0) {
+            const auto& entry = tables[providerTableIdx].getEntry(get_index(pc, providerTableIdx, history));
+            return entry.counter >= 0;
+        }
+
+        return base_predictor[pc % PREDICTOR_SIZE] >= 0; // Base predictor
+    }
+
+    uint32_t get_index(uint32_t pc, size_t tableIndex, uint32_t history) const {
+        return (pc ^ (history & ((1 << tables[tableIndex].getHistoryLength()) - 1))) % tables[tableIndex].
             getHistoryLength();
     }
 
-    uint32_t get_tag(uint32_t pc, size_t tableIndex) const {
-        return (pc >> 2) ^ (global_history & ((1 << tables[tableIndex].getHistoryLength()) - 1));
+    uint32_t get_tag(uint32_t pc, size_t tableIndex, uint32_t history) const {
+        return (pc >> 2) ^ (history & ((1 << tables[tableIndex].getHistoryLength()) - 1));
     }
 
     void update_global_history(bool taken) {
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "constants.h"
+#include "tools.h"
+
+namespace cache {
+enum class Replacement_Policy { LRU, PLRU, Random };
+
+/// The geometry and timing of a cache. A size of 0 disables it: every access then takes hit_latency cycles.
+struct Cache_Config {
+    unsigned           size          = 0;  // in bytes
+    unsigned           associativity = 4;
+    unsigned           line_size     = 32; // in bytes
+    Replacement_Policy replacement   = Replacement_Policy::LRU;
+    unsigned           hit_latency   = MEMORY_LATENCY;
+    unsigned           miss_latency  = 5 * MEMORY_LATENCY;
+    unsigned           mshrs         = 4; // misses in flight at once
+
+    /// The number of sets is a power of 2, and so is the associativity for PLRU.
+    bool valid() const {
+        auto power_of_2 = [](unsigned x) { return x != 0 && (x & (x - 1)) == 0; };
+        if (size == 0) return hit_latency != 0;
+        if (!power_of_2(line_size) || associativity == 0 || size % (line_size * associativity) != 0) return false;
+        if (!power_of_2(size / (line_size * associativity))) return false;
+        if (replacement == Replacement_Policy::PLRU && !power_of_2(associativity)) return false;
+        return hit_latency != 0 && miss_latency >= hit_latency && mshrs != 0;
+    }
+};
+
+/**
+ * A set-associative, write-back and write-allocate cache. It only models the timing: the tags are kept, and the data
+ * stays in the memory.
+ * It is non-blocking: a miss holds an MSHR until its line arrives, and the accesses to the line meanwhile wait for it
+ * without taking another one.
+ */
+class Cache {
+public:
+    explicit Cache(const Cache_Config& config = {})
+        : config_(config), sets_(config.size == 0 ? 0 : config.size / (config.line_size * config.associativity)),
+          lines_(sets_ * config.associativity), plru_(sets_ * config.associativity), mshrs_(config.mshrs) {}
+
+    bool enabled() const { return sets_ != 0; }
+
+    unsigned line_size() const { return config_.line_size; }
+
+    /// The number of misses that can start in cycle `now`, which is unbounded for a disabled cache.
+    unsigned free_mshrs(unsigned long long now) const {
+        if (!enabled()) return ~0u;
+        unsigned count = 0;
+        for (const auto& mshr : mshrs_) count += mshr.ready <= now;
+        return count;
+    }
+
+    /// Whether the line of `address` is in the cache, though it may still be on its way, which is always true for a
+    /// disabled cache.
+    bool contains(unsigned address) const {
+        return !enabled() || find(address / config_.line_size) != nullptr;
+    }
+
+    /// Whether the line of `address` has arrived by cycle `now`.
+    bool arrived(unsigned address, unsigned long long now) const {
+        return contains(address) && filling(address / config_.line_size, now) == nullptr;
+    }
+
+    /**
+     * Looks up the line of `address` in cycle `now`, filling it on a miss, which needs a free MSHR.
+     * Returns the latency of the access in cycles.
+     */
+    unsigned access(unsigned address, bool write, unsigned long long now) {
+        if (!enabled()) return config_.hit_latency;
+        ++tick_;
+        unsigned line = address / config_.line_size;
+        if (Line* hit = find(line)) {
+            touch(hit);
+            hit->dirty = hit->dirty || write;
+            if (hit->prefetched) ++useful_prefetches_;
+            hit->prefetched = false;
+            if (const MSHR* mshr = filling(line, now)) {
+                ++merges_; // the line is still on its way
+                return std::max<unsigned>(config_.hit_latency, mshr->ready - now);
+            }
+            ++hits_;
+            return config_.hit_latency;
+        }
+        ++misses_;
+        fill(line, write, now);
+        return config_.miss_latency;
+    }
+
+    /// Starts filling the line of `address` ahead of its use, if it is missing and an MSHR is free.
+    void prefetch(unsigned address, unsigned long long now) {
+        if (contains(address) || free_mshrs(now) == 0) return;
+        ++tick_;
+        ++prefetches_;
+        fill(address / config_.line_size, false, now).prefetched = true;
+    }
+
+    /// Prints the counters as `<name> hits: <count>` lines, if the cache is enabled.
+    void report(const char* name) const {
+        if (!enabled()) return;
+        fprintf(stderr, "%s hits: %llu\n", name, hits_);
+        fprintf(stderr, "%s misses: %llu\n", name, misses_);
+        fprintf(stderr, "%s mshr merges: %llu\n", name, merges_);
+        fprintf(stderr, "%s evictions: %llu\n", name, evictions_);
+        fprintf(stderr, "%s writebacks: %llu\n", name, writebacks_);
+        if (prefetches_ != 0) {
+            fprintf(stderr, "%s prefetches: %llu\n", name, prefetches_);
+            fprintf(stderr, "%s useful prefetches: %llu\n", name, useful_prefetches_);
+        }
+        fprintf(stderr, "%s hit rate: %Lf\n", name,
+                static_cast<long double>(hits_) / (hits_ + merges_ + misses_));
+    }
+
+private:
+    struct Line {
+        bool               valid      = false;
+        bool               dirty      = false;
+        bool               prefetched = false; // not yet accessed since it was prefetched
+        unsigned           tag        = 0;
+        unsigned long long last_use   = 0; // for LRU
+    };
+
+    struct MSHR {
+        unsigned           line  = 0;
+        unsigned long long ready = 0; // the cycle the line arrives in, free from then on
+    };
+
+    Cache_Config         config_;
+    unsigned             sets_;
+    std::vector<Line>    lines_;
+    std::vector<uint8_t> plru_; // per set, the nodes 1 .. associativity - 1 of a binary tree pointing to the victim
+    unsigned long long   tick_   = 0;
+    uint32_t             random_ = 0x2545f491; // xorshift state, fixed so that the simulation stays deterministic
+    std::vector<MSHR>    mshrs_;
+
+    unsigned long long hits_              = 0;
+    unsigned long long merges_            = 0; // hits on a line still being filled
+    unsigned long long misses_            = 0;
+    unsigned long long evictions_         = 0; // valid lines replaced
+    unsigned long long writebacks_        = 0; // dirty lines replaced
+    unsigned long long prefetches_        = 0;
+    unsigned long long useful_prefetches_ = 0; // prefetched lines accessed before being replaced
+
+    Line* find(unsigned line) {
+        return const_cast<Line*>(std::as_const(*this).find(line));
+    }
+
+    const Line* find(unsigned line) const {
+        unsigned    set  = line % sets_;
+        unsigned    tag  = line / sets_;
+        const Line* ways = &lines_[set * config_.associativity];
+        for (unsigned way = 0; way < config_.associativity; ++way) {
+            if (ways[way].valid && ways[way].tag == tag) return &ways[way];
+        }
+        return nullptr;
+    }
+
+    /// The MSHR filling `line` in cycle `now`, if any.
+    const MSHR* filling(unsigned line, unsigned long long now) const {
+        for (const auto& mshr : mshrs_) {
+            if (mshr.ready > now && mshr.line == line) return &mshr;
+        }
+        return nullptr;
+    }
+
+    /// Replaces a line of the set of `line` with it, holding a free MSHR until it arrives.
+    Line& fill(unsigned line, bool write, unsigned long long now) {
+        auto mshr = std::find_if(mshrs_.begin(), mshrs_.end(), [&](const MSHR& m) { return m.ready <= now; });
+        dark::debug::assert(mshr != mshrs_.end(), "Cache: miss without a free MSHR");
+        *mshr = {line, now + config_.miss_latency};
+
+        unsigned set         = line % sets_;
+        Line&    victim_line = lines_[set * config_.associativity + victim(set)];
+        if (victim_line.valid) {
+            ++evictions_;
+            if (victim_line.dirty) ++writebacks_;
+        }
+        victim_line = {true, write, false, line / sets_, 0};
+        touch(&victim_line);
+        return victim_line;
+    }
+
+    void touch(Line* line) {
+        line->last_use = tick_;
+        auto     index = static_cast<unsigned>(line - lines_.data());
+        unsigned set   = index / config_.associativity;
+        unsigned way   = index % config_.associativity;
+        if (config_.replacement != Replacement_Policy::PLRU) return;
+        // Every node on the path to the way points away from it
+        uint8_t* tree = &plru_[set * config_.associativity];
+        unsigned node = 1;
+        for (unsigned half = config_.associativity / 2; half != 0; half /= 2) {
+            unsigned right = (way & half) != 0;
+            tree[node]     = !right;
+            node           = 2 * node + right;
+        }
+    }
+
+    unsigned victim(unsigned set) {
+        const Line* ways = &lines_[set * config_.associativity];
+        for (unsigned way = 0; way < config_.associativity; ++way) {
+            if (!ways[way].valid) return way;
+        }
+        switch (config_.replacement) {
+        case Replacement_Policy::LRU: {
+            unsigned result = 0;
+            for (unsigned way = 1; way < config_.associativity; ++way) {
+                if (ways[way].last_use < ways[result].last_use) result = way;
+            }
+            return result;
+        }
+        case Replacement_Policy::PLRU: {
+            const uint8_t* tree = &plru_[set * config_.associativity];
+            unsigned       node = 1, way = 0;
+            for (unsigned half = config_.associativity / 2; half != 0; half /= 2) {
+                way  = 2 * way + tree[node];
+                node = 2 * node + tree[node];
+            }
+            return way;
+        }
+        default:
+            random_ ^= random_ << 13;
+            random_ ^= random_ >> 17;
+            random_ ^= random_ << 5;
+            return random_ % config_.associativity;
+        }
+    }
+};
+} // namespace cache
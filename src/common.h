@@ -19,3 +19,69 @@ struct CDB_Output {
 struct Commit_Info {
     Wire<ROB_SIZE_LOG> rob_id; // 0 means disabled
 };
+
+/**
+ * How a reservation station picks one of its ready entries to issue.
+ * ArrayOrder takes the lowest slot, which is whichever slot the instruction happened to be put in.
+ * OldestFirst takes the instruction that entered the station first, tracked with an age matrix.
+ */
+enum class Issue_Policy {
+    ArrayOrder,
+    OldestFirst
+};
+
+/**
+ * When a mispredicted branch is recovered from.
+ * AtCommit flushes the whole pipeline once the branch reaches the ROB head.
+ * AtExecute squashes only the instructions after the branch as soon as the BCU resolves it,
+ * restoring the register renaming from a checkpoint taken when the branch was issued.
+ */
+enum class Recovery_Policy {
+    AtCommit,
+    AtExecute
+};
+
+/**
+ * Where the values of the instructions in flight are kept until they commit.
+ * ReorderBuffer keeps them in the ROB entries, which the decoder reads operands from, and the register file holds the
+ * ROB entry of the latest instruction writing each register.
+ * PhysicalRegisterFile renames each destination to a physical register from a free list, which is written when the
+ * result is on a CDB and freed when a later instruction writing the same register commits. The ROB only holds what
+ * the commit needs, and a branch checkpoints the register alias table, see rename_table::Rename_Table.
+ */
+enum class Rename_Policy {
+    ReorderBuffer,
+    PhysicalRegisterFile
+};
+
+/// The ROB entry allocated after `rob_id`, as the pos 0 of rob is unused.
+inline unsigned next_rob_id(unsigned rob_id) {
+    return (rob_id == ROB_SIZE - 1) ? 1 : rob_id + 1;
+}
+
+/// The position of the ROB entry `rob_id` in program order, counting from the ROB head.
+inline unsigned rob_age(unsigned rob_id, unsigned head) {
+    return (rob_id + ROB_SIZE - 1 - head) % (ROB_SIZE - 1); // the pos 0 of rob is unused
+}
+
+/**
+ * Sent by the ROB for one cycle when a mispredicted branch is resolved early, see Recovery_Policy.
+ * Every instruction after the branch is squashed, including the ones issued in the cycle it is received.
+ */
+struct Squash_Input {
+    Wire<1>            enabled;
+    Wire<ROB_SIZE_LOG> rob_id; // the mispredicted branch, which is kept
+    Wire<ROB_SIZE_LOG> head;   // the ROB head when the branch was resolved, which ages are counted from
+
+    /// Whether the instruction in the ROB entry `id` is squashed.
+    bool squashes(unsigned id) {
+        if (enabled == 0 || id == 0) return false;
+        return rob_age(id, to_unsigned(head)) > rob_age(to_unsigned(rob_id), to_unsigned(head));
+    }
+};
+
+struct Squash_Output {
+    Register<1>            enabled;
+    Register<ROB_SIZE_LOG> rob_id;
+    Register<ROB_SIZE_LOG> head;
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstdint>
+
+#include "memory.h"
+
+/**
+ * The RV32C extension, shared by the fetcher, the decoder and the interpreter. A compressed instruction is 2 bytes,
+ * told apart by its lowest 2 bits not being 11, and is executed as the 32-bit instruction it expands to, except that
+ * the next one is 2 bytes after it.
+ */
+namespace compressed {
+/// The length in bytes of the instruction whose low 16 bits are `bits`.
+inline unsigned length(uint32_t bits) {
+    return (bits & 0b11) == 0b11 ? 4 : 2;
+}
+
+/// The instruction at `pc`, which only needs to be 2 bytes aligned: a compressed one is in the low 16 bits.
+inline uint32_t read(const Memory& memory, uint32_t pc) {
+    uint32_t low = memory.get_half(pc);
+    if (length(low) == 2) return low;
+    return low | static_cast<uint32_t>(memory.get_half(pc + 2)) << 16;
+}
+
+namespace details {
+    /// The bits [hi, lo] of `c`, moved to start at bit `to`.
+    inline uint32_t field(uint32_t c, unsigned hi, unsigned lo, unsigned to) {
+        return ((c >> lo) & ((1u << (hi - lo + 1)) - 1)) << to;
+    }
+
+    /// `value` sign extended from `bits` bits.
+    inline int32_t sign_extend(uint32_t value, unsigned bits) {
+        return static_cast<int32_t>(value << (32 - bits)) >> (32 - bits);
+    }
+
+    /// A register among x8-x15, encoded in the 3 bits at `lo`.
+    inline uint32_t prime(uint32_t c, unsigned lo) {
+        return 8 + ((c >> lo) & 0b111);
+    }
+
+    inline uint32_t r_type(uint32_t funct7, uint32_t rs2, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode) {
+        return funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+    }
+
+    inline uint32_t i_type(int32_t imm, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode) {
+        return (static_cast<uint32_t>(imm) & 0xfff) << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+    }
+
+    inline uint32_t s_type(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3) {
+        auto u = static_cast<uint32_t>(imm);
+        return field(u, 11, 5, 25) | rs2 << 20 | rs1 << 15 | funct3 << 12 | field(u, 4, 0, 7) | 0b0100011;
+    }
+
+    inline uint32_t b_type(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3) {
+        auto u = static_cast<uint32_t>(imm);
+        return field(u, 12, 12, 31) | field(u, 10, 5, 25) | rs2 << 20 | rs1 << 15 | funct3 << 12 |
+               field(u, 4, 1, 8) | field(u, 11, 11, 7) | 0b1100011;
+    }
+
+    inline uint32_t j_type(int32_t imm, uint32_t rd) {
+        auto u = static_cast<uint32_t>(imm);
+        return field(u, 20, 20, 31) | field(u, 10, 1, 21) | field(u, 11, 11, 20) | field(u, 19, 12, 12) | rd << 7 |
+               0b1101111;
+    }
+
+    /// The offset of C.J and C.JAL.
+    inline int32_t jump_offset(uint32_t c) {
+        uint32_t u = field(c, 12, 12, 11) | field(c, 11, 11, 4) | field(c, 10, 9, 8) | field(c, 8, 8, 10) |
+                     field(c, 7, 7, 6) | field(c, 6, 6, 7) | field(c, 5, 3, 1) | field(c, 2, 2, 5);
+        return sign_extend(u, 12);
+    }
+
+    /// The offset of C.BEQZ and C.BNEZ.
+    inline int32_t branch_offset(uint32_t c) {
+        uint32_t u = field(c, 12, 12, 8) | field(c, 11, 10, 3) | field(c, 6, 5, 6) | field(c, 4, 3, 1) |
+                     field(c, 2, 2, 5);
+        return sign_extend(u, 9);
+    }
+} // namespace details
+
+/**
+ * The 32-bit instruction the compressed instruction `c` expands to, or 0, which is no valid instruction, for the
+ * reserved and illegal encodings and for those of the F and D extensions and of C.EBREAK, which are not supported.
+ */
+inline uint32_t expand(uint32_t c) {
+    using namespace details;
+    constexpr uint32_t kOpImm = 0b0010011, kOp = 0b0110011, kLoad = 0b0000011, kLui = 0b0110111, kJalr = 0b1100111;
+    uint32_t funct3 = c >> 13 & 0b111;
+    uint32_t rd     = c >> 7 & 0b11111; // also rs1
+    uint32_t rs2    = c >> 2 & 0b11111;
+    int32_t  imm6   = sign_extend(field(c, 12, 12, 5) | field(c, 6, 2, 0), 6);
+
+    switch ((c & 0b11) << 3 | funct3) {
+    case 0b00000: { // C.ADDI4SPN
+        uint32_t imm = field(c, 12, 11, 4) | field(c, 10, 7, 6) | field(c, 6, 6, 2) | field(c, 5, 5, 3);
+        return imm == 0 ? 0 : i_type(imm, 2, 0b000, prime(c, 2), kOpImm);
+    }
+    case 0b00010: { // C.LW
+        uint32_t imm = field(c, 12, 10, 3) | field(c, 6, 6, 2) | field(c, 5, 5, 6);
+        return i_type(imm, prime(c, 7), 0b010, prime(c, 2), kLoad);
+    }
+    case 0b00110: { // C.SW
+        uint32_t imm = field(c, 12, 10, 3) | field(c, 6, 6, 2) | field(c, 5, 5, 6);
+        return s_type(imm, prime(c, 2), prime(c, 7), 0b010);
+    }
+    case 0b01000: // C.ADDI, C.NOP
+        return i_type(imm6, rd, 0b000, rd, kOpImm);
+    case 0b01001: // C.JAL
+        return j_type(jump_offset(c), 1);
+    case 0b01010: // C.LI
+        return i_type(imm6, 0, 0b000, rd, kOpImm);
+    case 0b01011: {
+        if (rd == 2) { // C.ADDI16SP
+            uint32_t imm = field(c, 12, 12, 9) | field(c, 6, 6, 4) | field(c, 5, 5, 6) | field(c, 4, 3, 7) |
+                           field(c, 2, 2, 5);
+            return imm == 0 ? 0 : i_type(sign_extend(imm, 10), 2, 0b000, 2, kOpImm);
+        }
+        // C.LUI
+        if (imm6 == 0) return 0;
+        return (static_cast<uint32_t>(imm6) & 0xfffff) << 12 | rd << 7 | kLui;
+    }
+    case 0b01100: {
+        uint32_t rd_prime = prime(c, 7), rs2_prime = prime(c, 2);
+        switch (c >> 10 & 0b11) {
+        case 0b00: // C.SRLI
+            return (c >> 12 & 1) ? 0 : i_type(rs2, rd_prime, 0b101, rd_prime, kOpImm);
+        case 0b01: // C.SRAI
+            return (c >> 12 & 1) ? 0 : i_type(0b0100000 << 5 | rs2, rd_prime, 0b101, rd_prime, kOpImm);
+        case 0b10: // C.ANDI
+            return i_type(imm6, rd_prime, 0b111, rd_prime, kOpImm);
+        default:
+            if (c >> 12 & 1) return 0; // C.SUBW and C.ADDW are RV64 only
+            switch (c >> 5 & 0b11) {
+            case 0b00: return r_type(0b0100000, rs2_prime, rd_prime, 0b000, rd_prime, kOp); // C.SUB
+            case 0b01: return r_type(0, rs2_prime, rd_prime, 0b100, rd_prime, kOp);         // C.XOR
+            case 0b10: return r_type(0, rs2_prime, rd_prime, 0b110, rd_prime, kOp);         // C.OR
+            default: return r_type(0, rs2_prime, rd_prime, 0b111, rd_prime, kOp);           // C.AND
+            }
+        }
+    }
+    case 0b01101: // C.J
+        return j_type(jump_offset(c), 0);
+    case 0b01110: // C.BEQZ
+        return b_type(branch_offset(c), 0, prime(c, 7), 0b000);
+    case 0b01111: // C.BNEZ
+        return b_type(branch_offset(c), 0, prime(c, 7), 0b001);
+    case 0b10000: // C.SLLI
+        return (c >> 12 & 1) ? 0 : i_type(rs2, rd, 0b001, rd, kOpImm);
+    case 0b10010: { // C.LWSP
+        uint32_t imm = field(c, 12, 12, 5) | field(c, 6, 4, 2) | field(c, 3, 2, 6);
+        return rd == 0 ? 0 : i_type(imm, 2, 0b010, rd, kLoad);
+    }
+    case 0b10100:
+        if ((c >> 12 & 1) == 0) {
+            if (rs2 == 0) return rd == 0 ? 0 : i_type(0, rd, 0b000, 0, kJalr); // C.JR
+            return r_type(0, rs2, 0, 0b000, rd, kOp);                           // C.MV
+        }
+        if (rs2 == 0) return rd == 0 ? 0 : i_type(0, rd, 0b000, 1, kJalr); // C.JALR, C.EBREAK is not supported
+        return r_type(0, rs2, rd, 0b000, rd, kOp);                          // C.ADD
+    case 0b10110: { // C.SWSP
+        uint32_t imm = field(c, 12, 9, 2) | field(c, 8, 7, 6);
+        return s_type(imm, rs2, 2, 0b010);
+    }
+    default: // the F and D extensions, and the 32-bit instructions
+        return 0;
+    }
+}
+} // namespace compressed
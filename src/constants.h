@@ -4,11 +4,33 @@
 
 #pragma once
 
+// The window sizes can be set at build time for limit studies, e.g. `cmake -DROB_SIZE_LOG=9 -DRS_SIZE_LOG=6`
+#ifdef SIM_ROB_SIZE_LOG
+constexpr int ROB_SIZE_LOG = SIM_ROB_SIZE_LOG;
+#else
 constexpr int ROB_SIZE_LOG = 5;
+#endif
 constexpr int ROB_SIZE = 1 << ROB_SIZE_LOG;
 
+constexpr int PRF_SIZE_LOG = (ROB_SIZE_LOG > 5 ? ROB_SIZE_LOG : 5) + 1;
+constexpr int PRF_SIZE = 1 << PRF_SIZE_LOG; // physical registers, enough for x0 - x31 and one for each ROB entry
+
+#ifdef SIM_RS_SIZE_LOG
+constexpr int RS_SIZE_LOG = SIM_RS_SIZE_LOG;
+#else
 constexpr int RS_SIZE_LOG = 4;
+#endif
 constexpr int RS_SIZE = 1 << RS_SIZE_LOG;
 
+static_assert(ROB_SIZE_LOG >= 3 && ROB_SIZE_LOG <= 12, "the ROB holds 8 to 4096 entries");
+static_assert(RS_SIZE_LOG >= 1 && RS_SIZE_LOG <= 10, "a reservation station holds 2 to 1024 entries");
+
 constexpr int MEMORY_SIZE = 1048576;
 constexpr int MEMORY_LATENCY = 4;
+
+constexpr int STORE_BUFFER_SIZE = 8; // committed stores waiting to be written to the memory, one word each
+constexpr int FETCH_QUEUE_SIZE = 8; // instructions fetched ahead of the decoder, by default
+constexpr int ISSUE_WIDTH_MAX = 4; // instructions fetched, issued and added to the ROB in a cycle at most
+constexpr int COMMIT_WIDTH_MAX = 4; // instructions committed from the ROB in a cycle at most
+constexpr int ALU_COUNT_MAX = 4; // ALUs behind the ALU reservation station at most
+constexpr int CDB_COUNT_MAX = ALU_COUNT_MAX + 2; // common data buses at most, one for each ALU, the MDU and memory
@@ -4,14 +4,23 @@
 
 #pragma once
 
+#include <vector>
+
 #include "tools.h"
 #include "common.h"
+#include "compressed.h"
+#include "rename_table.h"
+#include "stats.h"
+#include "tracer.h"
 
 namespace decoder {
+/// A group of instructions in program order, see fetcher::Fetcher_Output.
 struct Input_From_Fetcher {
-    Wire<32> instruction;
-    Wire<32> program_counter;
-    Wire<1>  predicted_branch_taken;
+    std::array<Wire<1>, ISSUE_WIDTH_MAX>  valid;
+    std::array<Wire<32>, ISSUE_WIDTH_MAX> instruction;
+    std::array<Wire<32>, ISSUE_WIDTH_MAX> program_counter;
+    std::array<Wire<1>, ISSUE_WIDTH_MAX>  predicted_branch_taken;
+    std::array<Wire<32>, ISSUE_WIDTH_MAX> history;
 };
 
 struct Input_From_Regfile {
@@ -20,29 +29,45 @@ struct Input_From_Regfile {
 };
 
 struct Input_From_ROB {
-    std::array<Wire<32>, ROB_SIZE> value;
-    std::array<Wire<1>, ROB_SIZE>  ready;
+    dark::WireArray<32, ROB_SIZE> value;
+    dark::WireArray<1, ROB_SIZE>  ready;
+};
+
+/// For Rename_Policy::PhysicalRegisterFile only, see prf::PRF.
+struct Input_From_PRF {
+    dark::WireArray<32, PRF_SIZE> value;
+    dark::WireArray<1, PRF_SIZE>  ready;
+};
+
+/// An instruction committed by the ROB, which frees the physical register its destination was mapped to before.
+struct Input_From_Commit {
+    Wire<1>            enabled;
+    Wire<5>            reg_id;
+    Wire<ROB_SIZE_LOG> rob_id;
 };
 
 struct Decoder_Input {
     Input_From_Regfile from_regfile;
     Input_From_ROB     from_rob;
+    Input_From_PRF     from_prf;
+    std::array<Input_From_Commit, COMMIT_WIDTH_MAX> from_commit;
     Input_From_Fetcher from_fetcher;
-    CDB_Input          cdb_input_alu;
-    CDB_Input          cdb_input_mem;
-    Wire<1>            rs_alu_full;
-    Wire<1>            rs_bcu_full;
-    Wire<1>            rs_mem_load_full;
-    Wire<1>            rs_mem_store_full;
-    Wire<1>            rob_full;
-    Wire<ROB_SIZE_LOG> rob_id;
-    Commit_Info        commit_info;
+    std::array<CDB_Input, CDB_COUNT_MAX> cdb_input; // all the CDBs, see Simulator
+    Wire<32>           rs_alu_free; // the entries left once the instructions issued in the last cycle are added
+    Wire<32>           rs_bcu_free;
+    Wire<32>           rs_mdu_free;
+    Wire<32>           rs_mem_load_free;
+    Wire<32>           rs_mem_store_free;
+    Wire<32>           rob_free;
+    Wire<ROB_SIZE_LOG> first_rob_id; // the ROB entry of the first instruction issued in this cycle
     Wire<1>            flush_input;
+    Squash_Input       squash_input;
 };
 
 struct Output_To_Fetcher {
     Register<1>  enabled;
     Register<32> pc;
+    Register<32> queue_vacancy; // the free entries of the fetch queue, not touched by write_disable
 
     void write_disable(bool valid = true);
 };
@@ -52,9 +77,12 @@ struct Output_To_ROB {
     Register<2>  op;          // 00 for jalr, 01 for branch, 10 for others, 11 for special halt instruction
     Register<1>  value_ready; // 1 for value acquired, 0 otherwise
     Register<32> value;       // for jalr, the jump address; for branch and others, the value to write to the register
-    Register<32> alt_value;   // for jalr, pc + 4; for branch, pc of the branch; for others, unused
+    Register<32> alt_value;   // for jalr, the next pc; for branch, pc of the branch; for others, unused
     Register<5>  dest;        // the register to store the value
     Register<1>  predicted_branch_taken;
+    Register<3>  unit;        // 000 alu, 001 bcu, 010 load, 011 store, 100 mdu, used for stall accounting
+    Register<32> pc;          // pc of the instruction, used for profiling
+    Register<32> history;     // the global history of the branch predictor before it, see fetcher::Fetcher
 
     void write_disable(bool valid = true);
 };
@@ -71,6 +99,18 @@ struct Output_To_RS_ALU {
     void write_disable(bool valid = true);
 };
 
+struct Output_To_RS_MDU {
+    Register<1>            enabled;
+    Register<3>            op; // func3
+    Register<32>           Vj;
+    Register<32>           Vk;
+    Register<ROB_SIZE_LOG> Qj;
+    Register<ROB_SIZE_LOG> Qk;
+    Register<ROB_SIZE_LOG> dest;
+
+    void write_disable(bool valid = true);
+};
+
 struct Output_To_RS_BCU {
     Register<1>            enabled;
     Register<3>            op; // func3
@@ -90,9 +130,9 @@ struct Output_To_RS_Mem_Load {
     Register<3>            op; // func3
     Register<32>           Vj; // rs1, position
     Register<ROB_SIZE_LOG> Qj;
-    // Register<ROB_SIZE_LOG> Ql; // calculated in RS
     Register<ROB_SIZE_LOG> dest;
     Register<12>           offset;
+    Register<32>           pc; // for the store set predictor
 
     void write_disable(bool valid = true);
 };
@@ -104,10 +144,9 @@ struct Output_To_RS_Mem_Store {
     Register<32>           Vk; // rs2, value
     Register<ROB_SIZE_LOG> Qj;
     Register<ROB_SIZE_LOG> Qk;
-    // Register<ROB_SIZE_LOG> Ql; // calculated in RS
-    Register<ROB_SIZE_LOG> Qm; // last branch id
     Register<ROB_SIZE_LOG> dest;
     Register<12>           offset;
+    Register<32>           pc; // for the store set predictor
 
     void write_disable(bool valid = true);
 };
@@ -120,27 +159,84 @@ struct Output_To_RegFile {
     void write_disable(bool valid = true);
 };
 
+/// A destination renamed to a physical register, see prf::Rename_Input.
+struct Output_To_PRF {
+    Register<1>            enabled;
+    Register<PRF_SIZE_LOG> preg;
+    Register<ROB_SIZE_LOG> rob_id;
+    Register<1>            value_ready;
+    Register<32>           value;
+
+    void write_disable(bool valid = true);
+};
+
+/// Except for to_fetcher, the outputs are indexed by the position of the instruction in the group issued.
 struct Decoder_Output {
-    Output_To_Fetcher      to_fetcher;
-    Output_To_ROB          to_rob;
-    Output_To_RS_ALU       to_rs_alu;
-    Output_To_RS_BCU       to_rs_bcu;
-    Output_To_RS_Mem_Load  to_rs_mem_load;
-    Output_To_RS_Mem_Store to_rs_mem_store;
-    Output_To_RegFile      to_reg_file;
+    Output_To_Fetcher                                   to_fetcher;
+    std::array<Output_To_ROB, ISSUE_WIDTH_MAX>          to_rob;
+    std::array<Output_To_RS_ALU, ISSUE_WIDTH_MAX>       to_rs_alu;
+    std::array<Output_To_RS_MDU, ISSUE_WIDTH_MAX>       to_rs_mdu;
+    std::array<Output_To_RS_BCU, ISSUE_WIDTH_MAX>       to_rs_bcu;
+    std::array<Output_To_RS_Mem_Load, ISSUE_WIDTH_MAX>  to_rs_mem_load;
+    std::array<Output_To_RS_Mem_Store, ISSUE_WIDTH_MAX> to_rs_mem_store;
+    std::array<Output_To_RegFile, ISSUE_WIDTH_MAX>      to_reg_file;
+    std::array<Output_To_PRF, ISSUE_WIDTH_MAX>          to_prf;
+};
+
+
+/// An instruction in the fetch queue.
+struct Fetched_Instruction {
+    Bit<32> instruction; // a compressed one is expanded, see compressed::expand
+    Bit<32> program_counter;
+    unsigned length; // in bytes, 2 for a compressed instruction
+    Bit<1>  predicted_branch_taken;
+    Bit<32> history;
 };
 
+/// An instruction issued earlier in the cycle, whose result the later ones of the group may read.
+struct Group_Entry {
+    unsigned          dest = 0; // the register renamed, 0 if none
+    Bit<ROB_SIZE_LOG> rob_id;
+    bool              value_ready = false; // the result is known at issue, as for lui and jal
+    Bit<32>           value;
+};
+
+/// The renaming of a physical register, see Decoder::query_physical_register.
+struct Physical_Register {
+    Bit<ROB_SIZE_LOG>  rob_id;             // the instruction writing it
+    bool               value_ready = true; // the value is known at issue
+    Bit<32>            value;
+    unsigned long long renamed = 0; // the cycle it was renamed in
+};
 
+/**
+ * The decoder issues the instructions in order from the fetch queue, which the fetcher fills along the predicted
+ * path, so that it keeps fetching while the decoder stalls. The fetcher is only redirected for a jalr.
+ * Up to `issue_width` instructions are issued in a cycle, stopping at the first one that cannot be, and after a jalr.
+ * An instruction reads the registers renamed by the earlier ones of its group, see query_register.
+ * With Rename_Policy::PhysicalRegisterFile, the decoder renames the destinations itself, and keeps the register alias
+ * table up to date with the instructions committed.
+ * @param fetch_queue_size the number of entries of the fetch queue, at least 1.
+ * @param issue_width the number of instructions issued in a cycle at most, up to ISSUE_WIDTH_MAX.
+ */
 struct Decoder final : dark::Module<Decoder_Input, Decoder_Output> {
+    Decoder(Stats* stats, Tracer* tracer, unsigned fetch_queue_size = FETCH_QUEUE_SIZE, unsigned issue_width = 1,
+            Rename_Policy rename_policy = Rename_Policy::ReorderBuffer)
+        : issue_width_(issue_width), rename_policy_(rename_policy), fetch_queue_(fetch_queue_size), stats_(stats),
+          tracer_(tracer) {
+        dark::debug::assert(issue_width >= 1 && issue_width <= ISSUE_WIDTH_MAX, "Decoder: invalid issue width");
+    }
+
     void wait_for_jalr() {
+        stats_->record_issue_slot(IssueSlot::WaitForJalr, issue_width_);
         Bit<32> new_pc = 0;
-        // Check the CDB for the result of the JALR
-        if (cdb_input_alu.rob_id == last_jalr_id) {
-            last_jalr_id = 0;
-            new_pc       = cdb_input_alu.value;
-        } else if (cdb_input_mem.rob_id == last_jalr_id) {
-            last_jalr_id = 0;
-            new_pc       = cdb_input_mem.value;
+        // Check the CDBs for the result of the JALR
+        for (const auto& cdb : cdb_input) {
+            if (cdb.rob_id == last_jalr_id) {
+                last_jalr_id = 0;
+                new_pc       = cdb.value;
+                break;
+            }
         }
         if (last_jalr_id == 0) {
             state = State::SkipOneCycle;
@@ -150,12 +246,7 @@ struct Decoder final : dark::Module<Decoder_Input, Decoder_Output> {
             to_fetcher.pc <= new_pc;
 
             // Disable all other outputs
-            to_rob.write_disable();
-            to_rs_alu.write_disable();
-            to_rs_bcu.write_disable();
-            to_rs_mem_load.write_disable();
-            to_rs_mem_store.write_disable();
-            to_reg_file.write_disable();
+            disable_slots(0);
         } else {
             disable_all_outputs();
         }
@@ -170,48 +261,96 @@ struct Decoder final : dark::Module<Decoder_Input, Decoder_Output> {
         // ret: special case of jalr, if x1 is ready, convert it to a jal
         // jalr: write an add instruction to rs_alu, go to state `wait for jalr`
 
+        ++cycle_;
+        if (rename_policy_ == Rename_Policy::PhysicalRegisterFile) {
+            // Even in a flush, as the instructions before a mispredicted branch may commit in the same cycle
+            for (auto& port : from_commit) {
+                if (port.enabled == 1) rename_.commit(to_unsigned(port.reg_id), to_unsigned(port.rob_id));
+            }
+        }
+
         if (flush_input == 1) {
+            stats_->record_issue_slot(IssueSlot::FlushRecovery, issue_width_);
             flush();
+            write_vacancy();
             return;
         }
-
-        // Update last_branch_id using commit_info
-        if (commit_info.rob_id == last_branch_id) {
-            last_branch_id = 0; // No uncommitted branch
+        if (squash_input.enabled == 1) {
+            stats_->record_issue_slot(IssueSlot::FlushRecovery, issue_width_);
+            squash();
+            write_vacancy();
+            return;
         }
 
         switch (state) {
         case State::SkipOneCycle:
-            state = State::TryToIssue;
+            // The fetcher is redirected: the fetch queue and the instruction arriving were fetched before that
+            stats_->record_issue_slot(IssueSlot::FetchRedirect, issue_width_);
+            tracer_->squash_decoding();
+            fetch_queue_count_ = 0;
+            state              = State::TryToIssue;
             disable_all_outputs();
-            return;
+            break;
         case State::WaitForJalr:
+            enqueue();
             wait_for_jalr();
-            return;
-
-        case State::TryToIssue: {
-            Bit<32> instruction            = from_fetcher.instruction;
-            Bit<32> program_counter        = from_fetcher.program_counter;
-            Bit<1>  predicted_branch_taken = from_fetcher.predicted_branch_taken;
-
-            issue_instruction(instruction, program_counter, predicted_branch_taken);
+            break;
 
-            last_instruction            = instruction;
-            last_program_counter        = program_counter;
-            last_predicted_branch_taken = predicted_branch_taken;
-            return;
+        case State::TryToIssue:
+            enqueue();
+            issue_group();
+            break;
+        default:
+            dark::debug::unreachable();
         }
-        case State::IssuePrevious: {
-            Bit<32> instruction            = last_instruction;
-            Bit<32> program_counter        = last_program_counter;
-            Bit<1>  predicted_branch_taken = last_predicted_branch_taken;
+        write_vacancy();
+    }
 
-            issue_instruction(instruction, program_counter, predicted_branch_taken);
-            return;
+    /// Puts the instructions arriving from the fetcher, if any, at the tail of the fetch queue.
+    void enqueue() {
+        for (unsigned i = 0; i < issue_width_ && from_fetcher.valid[i] == 1; ++i) {
+            dark::debug::assert(fetch_queue_count_ < fetch_queue_.size(), "Decoder: the fetch queue overflows");
+            unsigned bits   = to_unsigned(from_fetcher.instruction[i]);
+            unsigned length = compressed::length(bits);
+            fetch_queue_[(fetch_queue_head_ + fetch_queue_count_++) % fetch_queue_.size()] = {
+                length == 2 ? compressed::expand(bits) : bits, from_fetcher.program_counter[i], length,
+                from_fetcher.predicted_branch_taken[i], from_fetcher.history[i]
+            };
         }
-        default:
-            dark::debug::unreachable();
+    }
+
+    /// Issues the instructions at the head of the fetch queue, as many as possible up to the issue width.
+    void issue_group() {
+        group_ = {};
+        group_.rob_id = first_rob_id;
+        while (group_.size < issue_width_) {
+            if (fetch_queue_count_ == 0) {
+                stats_->record_issue_slot(IssueSlot::FetchEmpty, issue_width_ - group_.size);
+                break;
+            }
+            const auto& head = fetch_queue_[fetch_queue_head_];
+            tracer_->decode();
+            bool issued = issue_instruction(group_.size, head.instruction, head.program_counter, head.length,
+                                            head.predicted_branch_taken, head.history);
+            if (!issued) break;
+            if (state != State::TryToIssue) {
+                // A ret or jalr redirects the fetcher, the rest of the queue is fetched along a stale path
+                auto reason = state == State::WaitForJalr ? IssueSlot::WaitForJalr : IssueSlot::FetchRedirect;
+                stats_->record_issue_slot(reason, issue_width_ - group_.size);
+                break;
+            }
         }
+        disable_slots(group_.size);
+        to_fetcher.write_disable(state != State::SkipOneCycle); // only a ret redirects the fetcher here
+    }
+
+    void pop_fetch_queue() {
+        fetch_queue_head_ = (fetch_queue_head_ + 1) % fetch_queue_.size();
+        --fetch_queue_count_;
+    }
+
+    void write_vacancy() {
+        to_fetcher.queue_vacancy <= fetch_queue_.size() - fetch_queue_count_;
     }
 
     struct Query_Register_Result {
@@ -220,14 +359,26 @@ struct Decoder final : dark::Module<Decoder_Input, Decoder_Output> {
     };
 
     Query_Register_Result query_register(unsigned int reg) {
-        // Check the last issued instruction first
-        if (to_rob.enabled == 1 && to_rob.dest == reg) {
-            // The last issued instruction has not been updated to the ROB yet
-            if (to_rob.value_ready) {
-                return {to_rob.value, 0};
-            } else {
-                // dark::debug::assert(to_reg_file.enabled, "Wrote to ROB but not to reg file"); // That's the sw command, it's ok
-                return {0, to_reg_file.rob_id};
+        if (reg == 0) return {0, 0};
+        if (rename_policy_ == Rename_Policy::PhysicalRegisterFile) return query_physical_register(rename_.map(reg));
+
+        // Check the instructions issued earlier in this cycle first, the latest one first
+        for (unsigned i = group_.size; i-- > 0;) {
+            const auto& entry = group_.entries[i];
+            if (entry.dest != reg) continue;
+            if (entry.value_ready) return {entry.value, 0};
+            return {0, entry.rob_id};
+        }
+
+        // Then the instructions issued in the last cycle, the latest one first
+        for (unsigned i = issue_width_; i-- > 0;) {
+            if (to_rob[i].enabled == 1 && to_rob[i].dest == reg) {
+                // The instruction has not been updated to the ROB yet
+                if (to_rob[i].value_ready) {
+                    return {to_rob[i].value, 0};
+                } else {
+                    return {0, to_reg_file[i].rob_id};
+                }
             }
         }
 
@@ -235,12 +386,9 @@ struct Decoder final : dark::Module<Decoder_Input, Decoder_Output> {
 
         if (Q == 0) return {from_regfile.data[reg], 0};
 
-        // Check the CDB
-        if (cdb_input_alu.rob_id == Q) {
-            return {cdb_input_alu.value, 0};
-        }
-        if (cdb_input_mem.rob_id == Q) {
-            return {cdb_input_mem.value, 0};
+        // Check the CDBs
+        for (const auto& cdb : cdb_input) {
+            if (cdb.rob_id == Q) return {cdb.value, 0};
         }
 
         // Check the ROB
@@ -252,39 +400,107 @@ struct Decoder final : dark::Module<Decoder_Input, Decoder_Output> {
         return {0, Q};
     }
 
+    /**
+     * The renaming is known here at once, but the PRF only has it two cycles later, until when the value known at
+     * issue is taken from the renaming instead. The CDBs carry the results that the PRF has not written yet.
+     */
+    Query_Register_Result query_physical_register(unsigned preg) {
+        const auto& reg = pregs_[preg];
+        if (cycle_ < reg.renamed + 2) {
+            if (reg.value_ready) return {reg.value, 0};
+        } else if (from_prf.ready[preg] == 1) {
+            return {from_prf.value[preg], 0};
+        }
+        for (const auto& cdb : cdb_input) {
+            if (cdb.rob_id == reg.rob_id) return {cdb.value, 0};
+        }
+        return {0, reg.rob_id};
+    }
+
+    /**
+     * Renames `rd` to a physical register through the port `slot`, with its value if known at issue. An instruction
+     * without a destination takes the physical register 0, so that the PRF drops its result on the CDB.
+     */
+    void rename(unsigned slot, unsigned rd, Bit<ROB_SIZE_LOG> rob_id, bool value_ready, Bit<32> value) {
+        unsigned preg = 0;
+        if (rd != 0) {
+            preg         = rename_.allocate(rd, to_unsigned(rob_id));
+            pregs_[preg] = {rob_id, value_ready, value, cycle_};
+        }
+        to_prf[slot].enabled <= 1;
+        to_prf[slot].preg <= preg;
+        to_prf[slot].rob_id <= rob_id;
+        to_prf[slot].value_ready <= value_ready;
+        to_prf[slot].value <= value;
+    }
+
+    /// The physical register holding the committed value of `reg`, for Rename_Policy::PhysicalRegisterFile.
+    unsigned committed_register(unsigned reg) const {
+        return rename_.committed(reg);
+    }
+
     void disable_all_outputs() {
-        to_rob.write_disable();
-        to_rs_alu.write_disable();
-        to_rs_bcu.write_disable();
-        to_rs_mem_load.write_disable();
-        to_rs_mem_store.write_disable();
         to_fetcher.write_disable();
-        to_reg_file.write_disable();
+        disable_slots(0);
+    }
+
+    /// Disables the outputs of the positions of the group from `slot` on.
+    void disable_slots(unsigned slot) {
+        for (unsigned i = slot; i < issue_width_; ++i) {
+            to_rob[i].write_disable();
+            to_rs_alu[i].write_disable();
+            to_rs_mdu[i].write_disable();
+            to_rs_bcu[i].write_disable();
+            to_rs_mem_load[i].write_disable();
+            to_rs_mem_store[i].write_disable();
+            to_reg_file[i].write_disable();
+            to_prf[i].write_disable();
+        }
     }
 
+    /// Drops the fetch queue along with the instruction arriving, as the fetcher is redirected in this cycle.
     void flush() {
+        tracer_->squash();
+        disable_all_outputs();
+        state              = State::TryToIssue;
+        last_jalr_id       = 0;
+        fetch_queue_count_ = 0;
+        rename_.flush();
+    }
+
+    /// Drops the fetch queue, which comes after the mispredicted branch.
+    void squash() {
+        tracer_->squash_decoding();
         disable_all_outputs();
-        state                       = State::TryToIssue;
-        last_branch_id              = 0;
-        last_jalr_id                = 0;
-        last_instruction            = 0;
-        last_program_counter        = 0;
-        last_predicted_branch_taken = 0;
+        state              = State::TryToIssue;
+        last_jalr_id       = 0; // a jalr being waited for comes after the branch
+        fetch_queue_count_ = 0;
+        rename_.restore(to_unsigned(squash_input.rob_id));
     }
 
-    void issue_instruction(Bit<32> instruction, Bit<32> program_counter, Bit<1> predicted_branch_taken) {
+    /**
+     * Issues the instruction to the position `slot` of the group, and returns false if it cannot be issued.
+     * It takes the ROB entry after those taken by the group so far. `length` is that of the instruction in the memory,
+     * so the next one is at `program_counter + length`.
+     */
+    bool issue_instruction(unsigned slot, Bit<32> instruction, Bit<32> program_counter, unsigned length,
+                           Bit<1> predicted_branch_taken, Bit<32> history) {
         // set flags that records whether an output has been written
         // call to_something.write_disable(!flag) in the end
         // Ensure all outputs are correctly marked disabled if not written
         // Initialize all flags to false
         bool rs_alu_written       = false;
+        bool rs_mdu_written       = false;
         bool rs_bcu_written       = false;
         bool rs_mem_load_written  = false;
         bool rs_mem_store_written = false;
         bool rob_written          = false;
-        bool fetcher_written      = false;
         bool reg_file_written     = false;
 
+        Bit<ROB_SIZE_LOG> rob_id      = group_.rob_id;
+        bool              value_ready = false; // the result is known at issue, see Group_Entry
+        Bit<32>           value       = 0;
+
         unsigned int opcode = to_unsigned(instruction.range<6, 0>());
         Bit<3>       func3  = instruction.range<14, 12>();
         Bit<7>       func7  = instruction.range<31, 25>();
@@ -298,10 +514,6 @@ struct Decoder final : dark::Module<Decoder_Input, Decoder_Output> {
             instruction.range<11, 8>(), Bit<1>(0)
         };
         Bit<20> imm_u = instruction.range<31, 12>();
-        Bit<21> imm_j = {
-            instruction.range<31, 31>(), instruction.range<19, 12>(), instruction.range<20, 20>(),
-            instruction.range<30, 21>(), Bit<1>(0)
-        };
 
         auto rs1_result = query_register(to_unsigned(rs1));
         auto rs2_result = query_register(to_unsigned(rs2));
@@ -309,94 +521,90 @@ struct Decoder final : dark::Module<Decoder_Input, Decoder_Output> {
         state = State::TryToIssue;
         // Set state to TryToIssue by default unless an issue fails or there is a special case.
 
-        if (rob_full == 1) {
-            issue_failure(program_counter);
-            return;
+        if (to_unsigned(rob_free) <= slot) {
+            return issue_failure(IssueSlot::RobFull, slot);
         }
         switch (opcode) {
         case 0b0110111: { // LUI
+            value_ready = true;
+            value       = to_unsigned(imm_u) << 12;
 
             // Set output to ROB
-            to_rob.enabled <= 1;
-            to_rob.op <= 2;          // type 'others'
-            to_rob.value_ready <= 1; // value ready
-            to_rob.value <= to_unsigned(imm_u) << 12;
-            to_rob.alt_value <= 0;
-            to_rob.dest <= rd;
-            to_rob.predicted_branch_taken <= 0;
+            to_rob[slot].enabled <= 1;
+            to_rob[slot].op <= 2;          // type 'others'
+            to_rob[slot].value_ready <= 1; // value ready
+            to_rob[slot].value <= value;
+            to_rob[slot].alt_value <= 0;
+            to_rob[slot].dest <= rd;
+            to_rob[slot].predicted_branch_taken <= 0;
+            to_rob[slot].unit <= 0;
             rob_written = true;
 
             // Reserve ROB entry for this instruction
-            to_reg_file.enabled <= 1;
-            to_reg_file.reg_id <= rd;
-            to_reg_file.rob_id <= rob_id;
+            to_reg_file[slot].enabled <= 1;
+            to_reg_file[slot].reg_id <= rd;
+            to_reg_file[slot].rob_id <= rob_id;
             reg_file_written = true;
 
             break;
         }
         case 0b0010111: { // AUIPC
-            if (rs_alu_full == 1) {
+            if (to_unsigned(rs_alu_free) <= group_.alu) {
                 // ALU reservation station is full
-                issue_failure(program_counter);
-                return;
+                return issue_failure(IssueSlot::RsAluFull, slot);
             }
 
             // Set output to ROB
-            to_rob.enabled <= 1;
-            to_rob.op <= 2;          // type 'others'
-            to_rob.value_ready <= 0; // value not ready until ALU computes it
-            to_rob.value <= 0;       // temporary
-            to_rob.alt_value <= 0;
-            to_rob.dest <= rd;
-            to_rob.predicted_branch_taken <= 0;
+            to_rob[slot].enabled <= 1;
+            to_rob[slot].op <= 2;          // type 'others'
+            to_rob[slot].value_ready <= 0; // value not ready until ALU computes it
+            to_rob[slot].value <= 0;       // temporary
+            to_rob[slot].alt_value <= 0;
+            to_rob[slot].dest <= rd;
+            to_rob[slot].predicted_branch_taken <= 0;
+            to_rob[slot].unit <= 0;
             rob_written = true;
 
             // Reserve ROB entry for this instruction
-            to_reg_file.enabled <= 1;
-            to_reg_file.reg_id <= rd;
-            to_reg_file.rob_id <= rob_id;
+            to_reg_file[slot].enabled <= 1;
+            to_reg_file[slot].reg_id <= rd;
+            to_reg_file[slot].rob_id <= rob_id;
             reg_file_written = true;
 
             // Set output to RS_ALU
-            to_rs_alu.enabled <= 1;
-            to_rs_alu.op <= 0x000; // Since ALU will perform addition
-            to_rs_alu.Vj <= program_counter;
-            to_rs_alu.Vk <= to_unsigned(imm_u) << 12;
-            to_rs_alu.Qj <= 0;
-            to_rs_alu.Qk <= 0;
-            to_rs_alu.dest <= rob_id;
+            to_rs_alu[slot].enabled <= 1;
+            to_rs_alu[slot].op <= 0x000; // Since ALU will perform addition
+            to_rs_alu[slot].Vj <= program_counter;
+            to_rs_alu[slot].Vk <= to_unsigned(imm_u) << 12;
+            to_rs_alu[slot].Qj <= 0;
+            to_rs_alu[slot].Qk <= 0;
+            to_rs_alu[slot].dest <= rob_id;
             rs_alu_written = true;
 
             break;
         }
-        case 0b1101111: { // JAL
-            // Calculate the jump address using sign-extended immediate
-            Bit<32> jump_address = program_counter + to_signed(imm_j);
+        case 0b1101111: { // JAL, which the fetcher has followed already
+            value_ready = true;
+            value       = program_counter + length;
 
             // Set output to ROB
-            to_rob.enabled <= 1;
-            to_rob.op <= 2;          // type 'others'
-            to_rob.value_ready <= 1; // value ready
+            to_rob[slot].enabled <= 1;
+            to_rob[slot].op <= 2;          // type 'others'
+            to_rob[slot].value_ready <= 1; // value ready
             // The jump address isn't written to the ROB, as it's not needed
-            to_rob.value <= program_counter + 4;
-            to_rob.alt_value <= 0;
-            to_rob.dest <= rd;
-            to_rob.predicted_branch_taken <= 0; // Not a branch prediction
+            to_rob[slot].value <= value;
+            to_rob[slot].alt_value <= 0;
+            to_rob[slot].dest <= rd;
+            to_rob[slot].predicted_branch_taken <= 0; // Not a branch prediction
+            to_rob[slot].unit <= 0;
             rob_written = true;
 
             // Reserve ROB entry for this instruction
-            to_reg_file.enabled <= 1;
-            to_reg_file.reg_id <= rd;
-            to_reg_file.rob_id <= rob_id;
+            to_reg_file[slot].enabled <= 1;
+            to_reg_file[slot].reg_id <= rd;
+            to_reg_file[slot].rob_id <= rob_id;
             reg_file_written = true;
 
-            // Update the program counter with the jump address in the fetcher
-            to_fetcher.enabled <= 1;
-            to_fetcher.pc <= jump_address;
-            fetcher_written = true;
-
-            state = State::SkipOneCycle; // Skip 1 cycle
-
             break;
         }
         case 0b1100111: { // JALR
@@ -408,19 +616,19 @@ struct Decoder final : dark::Module<Decoder_Input, Decoder_Output> {
                     Bit<32> return_address = rs1_result.V;
 
                     // Set output to ROB
-                    to_rob.enabled <= 1;
-                    to_rob.op <= 2;          // type 'others'
-                    to_rob.value_ready <= 1; // value ready
-                    to_rob.value <= program_counter + 4;
-                    to_rob.alt_value <= 0;
-                    to_rob.dest <= 0; // unused
-                    to_rob.predicted_branch_taken <= 0;
+                    to_rob[slot].enabled <= 1;
+                    to_rob[slot].op <= 2;          // type 'others'
+                    to_rob[slot].value_ready <= 1; // value ready
+                    to_rob[slot].value <= program_counter + length;
+                    to_rob[slot].alt_value <= 0;
+                    to_rob[slot].dest <= 0; // unused
+                    to_rob[slot].predicted_branch_taken <= 0;
+                    to_rob[slot].unit <= 0;
                     rob_written = true;
 
                     // Update the program counter with the return address
                     to_fetcher.enabled <= 1;
                     to_fetcher.pc <= return_address;
-                    fetcher_written = true;
 
                     state = State::SkipOneCycle; // Skip 1 cycle
                     break;
@@ -428,36 +636,36 @@ struct Decoder final : dark::Module<Decoder_Input, Decoder_Output> {
             }
 
             // Regular JALR
-            if (rs_alu_full == 1) {
+            if (to_unsigned(rs_alu_free) <= group_.alu) {
                 // ALU reservation station is full
-                issue_failure(program_counter);
-                return;
+                return issue_failure(IssueSlot::RsAluFull, slot);
             }
 
             // Set output to ROB
-            to_rob.enabled <= 1;
-            to_rob.op <= 0;                          // type 'jalr'
-            to_rob.value_ready <= 0;                 // value not ready until ALU computes it
-            to_rob.value <= 0;                       // temporary
-            to_rob.alt_value <= program_counter + 4; // this value will be written to rd
-            to_rob.dest <= rd;
-            to_rob.predicted_branch_taken <= 0;
+            to_rob[slot].enabled <= 1;
+            to_rob[slot].op <= 0;                               // type 'jalr'
+            to_rob[slot].value_ready <= 0;                      // value not ready until ALU computes it
+            to_rob[slot].value <= 0;                            // temporary
+            to_rob[slot].alt_value <= program_counter + length; // this value will be written to rd
+            to_rob[slot].dest <= rd;
+            to_rob[slot].predicted_branch_taken <= 0;
+            to_rob[slot].unit <= 0;
             rob_written = true;
 
             // Reserve ROB entry for this instruction
-            to_reg_file.enabled <= 1;
-            to_reg_file.reg_id <= rd;
-            to_reg_file.rob_id <= rob_id;
+            to_reg_file[slot].enabled <= 1;
+            to_reg_file[slot].reg_id <= rd;
+            to_reg_file[slot].rob_id <= rob_id;
             reg_file_written = true;
 
             // Set output to RS_ALU
-            to_rs_alu.enabled <= 1;
-            to_rs_alu.op <= 0x000; // Since ALU will perform addition for address calculation
-            to_rs_alu.Vj <= rs1_result.V;
-            to_rs_alu.Vk <= to_signed(imm_i);
-            to_rs_alu.Qj <= rs1_result.Q;
-            to_rs_alu.Qk <= 0;
-            to_rs_alu.dest <= rob_id;
+            to_rs_alu[slot].enabled <= 1;
+            to_rs_alu[slot].op <= 0x000; // Since ALU will perform addition for address calculation
+            to_rs_alu[slot].Vj <= rs1_result.V;
+            to_rs_alu[slot].Vk <= to_signed(imm_i);
+            to_rs_alu[slot].Qj <= rs1_result.Q;
+            to_rs_alu[slot].Qk <= 0;
+            to_rs_alu[slot].dest <= rob_id;
             rs_alu_written = true;
 
             state        = State::WaitForJalr; // Wait for jalr to complete
@@ -466,121 +674,110 @@ struct Decoder final : dark::Module<Decoder_Input, Decoder_Output> {
             break;
         }
         case 0b1100011: { // Branch Instructions: BEQ, BNE, BLT, BGE, BLTU, BGEU
-            if (rs_bcu_full == 1) {
+            if (to_unsigned(rs_bcu_free) <= group_.bcu) {
                 // BCU reservation station is full
-                issue_failure(program_counter);
-                return;
+                return issue_failure(IssueSlot::RsBcuFull, slot);
             }
 
-            // Calculate branch target address
-            Bit<32> target_address            = program_counter + to_signed(imm_b);
-            Bit<32> predicted_program_counter = to_unsigned(predicted_branch_taken)
-                                                    ? target_address
-                                                    : program_counter + 4;
+            // Calculate branch target address, the fetcher has followed the predicted one already
+            Bit<32> target_address = program_counter + to_signed(imm_b);
 
             // Set output to ROB (registration of branch instruction)
-            to_rob.enabled <= 1;
-            to_rob.op <= 1;                      // type 'branch'
-            to_rob.value_ready <= 0;             // value not ready until branch is resolved
-            to_rob.value <= 0;                   // temporary
-            to_rob.alt_value <= program_counter; // Current pc
-            to_rob.dest <= 0;                    // No register to write to
-            to_rob.predicted_branch_taken <= predicted_branch_taken;
+            to_rob[slot].enabled <= 1;
+            to_rob[slot].op <= 1;                      // type 'branch'
+            to_rob[slot].value_ready <= 0;             // value not ready until branch is resolved
+            to_rob[slot].value <= 0;                   // temporary
+            to_rob[slot].alt_value <= program_counter; // Current pc
+            to_rob[slot].dest <= 0;                    // No register to write to
+            to_rob[slot].predicted_branch_taken <= predicted_branch_taken;
+            to_rob[slot].unit <= 1;
             rob_written = true;
 
-            // Prepare to set the fetcher to the predicted next instruction
-            to_fetcher.enabled <= 1;
-            to_fetcher.pc <= predicted_program_counter;
-            fetcher_written = true;
-
             // Set output to RS_BCU
-            to_rs_bcu.enabled <= 1;
-            to_rs_bcu.op <= func3;
-            to_rs_bcu.Vj <= rs1_result.V;
-            to_rs_bcu.Vk <= rs2_result.V;
-            to_rs_bcu.Qj <= rs1_result.Q;
-            to_rs_bcu.Qk <= rs2_result.Q;
-            to_rs_bcu.dest <= rob_id;
-            to_rs_bcu.pc_fallthrough <= program_counter + 4;
-            to_rs_bcu.pc_target <= target_address;
+            to_rs_bcu[slot].enabled <= 1;
+            to_rs_bcu[slot].op <= func3;
+            to_rs_bcu[slot].Vj <= rs1_result.V;
+            to_rs_bcu[slot].Vk <= rs2_result.V;
+            to_rs_bcu[slot].Qj <= rs1_result.Q;
+            to_rs_bcu[slot].Qk <= rs2_result.Q;
+            to_rs_bcu[slot].dest <= rob_id;
+            to_rs_bcu[slot].pc_fallthrough <= program_counter + length;
+            to_rs_bcu[slot].pc_target <= target_address;
             rs_bcu_written = true;
 
-            state          = State::SkipOneCycle; // Skip 1 cycle
-            last_branch_id = rob_id;              // Updates the last_branch_id
-
             break;
         }
         case 0b0000011: { // Load Instructions: LB, LH, LW, LBU, LHU
-            if (rs_mem_load_full == 1) {
+            if (to_unsigned(rs_mem_load_free) <= group_.load) {
                 // Load reservation station is full
-                issue_failure(program_counter);
-                return;
+                return issue_failure(IssueSlot::RsLoadFull, slot);
             }
 
             // Set output to ROB (registration of load instruction)
-            to_rob.enabled <= 1;
-            to_rob.op <= 2;          // type 'others'
-            to_rob.value_ready <= 0; // value not ready until loaded from memory
-            to_rob.value <= 0;       // temporary
-            to_rob.alt_value <= 0;   // unused
-            to_rob.dest <= rd;
-            to_rob.predicted_branch_taken <= 0; // Not a branch
+            to_rob[slot].enabled <= 1;
+            to_rob[slot].op <= 2;          // type 'others'
+            to_rob[slot].value_ready <= 0; // value not ready until loaded from memory
+            to_rob[slot].value <= 0;       // temporary
+            to_rob[slot].alt_value <= 0;   // unused
+            to_rob[slot].dest <= rd;
+            to_rob[slot].predicted_branch_taken <= 0; // Not a branch
+            to_rob[slot].unit <= 2;
             rob_written = true;
 
             // Reserve ROB entry for this instruction
-            to_reg_file.enabled <= 1;
-            to_reg_file.reg_id <= rd;
-            to_reg_file.rob_id <= rob_id;
+            to_reg_file[slot].enabled <= 1;
+            to_reg_file[slot].reg_id <= rd;
+            to_reg_file[slot].rob_id <= rob_id;
             reg_file_written = true;
 
             // Set output to RS_Mem_Load
-            to_rs_mem_load.enabled <= 1;
-            to_rs_mem_load.op <= func3;
-            to_rs_mem_load.Vj <= rs1_result.V;
-            to_rs_mem_load.Qj <= rs1_result.Q;
-            to_rs_mem_load.dest <= rob_id;
-            to_rs_mem_load.offset <= imm_i;
+            to_rs_mem_load[slot].enabled <= 1;
+            to_rs_mem_load[slot].op <= func3;
+            to_rs_mem_load[slot].Vj <= rs1_result.V;
+            to_rs_mem_load[slot].Qj <= rs1_result.Q;
+            to_rs_mem_load[slot].dest <= rob_id;
+            to_rs_mem_load[slot].offset <= imm_i;
+            to_rs_mem_load[slot].pc <= program_counter;
             rs_mem_load_written = true;
 
             break;
         }
 
         case 0b0100011: { // Store Instructions: SB, SH, SW
-            if (rs_mem_store_full == 1) {
+            if (to_unsigned(rs_mem_store_free) <= group_.store) {
                 // Store reservation station is full
-                issue_failure(program_counter);
-                return;
+                return issue_failure(IssueSlot::RsStoreFull, slot);
             }
 
             // Set output to ROB (registration of store instruction)
-            to_rob.enabled <= 1;
-            to_rob.op <= 2;                     // type 'others'
-            to_rob.value_ready <= 0;            // value not ready until written to memory
-            to_rob.value <= 0;                  // temporary
-            to_rob.alt_value <= 0;              // unused
-            to_rob.dest <= 0;                   // No destination register for store
-            to_rob.predicted_branch_taken <= 0; // Not a branch prediction
+            to_rob[slot].enabled <= 1;
+            to_rob[slot].op <= 2;                     // type 'others'
+            to_rob[slot].value_ready <= 0;            // not ready until the address and data are known
+            to_rob[slot].value <= 0;                  // temporary
+            to_rob[slot].alt_value <= 0;              // unused
+            to_rob[slot].dest <= 0;                   // No destination register for store
+            to_rob[slot].predicted_branch_taken <= 0; // Not a branch prediction
+            to_rob[slot].unit <= 3;
             rob_written = true;
 
             // Set output to RS_Mem_Store
-            to_rs_mem_store.enabled <= 1;
-            to_rs_mem_store.op <= func3;
-            to_rs_mem_store.Vj <= rs1_result.V;
-            to_rs_mem_store.Vk <= rs2_result.V;
-            to_rs_mem_store.Qj <= rs1_result.Q;
-            to_rs_mem_store.Qk <= rs2_result.Q;
-            to_rs_mem_store.Qm <= last_branch_id;
-            to_rs_mem_store.dest <= rob_id;
-            to_rs_mem_store.offset <= imm_s;
+            to_rs_mem_store[slot].enabled <= 1;
+            to_rs_mem_store[slot].op <= func3;
+            to_rs_mem_store[slot].Vj <= rs1_result.V;
+            to_rs_mem_store[slot].Vk <= rs2_result.V;
+            to_rs_mem_store[slot].Qj <= rs1_result.Q;
+            to_rs_mem_store[slot].Qk <= rs2_result.Q;
+            to_rs_mem_store[slot].dest <= rob_id;
+            to_rs_mem_store[slot].offset <= imm_s;
+            to_rs_mem_store[slot].pc <= program_counter;
             rs_mem_store_written = true;
 
             break;
         }
         case 0b0010011: { // I-type ALU Instructions: ADDI, SLTI, SLTIU, XORI, ORI, ANDI, SLLI, SRLI, SRAI
-            if (rs_alu_full == 1) {
+            if (to_unsigned(rs_alu_free) <= group_.alu) {
                 // ALU reservation station is full
-                issue_failure(program_counter);
-                return;
+                return issue_failure(IssueSlot::RsAluFull, slot);
             }
 
             Bit<2> op;
@@ -592,70 +789,103 @@ struct Decoder final : dark::Module<Decoder_Input, Decoder_Output> {
             }
 
             // Set output to ROB (registration of ALU I-type instruction)
-            to_rob.enabled <= 1;
-            to_rob.op <= op;
-            to_rob.value_ready <= 0; // value not ready until ALU computes it
-            to_rob.value <= 0;       // temporary
-            to_rob.alt_value <= 0;   // unused
-            to_rob.dest <= rd;
-            to_rob.predicted_branch_taken <= 0; // Not a branch
+            to_rob[slot].enabled <= 1;
+            to_rob[slot].op <= op;
+            to_rob[slot].value_ready <= 0; // value not ready until ALU computes it
+            to_rob[slot].value <= 0;       // temporary
+            to_rob[slot].alt_value <= 0;   // unused
+            to_rob[slot].dest <= rd;
+            to_rob[slot].predicted_branch_taken <= 0; // Not a branch
+            to_rob[slot].unit <= 0;
             rob_written = true;
 
             // Reserve ROB entry for this instruction
-            to_reg_file.enabled <= 1;
-            to_reg_file.reg_id <= rd;
-            to_reg_file.rob_id <= rob_id;
+            to_reg_file[slot].enabled <= 1;
+            to_reg_file[slot].reg_id <= rd;
+            to_reg_file[slot].rob_id <= rob_id;
             reg_file_written = true;
 
             // Set output to RS_ALU
-            to_rs_alu.enabled <= 1;
+            to_rs_alu[slot].enabled <= 1;
             if (func3 == 0b001 || func3 == 0b101) {                      // SLLI, SRLI, SRAI
-                to_rs_alu.op <= Bit{instruction.range<30, 30>(), func3}; // func7 bit 5 and func3 define ALU operation
+                to_rs_alu[slot].op <= Bit{instruction.range<30, 30>(), func3}; // func7 bit 5 and func3 define ALU operation
             } else {                                                     // ADDI, SLTI, SLTIU, XORI, ORI, ANDI
-                to_rs_alu.op <= Bit{Bit<1>{0}, func3};
+                to_rs_alu[slot].op <= Bit{Bit<1>{0}, func3};
             }
-            to_rs_alu.Vj <= rs1_result.V;
-            to_rs_alu.Vk <= ((func3 == 0b001 || func3 == 0b101)
+            to_rs_alu[slot].Vj <= rs1_result.V;
+            to_rs_alu[slot].Vk <= ((func3 == 0b001 || func3 == 0b101)
                                  ? to_unsigned(instruction.range<24, 20>())
                                  : to_signed(imm_i));
-            to_rs_alu.Qj <= rs1_result.Q;
-            to_rs_alu.Qk <= 0;
-            to_rs_alu.dest <= rob_id;
+            to_rs_alu[slot].Qj <= rs1_result.Q;
+            to_rs_alu[slot].Qk <= 0;
+            to_rs_alu[slot].dest <= rob_id;
             rs_alu_written = true;
 
             break;
         }
         case 0b0110011: { // R-type ALU Instructions: ADD, SUB, SLL, SLT, SLTU, XOR, SRL, SRA, OR, AND
-            if (rs_alu_full == 1) {
+            if (func7 == 0b0000001) { // RV32M: MUL, MULH, MULHSU, MULHU, DIV, DIVU, REM, REMU
+                if (to_unsigned(rs_mdu_free) <= group_.mdu) {
+                    // MDU reservation station is full
+                    return issue_failure(IssueSlot::RsMduFull, slot);
+                }
+
+                to_rob[slot].enabled <= 1;
+                to_rob[slot].op <= 2;          // type 'others'
+                to_rob[slot].value_ready <= 0; // value not ready until MDU computes it
+                to_rob[slot].value <= 0;
+                to_rob[slot].alt_value <= 0;
+                to_rob[slot].dest <= rd;
+                to_rob[slot].predicted_branch_taken <= 0;
+                to_rob[slot].unit <= 4;
+                rob_written = true;
+
+                to_reg_file[slot].enabled <= 1;
+                to_reg_file[slot].reg_id <= rd;
+                to_reg_file[slot].rob_id <= rob_id;
+                reg_file_written = true;
+
+                to_rs_mdu[slot].enabled <= 1;
+                to_rs_mdu[slot].op <= func3;
+                to_rs_mdu[slot].Vj <= rs1_result.V;
+                to_rs_mdu[slot].Vk <= rs2_result.V;
+                to_rs_mdu[slot].Qj <= rs1_result.Q;
+                to_rs_mdu[slot].Qk <= rs2_result.Q;
+                to_rs_mdu[slot].dest <= rob_id;
+                rs_mdu_written = true;
+
+                break;
+            }
+            if (to_unsigned(rs_alu_free) <= group_.alu) {
                 // ALU reservation station is full
-                issue_failure(program_counter);
-                return;
+                return issue_failure(IssueSlot::RsAluFull, slot);
             }
 
             // Set output to ROB (registration of ALU R-type instruction)
-            to_rob.enabled <= 1;
-            to_rob.op <= 2;          // type 'others'
-            to_rob.value_ready <= 0; // value not ready until ALU computes it
-            to_rob.value <= 0;       // temporary
-            to_rob.alt_value <= 0;   // unused
-            to_rob.dest <= rd;
-            to_rob.predicted_branch_taken <= 0; // Not a branch
+            to_rob[slot].enabled <= 1;
+            to_rob[slot].op <= 2;          // type 'others'
+            to_rob[slot].value_ready <= 0; // value not ready until ALU computes it
+            to_rob[slot].value <= 0;       // temporary
+            to_rob[slot].alt_value <= 0;   // unused
+            to_rob[slot].dest <= rd;
+            to_rob[slot].predicted_branch_taken <= 0; // Not a branch
+            to_rob[slot].unit <= 0;
             rob_written = true;
 
             // Reserve ROB entry for this instruction
-            to_reg_file.enabled <= 1;
-            to_reg_file.reg_id <= rd;
-            to_reg_file.rob_id <= rob_id;
+            to_reg_file[slot].enabled <= 1;
+            to_reg_file[slot].reg_id <= rd;
+            to_reg_file[slot].rob_id <= rob_id;
             reg_file_written = true;
 
             // Set output to RS_ALU
-            to_rs_alu.enabled <= 1;
-            to_rs_alu.op <= Bit{func7[5], func3}; // func7 bit 5 and func3 define ALU operation
-            to_rs_alu.Vj <= rs1_result.V;
-            to_rs_alu.Vk <= rs2_result.V;
-            to_rs_alu.Qj <= rs1_result.Q;
-            to_rs_alu.Qk <= rs2_result.Q;
-            to_rs_alu.dest <= rob_id;
+            to_rs_alu[slot].enabled <= 1;
+            to_rs_alu[slot].op <= Bit{func7[5], func3}; // func7 bit 5 and func3 define ALU operation
+            to_rs_alu[slot].Vj <= rs1_result.V;
+            to_rs_alu[slot].Vk <= rs2_result.V;
+            to_rs_alu[slot].Qj <= rs1_result.Q;
+            to_rs_alu[slot].Qk <= rs2_result.Q;
+            to_rs_alu[slot].dest <= rob_id;
             rs_alu_written = true;
 
             break;
@@ -668,44 +898,80 @@ struct Decoder final : dark::Module<Decoder_Input, Decoder_Output> {
         // std::cerr << "IDU: Issued instruction @" << std::hex << to_unsigned(program_counter) << " to ROB entry " <<
         //     to_unsigned(rob_id) << std::endl;
 
+        stats_->record_issue_slot(IssueSlot::Issued);
+        pop_fetch_queue();
+        if (rob_written) {
+            to_rob[slot].pc <= program_counter;
+            to_rob[slot].history <= history;
+            tracer_->issue(to_unsigned(rob_id));
+        }
 
-        to_rs_alu.write_disable(!rs_alu_written);
-        to_rs_bcu.write_disable(!rs_bcu_written);
-        to_rs_mem_load.write_disable(!rs_mem_load_written);
-        to_rs_mem_store.write_disable(!rs_mem_store_written);
-        to_rob.write_disable(!rob_written);
-        to_fetcher.write_disable(!fetcher_written);
-        to_reg_file.write_disable(!reg_file_written);
+        to_rs_alu[slot].write_disable(!rs_alu_written);
+        to_rs_mdu[slot].write_disable(!rs_mdu_written);
+        to_rs_bcu[slot].write_disable(!rs_bcu_written);
+        to_rs_mem_load[slot].write_disable(!rs_mem_load_written);
+        to_rs_mem_store[slot].write_disable(!rs_mem_store_written);
+        to_rob[slot].write_disable(!rob_written);
+        to_reg_file[slot].write_disable(!reg_file_written);
+
+        bool renamed = rename_policy_ == Rename_Policy::PhysicalRegisterFile && rob_written;
+        if (renamed) {
+            unsigned dest = reg_file_written ? to_unsigned(rd) : 0;
+            // The return address of a jalr is known at issue, unlike its target
+            if (opcode == 0b1100111) rename(slot, dest, rob_id, true, program_counter + length);
+            else rename(slot, dest, rob_id, value_ready, value);
+            if (rs_bcu_written) rename_.checkpoint(to_unsigned(rob_id));
+        }
+        to_prf[slot].write_disable(!renamed);
+
+        // The later instructions of the group see this one, see query_register
+        group_.entries[slot] = {reg_file_written ? to_unsigned(rd) : 0u, rob_id, value_ready, value};
+        group_.alu += rs_alu_written;
+        group_.mdu += rs_mdu_written;
+        group_.bcu += rs_bcu_written;
+        group_.load += rs_mem_load_written;
+        group_.store += rs_mem_store_written;
+        group_.rob_id = next_rob_id(to_unsigned(rob_id));
+        ++group_.size;
+        return true;
     }
 
-    void issue_failure(Bit<32> program_counter) {
-        state = State::IssuePrevious; // Try to issue previous instruction
-
-        to_fetcher.enabled <= 1;
-        to_fetcher.pc <= program_counter + 4;
-        // so that once the previous instruction is issued, the decoder will receive the next instruction in the next cycle
-
-        to_rob.write_disable();
-        to_rs_alu.write_disable();
-        to_rs_bcu.write_disable();
-        to_rs_mem_load.write_disable();
-        to_rs_mem_store.write_disable();
+    /// The instruction stays at the head of the fetch queue, to be issued again in the next cycle, and so do the ones
+    /// after it. The rest of the group, from `slot` on, is attributed to `reason`.
+    bool issue_failure(IssueSlot reason, unsigned slot) {
+        stats_->record_issue_slot(reason, issue_width_ - slot);
+        return false;
     }
 
 private:
     enum class State {
-        SkipOneCycle  = 0,
-        TryToIssue    = 1,
-        IssuePrevious = 2,
-        WaitForJalr   = 3
+        SkipOneCycle = 0,
+        TryToIssue   = 1,
+        WaitForJalr  = 2
+    };
+
+    /// The instructions issued so far in this cycle.
+    struct Issue_Group {
+        unsigned          size = 0;
+        unsigned          alu = 0, mdu = 0, bcu = 0, load = 0, store = 0; // the entries taken in each station
+        Bit<ROB_SIZE_LOG> rob_id;                                          // the ROB entry of the next instruction
+        std::array<Group_Entry, ISSUE_WIDTH_MAX> entries;
     };
 
-    State             state = State::SkipOneCycle; // Initial state is `skip 1 cycle`.
-    Bit<ROB_SIZE_LOG> last_branch_id; // the rob_id of the last uncommitted branch instruction, used in RS_Mem_Store
+    State             state = State::TryToIssue;
     Bit<ROB_SIZE_LOG> last_jalr_id; // the rob_id of the last jalr instruction whose address is yet unknown
-    Bit<32>           last_instruction;
-    Bit<32>           last_program_counter;
-    Bit<1>            last_predicted_branch_taken;
+    unsigned          issue_width_;
+    Issue_Group       group_;
+    unsigned long long cycle_ = 0;
+    Rename_Policy      rename_policy_;
+    // For Rename_Policy::PhysicalRegisterFile only
+    rename_table::Rename_Table              rename_;
+    std::array<Physical_Register, PRF_SIZE> pregs_;
+    std::vector<Fetched_Instruction> fetch_queue_; // a ring, oldest first
+    std::size_t                      fetch_queue_head_  = 0;
+    std::size_t                      fetch_queue_count_ = 0;
+    Stats*            stats_;
+    Tracer*           tracer_;
 };
 
 inline void Output_To_Fetcher::write_disable(bool valid) {
@@ -724,6 +990,9 @@ inline void Output_To_ROB::write_disable(bool valid) {
         alt_value <= 0;
         dest <= 0;
         predicted_branch_taken <= 0;
+        unit <= 0;
+        pc <= 0;
+        history <= 0;
     }
 }
 
@@ -739,6 +1008,18 @@ inline void Output_To_RS_ALU::write_disable(bool valid) {
     }
 }
 
+inline void Output_To_RS_MDU::write_disable(bool valid) {
+    if (valid) {
+        enabled <= 0;
+        op <= 0;
+        Vj <= 0;
+        Vk <= 0;
+        Qj <= 0;
+        Qk <= 0;
+        dest <= 0;
+    }
+}
+
 inline void Output_To_RS_BCU::write_disable(bool valid) {
     if (valid) {
         enabled <= 0;
@@ -761,6 +1042,7 @@ inline void Output_To_RS_Mem_Load::write_disable(bool valid) {
         Qj <= 0;
         dest <= 0;
         offset <= 0;
+        pc <= 0;
     }
 }
 
@@ -772,9 +1054,9 @@ inline void Output_To_RS_Mem_Store::write_disable(bool valid) {
         Vk <= 0;
         Qj <= 0;
         Qk <= 0;
-        Qm <= 0;
         dest <= 0;
         offset <= 0;
+        pc <= 0;
     }
 }
 
@@ -785,4 +1067,14 @@ inline void Output_To_RegFile::write_disable(bool valid) {
         rob_id <= 0;
     }
 }
+
+inline void Output_To_PRF::write_disable(bool valid) {
+    if (valid) {
+        enabled <= 0;
+        preg <= 0;
+        rob_id <= 0;
+        value_ready <= 0;
+        value <= 0;
+    }
+}
 } // namespace decoder
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+
+#include "constants.h"
+
+/**
+ * A set of entry indices in [0, N), one bit per entry.
+ * Waking up entries is an AND/OR, selecting the first entry is a count-trailing-zeros,
+ * and counting entries is a popcount, so none of them loops over the entries one by one.
+ */
+template <std::size_t N>
+class Entry_Mask {
+public:
+    static constexpr std::size_t npos = N; // returned by first() when the set is empty
+
+    void set(std::size_t index) { words_[index / 64] |= bit(index); }
+    void reset(std::size_t index) { words_[index / 64] &= ~bit(index); }
+    bool test(std::size_t index) const { return (words_[index / 64] & bit(index)) != 0; }
+    void clear() { words_ = {}; }
+
+    bool any() const {
+        for (auto word : words_) {
+            if (word != 0) return true;
+        }
+        return false;
+    }
+
+    std::size_t count() const {
+        std::size_t count = 0;
+        for (auto word : words_) count += std::popcount(word);
+        return count;
+    }
+
+    /// The lowest index in the set, or npos.
+    std::size_t first() const {
+        for (std::size_t i = 0; i < kWords; ++i) {
+            if (words_[i] != 0) return i * 64 + std::countr_zero(words_[i]);
+        }
+        return npos;
+    }
+
+    /// Calls `f(index)` for every index in the set, in increasing order.
+    template <typename F>
+    void for_each(F&& f) const {
+        for (std::size_t i = 0; i < kWords; ++i) {
+            for (auto word = words_[i]; word != 0; word &= word - 1) f(i * 64 + std::countr_zero(word));
+        }
+    }
+
+    Entry_Mask& operator|=(const Entry_Mask& rhs) {
+        for (std::size_t i = 0; i < kWords; ++i) words_[i] |= rhs.words_[i];
+        return *this;
+    }
+
+    Entry_Mask& operator&=(const Entry_Mask& rhs) {
+        for (std::size_t i = 0; i < kWords; ++i) words_[i] &= rhs.words_[i];
+        return *this;
+    }
+
+    /// Removes the indices in `rhs` from the set.
+    Entry_Mask& subtract(const Entry_Mask& rhs) {
+        for (std::size_t i = 0; i < kWords; ++i) words_[i] &= ~rhs.words_[i];
+        return *this;
+    }
+
+    friend Entry_Mask operator|(Entry_Mask lhs, const Entry_Mask& rhs) { return lhs |= rhs; }
+    friend Entry_Mask operator&(Entry_Mask lhs, const Entry_Mask& rhs) { return lhs &= rhs; }
+
+    /// The indices in [0, N) that are not in the set.
+    Entry_Mask operator~() const {
+        Entry_Mask result;
+        for (std::size_t i = 0; i < kWords; ++i) result.words_[i] = ~words_[i];
+        if constexpr (N % 64 != 0) result.words_[kWords - 1] &= (uint64_t{1} << (N % 64)) - 1;
+        return result;
+    }
+
+private:
+    static constexpr std::size_t kWords = (N + 63) / 64;
+
+    std::array<uint64_t, kWords> words_ = {};
+
+    static uint64_t bit(std::size_t index) { return uint64_t{1} << (index % 64); }
+};
+
+/**
+ * The entries of a reservation station that wait for an operand, indexed by the ROB id producing it.
+ * A broadcast of a ROB id wakes all the entries waiting for it at once.
+ */
+template <std::size_t N>
+class Tag_Wait {
+public:
+    /// The entry waits for `rob_id`, unless it is 0.
+    void wait(std::size_t index, unsigned rob_id) {
+        if (rob_id == 0) return;
+        by_tag_[rob_id].set(index);
+        pending_.set(index);
+        tag_[index] = rob_id;
+    }
+
+    /// Returns the entries waiting for `rob_id`, which stop waiting.
+    Entry_Mask<N> wake(unsigned rob_id) {
+        auto woken = by_tag_[rob_id];
+        by_tag_[rob_id].clear();
+        pending_.subtract(woken);
+        return woken;
+    }
+
+    /// The entries waiting for any ROB id.
+    const Entry_Mask<N>& pending() const { return pending_; }
+
+    /// The entries in `entries` are squashed and stop waiting.
+    void remove(const Entry_Mask<N>& entries) {
+        (pending_ & entries).for_each([&](std::size_t i) { by_tag_[tag_[i]].reset(i); });
+        pending_.subtract(entries);
+    }
+
+    void clear() { remove(pending_); }
+
+private:
+    std::array<Entry_Mask<N>, ROB_SIZE> by_tag_;
+    Entry_Mask<N>                       pending_;
+    std::array<uint16_t, N>             tag_ = {}; // the ROB id each pending entry waits for
+};
+
+/**
+ * The relative age of the entries of a reservation station: row i holds the entries older than entry i.
+ * The oldest of a set of entries is the one with none of the others in its row.
+ */
+template <std::size_t N>
+class Age_Matrix {
+public:
+    /// Entry `index` is allocated, so it is younger than every entry in `occupied`.
+    void insert(std::size_t index, const Entry_Mask<N>& occupied) {
+        for (auto& row : older_) row.reset(index);
+        older_[index] = occupied;
+        older_[index].reset(index);
+    }
+
+    /// The oldest entry in `candidates`, or npos if there is none.
+    std::size_t oldest(const Entry_Mask<N>& candidates) const {
+        std::size_t result = Entry_Mask<N>::npos;
+        candidates.for_each([&](std::size_t i) {
+            if (result == Entry_Mask<N>::npos && !(older_[i] & candidates).any()) result = i;
+        });
+        return result;
+    }
+
+private:
+    std::array<Entry_Mask<N>, N> older_;
+};
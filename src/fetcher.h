@@ -4,75 +4,252 @@
 
 #pragma once
 
+#include "cache.h"
+#include "compressed.h"
 #include "memory.h"
 #include "tools.h"
 #include "branch_predictor.h"
+#include "tracer.h"
 
 namespace fetcher {
 
 using BranchPredictor = branch_prediction::TAGEPredictor;
 
 struct Fetcher_Input {
-    Wire<32> last_PC_plus_4;
-
     Wire<32> pc_from_decoder;
     Wire<1> pc_from_decoder_enabled;
 
     Wire<32> pc_from_ROB;   // the last bit should be 0
     Wire<1> pc_from_ROB_enabled;
+    Wire<32> history_from_ROB; // the global history to go on from at pc_from_ROB
 
     Wire<32> pc_of_branch;  // from ROB, used for updating the branch predictor
     Wire<1> branch_taken;
     Wire<1> branch_record_enabled;
+    Wire<32> branch_history; // the global history the branch was predicted with
+
+    Wire<32> queue_vacancy; // from decoder, the free entries of the fetch queue
 };
 
+/// A group of up to `fetch_width` instructions in program order, see Fetcher.
 struct Fetcher_Output {
-    Register<32> instruction;
-    Register<32> program_counter;
-    Register<1> predicted_branch_taken;
+    std::array<Register<1>, ISSUE_WIDTH_MAX> valid; // whether an instruction is fetched in the slot
+    std::array<Register<32>, ISSUE_WIDTH_MAX> instruction; // as in the memory, a compressed one is not expanded
+    std::array<Register<32>, ISSUE_WIDTH_MAX> program_counter;
+    std::array<Register<1>, ISSUE_WIDTH_MAX> predicted_branch_taken;
+    std::array<Register<32>, ISSUE_WIDTH_MAX> history; // the global history of the branch predictor before the slot
 };
 
 /**
- * Fetcher is responsible for fetching the instruction from memory,
- * and predicting whether the branch will be taken (assuming every instruction is a branch).
+ * Fetcher is responsible for fetching the instructions from memory into the fetch queue of the decoder.
+ * It follows the predicted path on its own: the target of a jal is taken from the instruction, and a branch is
+ * predicted by the branch predictor. After a jalr it waits for the decoder to send the target.
+ * The global history of the branch predictor takes the predicted direction of each branch as it is fetched, and
+ * travels with the instruction, so that a redirect from the ROB restores the history of the path fetched again and
+ * a committed branch trains the predictor with the history it was predicted with.
+ * It runs ahead of the decoder as long as the fetch queue has room, and a miss in the instruction cache holds it.
+ * Up to `fetch_width` instructions are fetched in a cycle, from a single line and up to the first jump, be it a jal,
+ * a jalr or a branch predicted to be taken.
+ * The instructions are 2 bytes aligned, as those of the RV32C extension are 2 bytes long, see compressed::read.
+ * A 32-bit instruction in the last 2 bytes of a line needs the next line as well, and is the last one fetched from
+ * the line.
  *
- * The brahch predictor is not implemented yet.
+ * The prefetcher walks the predicted path ahead of the fetch, up to `prefetch_distance` lines, and starts filling the
+ * lines missing from the instruction cache. It reads the instructions of a line only once the line has arrived.
  */
 struct Fetcher final : dark::Module<Fetcher_Input, Fetcher_Output> {
-    explicit Fetcher(Memory *memory) : memory(memory) {}
+    Fetcher(Memory *memory, cache::Cache *icache, Tracer *tracer, unsigned prefetch_distance = 0,
+            unsigned fetch_width = 1)
+        : memory(memory), icache(icache), tracer(tracer), fetch_width(fetch_width),
+          prefetch_distance(prefetch_distance) {
+        dark::debug::assert(fetch_width >= 1 && fetch_width <= ISSUE_WIDTH_MAX, "Fetcher: invalid fetch width");
+    }
     void work() {
         static bool is_first_run = true;
         if (is_first_run) {
             first_run();
             is_first_run = false;
-            return ;
         }
-        unsigned pc;
+        ++cycle;
+
         if (pc_from_ROB_enabled) {
-            pc = to_unsigned(pc_from_ROB);
+            redirect(to_unsigned(pc_from_ROB));
+            branch_predictor.restore(to_unsigned(history_from_ROB));
         } else if (pc_from_decoder_enabled) {
-            pc = to_unsigned(pc_from_decoder);
-        } else {
-            pc = to_unsigned(last_PC_plus_4);
+            redirect(to_unsigned(pc_from_decoder));
         }
 
         if (branch_record_enabled) {
-            branch_predictor.update(to_unsigned(pc_of_branch), to_unsigned(branch_taken));
+            branch_predictor.update(to_unsigned(pc_of_branch), to_unsigned(branch_taken),
+                                    to_unsigned(branch_history));
         }
 
-        instruction <= memory->get_word(pc);    // fetching the instruction takes only 1 cycle
-        program_counter <= pc;
-        predicted_branch_taken <= branch_predictor.predict(pc);
+        fetch();
+        prefetch();
     }
     void first_run() {
-        unsigned pc = 0;
-        instruction <= memory->get_word(pc);
-        program_counter <= pc;
-        predicted_branch_taken <= false;
         branch_predictor.reset();
+        redirect(0);
     }
 private:
     Memory *memory;
+    cache::Cache *icache;
+    Tracer *tracer;
     BranchPredictor branch_predictor{};
+    unsigned long long cycle = 0;
+
+    unsigned pc = 0;                   // the next instruction to fetch
+    bool waiting = false;              // for the target of a jalr
+    bool accessed = false;             // whether the instruction cache is accessed for pc
+    bool spilled = false;              // whether it is accessed for the next line, which the instruction at pc ends in
+    unsigned long long fetch_ready = 0; // the cycle pc can be fetched in, once accessed
+    unsigned fetch_width;
+    unsigned fetched = 0;              // the instructions fetched in the last cycle
+
+    unsigned prefetch_distance;
+    unsigned walk_pc = 0;              // the next instruction the prefetcher reads
+    bool walking = false;              // false after a jalr
+    int walk_ahead = 0;                // the lines the prefetcher is ahead of the fetch
+
+    void redirect(unsigned new_pc) {
+        pc = new_pc;
+        waiting = false;
+        accessed = false;
+        restart_walk();
+    }
+
+    void fetch() {
+        // The instructions fetched in the last cycle may still take entries of the queue
+        unsigned room  = to_unsigned(queue_vacancy) - fetched;
+        unsigned count = 0;
+        while (count < fetch_width && count < room && !waiting && line_ready()) {
+            unsigned word   = compressed::read(*memory, pc);
+            unsigned length = compressed::length(word);
+            bool taken = false;
+            unsigned next = pc + length;
+            history[count] <= branch_predictor.history();
+            waiting = !next_pc(pc, word, next, taken, true);
+            valid[count] <= 1;
+            instruction[count] <= word;
+            program_counter[count] <= pc;
+            predicted_branch_taken[count] <= taken;
+            tracer->fetch(pc, word);
+            ++count;
+
+            bool step = leaves_line(pc, length, next);
+            pc = next;
+            accessed = false;
+            if (step) {
+                if (--walk_ahead < 0) restart_walk(); // the fetch has overtaken the prefetcher
+                break;
+            }
+        }
+        for (unsigned i = count; i < fetch_width; ++i) {
+            valid[i] <= 0;
+            instruction[i] <= 0;
+            program_counter[i] <= 0;
+            predicted_branch_taken[i] <= 0;
+            history[i] <= 0;
+        }
+        fetched = count;
+    }
+
+    /**
+     * Whether the line of pc can be read in this cycle. The first call for pc accesses the instruction cache, once
+     * an MSHR is free in case of a miss. Once the line has arrived, an instruction found to run into the next line
+     * accesses that one as well.
+     */
+    bool line_ready() {
+        if (!accessed) {
+            if (!icache->contains(pc) && icache->free_mshrs(cycle) == 0) return false;
+            fetch_ready = cycle + icache->access(pc, false, cycle) - 1; // a hit takes the cycle of the fetch
+            accessed = true;
+            spilled  = false;
+        }
+        if (cycle < fetch_ready) return false;
+        unsigned end = pc + compressed::length(memory->get_half(pc)) - 1;
+        if (!spilled && end / icache->line_size() != pc / icache->line_size()) {
+            if (!icache->contains(end) && icache->free_mshrs(cycle) == 0) return false;
+            fetch_ready = cycle + icache->access(end, false, cycle) - 1;
+            spilled = true;
+        }
+        return cycle >= fetch_ready;
+    }
+
+    /**
+     * The pc after the instruction `word` at `at` on the predicted path, which is put in `next`, holding the pc after
+     * it on entry. `taken` is set for a branch predicted to be taken, and shifted into the global history if
+     * `speculate`, as the fetch does but not the prefetcher. Returns false for a jalr, whose target is unknown.
+     */
+    bool next_pc(unsigned at, unsigned word, unsigned &next, bool &taken, bool speculate) {
+        if (compressed::length(word) == 2) word = compressed::expand(word);
+        Bit<32> instruction = word;
+        switch (word & 0x7f) {
+        case 0b1101111: { // JAL
+            Bit<21> imm_j = {
+                instruction.range<31, 31>(), instruction.range<19, 12>(), instruction.range<20, 20>(),
+                instruction.range<30, 21>(), Bit<1>(0)
+            };
+            next = at + to_signed(imm_j);
+            return true;
+        }
+        case 0b1100111: // JALR
+            return false;
+        case 0b1100011: { // Branch
+            Bit<13> imm_b = {
+                instruction.range<31, 31>(), instruction.range<7, 7>(), instruction.range<30, 25>(),
+                instruction.range<11, 8>(), Bit<1>(0)
+            };
+            taken = branch_predictor.predict(at);
+            if (speculate) branch_predictor.speculate(taken);
+            if (taken) next = at + to_signed(imm_b);
+            return true;
+        }
+        default:
+            return true;
+        }
+    }
+
+    /// Whether going from the instruction of `length` bytes at `from` to `to` is a step of the prefetcher: a jump, or
+    /// into the next line.
+    bool leaves_line(unsigned from, unsigned length, unsigned to) const {
+        return to != from + length || to / icache->line_size() != from / icache->line_size();
+    }
+
+    void restart_walk() {
+        walk_pc = pc;
+        walking = true;
+        walk_ahead = 0;
+    }
+
+    /// Walks the predicted path by a line, or starts filling the line it is on.
+    void prefetch() {
+        if (!icache->enabled() || prefetch_distance == 0) return;
+        if (!walking || walk_ahead >= static_cast<int>(prefetch_distance)) return;
+        if (!icache->arrived(walk_pc, cycle)) {
+            icache->prefetch(walk_pc, cycle);
+            return;
+        }
+        for (;;) {
+            if (walk_pc > MEMORY_SIZE - 4) {
+                walking = false;
+                return;
+            }
+            unsigned word   = compressed::read(*memory, walk_pc);
+            unsigned length = compressed::length(word);
+            bool taken = false;
+            unsigned next = walk_pc + length;
+            if (!next_pc(walk_pc, word, next, taken, false)) {
+                walking = false;
+                return;
+            }
+            bool step = leaves_line(walk_pc, length, next);
+            walk_pc = next;
+            if (step) {
+                ++walk_ahead;
+                return;
+            }
+        }
+    }
 };
-}
\ No newline at end of file
+}
@@ -4,7 +4,9 @@
 #include <iomanip>
 #include <iostream>
 
+#include "compressed.h"
 #include "memory.h"
+#include "muldiv.h"
 #include "tools.h"
 
 namespace instructions {
@@ -81,7 +83,7 @@ namespace instructions {
 
 /**
  * RISC-V interpreter
- * It supports a part of RV32I instruction set.
+ * It supports a part of RV32I instruction set, with the M and C extensions.
  */
 class Interpreter {
 public:
@@ -109,7 +111,9 @@ uint8_t Interpreter::run(unsigned int max_instructions) {
                   << "Branched to "<< std::setw(8) << target << std::endl;
     };
     for (unsigned instruction_count = 0; instruction_count < max_instructions; instruction_count++) {
-        Bit<32> instruction = memory_->get_word(program_counter_);
+        uint32_t bits   = compressed::read(*memory_, program_counter_);
+        uint32_t length = compressed::length(bits);
+        Bit<32> instruction = length == 2 ? compressed::expand(bits) : bits;
 
         // if (program_counter_ == 0x1000) {
         //     std::cerr << std::setw(8) << std::setfill(' ') << std::hex << to_unsigned(get_register(15))
@@ -140,7 +144,7 @@ uint8_t Interpreter::run(unsigned int max_instructions) {
             auto decoded = instructions::decode_U(instruction);
             get_register(decoded.rd) = to_unsigned(decoded.imm) << 12;
             log(program_counter_, to_unsigned(decoded.imm) << 12, decoded.rd);
-            program_counter_ += 4;
+            program_counter_ += length;
             break;
         }
 
@@ -149,15 +153,15 @@ uint8_t Interpreter::run(unsigned int max_instructions) {
             auto decoded = instructions::decode_U(instruction);
             get_register(decoded.rd) = program_counter_ + (to_unsigned(decoded.imm) << 12);
             log(program_counter_, program_counter_ + (to_unsigned(decoded.imm) << 12), decoded.rd);
-            program_counter_ += 4;
+            program_counter_ += length;
             break;
         }
 
         case 0b1101111: {
             // J-type: JAL
             auto decoded = instructions::decode_J(instruction);
-            get_register(decoded.rd) = program_counter_ + 4;
-            log(program_counter_, program_counter_ + 4, decoded.rd);
+            get_register(decoded.rd) = program_counter_ + length;
+            log(program_counter_, program_counter_ + length, decoded.rd);
             program_counter_ += to_signed(decoded.imm);
             break;
         }
@@ -165,8 +169,8 @@ uint8_t Interpreter::run(unsigned int max_instructions) {
         case 0b1100111: {
             // I-type: JALR
             auto decoded = instructions::decode_I(instruction);
-            get_register(decoded.rd) = program_counter_ + 4;
-            log(program_counter_, program_counter_ + 4, decoded.rd);
+            get_register(decoded.rd) = program_counter_ + length;
+            log(program_counter_, program_counter_ + length, decoded.rd);
             program_counter_ = to_unsigned((get_register(decoded.rs1) + to_signed(decoded.imm)) & ~1);
             break;
         }
@@ -205,8 +209,8 @@ uint8_t Interpreter::run(unsigned int max_instructions) {
                 log_branch(program_counter_, true, program_counter_ + to_signed(decoded.imm));
                 program_counter_ += to_signed(decoded.imm);
             } else {
-                log_branch(program_counter_, false, program_counter_ + 4);
-                program_counter_ += 4;
+                log_branch(program_counter_, false, program_counter_ + length);
+                program_counter_ += length;
             }
             break;
         }
@@ -237,7 +241,7 @@ uint8_t Interpreter::run(unsigned int max_instructions) {
             }
             log(program_counter_, get_register_unsigned(decoded.rd), decoded.rd);
 
-            program_counter_ += 4;
+            program_counter_ += length;
             break;
         }
 
@@ -261,7 +265,7 @@ uint8_t Interpreter::run(unsigned int max_instructions) {
             }
             log(program_counter_, 0, 0);
 
-            program_counter_ += 4;
+            program_counter_ += length;
             break;
         }
 
@@ -305,7 +309,7 @@ uint8_t Interpreter::run(unsigned int max_instructions) {
             }
             log(program_counter_, get_register_unsigned(decoded.rd), decoded.rd);
 
-            program_counter_ += 4;
+            program_counter_ += length;
             break;
         }
 
@@ -313,6 +317,17 @@ uint8_t Interpreter::run(unsigned int max_instructions) {
             // R-type: ALU instructions
             auto decoded = instructions::decode_R(instruction);
 
+            if (decoded.funct7 == 0b0000001) {
+                // RV32M: MUL, MULH, MULHSU, MULHU, DIV, DIVU, REM, REMU
+                get_register(decoded.rd) = muldiv::compute(to_unsigned(decoded.funct3),
+                                                           get_register_unsigned(decoded.rs1),
+                                                           get_register_unsigned(decoded.rs2));
+                log(program_counter_, get_register_unsigned(decoded.rd), decoded.rd);
+
+                program_counter_ += length;
+                break;
+            }
+
             switch (to_unsigned(decoded.funct3)) {
             case 0b000: // ADD / SUB
                 if (decoded.funct7 == 0b0000000) {
@@ -370,7 +385,7 @@ uint8_t Interpreter::run(unsigned int max_instructions) {
             }
             log(program_counter_, get_register_unsigned(decoded.rd), decoded.rd);
 
-            program_counter_ += 4;
+            program_counter_ += length;
             break;
         }
 
@@ -2,10 +2,156 @@
 // Created by zj on 7/31/2024.
 //
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
 #include "simulator.h"
 
-int main() {
-    Simulator simulator;
+/// Parses `<size>,<ways>,<line size>,<lru|plru|random>,<hit latency>,<miss latency>[,<mshrs>]`.
+static bool parse_cache_config(const char* text, cache::Cache_Config& config) {
+    char policy[16] = {};
+    int  fields     = std::sscanf(text, "%u,%u,%u,%15[^,],%u,%u,%u", &config.size, &config.associativity,
+                                  &config.line_size, policy, &config.hit_latency, &config.miss_latency, &config.mshrs);
+    if (fields != 6 && fields != 7) return false;
+    if (std::strcmp(policy, "lru") == 0) config.replacement = cache::Replacement_Policy::LRU;
+    else if (std::strcmp(policy, "plru") == 0) config.replacement = cache::Replacement_Policy::PLRU;
+    else if (std::strcmp(policy, "random") == 0) config.replacement = cache::Replacement_Policy::Random;
+    else return false;
+    return config.valid();
+}
+
+/**
+ * Usage: code [--trace <file> [--trace-window <begin> <end>]]
+ *             [--vcd <file> [--vcd-filter <pattern>]... [--vcd-ring <cycles>]]
+ *             [--host-profile <sample period>] [--oldest-first <alu|bcu|mem|all>]... [--early-recovery]
+ *             [--dcache <size>,<ways>,<line size>,<lru|plru|random>,<hit latency>,<miss latency>[,<mshrs>]]
+ *             [--icache <same as --dcache>] [--prefetch-distance <lines>] [--fetch-queue <entries>]
+ *             [--issue-width <instructions>] [--alus <count>] [--cdbs <count>]
+ *             [--commit-width <instructions>] [--rename <rob|prf>] [--mdu <mul latency>,<div latency>]
+ *             < program.data
+ *   --trace         log the pipeline in the Kanata format, which can be viewed in Konata
+ *   --trace-window  only trace the instructions fetched in cycles [begin, end)
+ *   --vcd           dump the registers of every module in the VCD format, which can be viewed in GTKWave
+ *   --vcd-filter    only dump the signals matching the glob pattern, e.g. `rob.to_fetcher.*` (repeatable)
+ *   --vcd-ring      only dump the last <cycles> cycles before the simulator halts or fails
+ *   --host-profile  report the simulation speed and the host time spent in each module,
+ *                   measured in 1 of every <sample period> cycles (a power of 2, e.g. 1024)
+ *   --oldest-first  issue the oldest ready instruction of the reservation station instead of the lowest slot
+ *   --early-recovery  recover from a mispredicted branch when the BCU resolves it instead of at commit
+ *   --dcache        model a data cache, e.g. `4096,4,32,lru,4,20`; sizes in bytes, latencies in cycles;
+ *                   <mshrs> misses may be in flight at once, 4 by default
+ *   --icache        model an instruction cache, e.g. `4096,4,32,lru,1,20`
+ *   --prefetch-distance  how many lines the instruction prefetcher runs ahead of the fetch, 4 by default, 0 for none
+ *   --fetch-queue   the number of instructions the fetcher can run ahead of the decoder, 8 by default
+ *   --issue-width   the number of instructions fetched and issued in a cycle, 1 by default, at most 4
+ *   --alus          the number of ALUs, 1 by default, at most 4
+ *   --cdbs          the number of CDBs, 2 by default, at most 6; the ALUs take them first, then the multiply/divide
+ *                   unit, then the memory unit
+ *   --commit-width  the number of instructions committed in a cycle, 1 by default, at most 4
+ *   --rename        keep the values in flight in the ROB (by default), or in a physical register file
+ *   --mdu           the cycles of a multiplication, 3 by default, and of a division with a 32-bit quotient, 32 by
+ *                   default, which is shorter for a shorter quotient
+ */
+int main(int argc, char* argv[]) {
+    Simulator_Config         config;
+    const char*              trace_path  = nullptr;
+    unsigned long long       trace_begin = 0, trace_end = 0;
+    const char*              vcd_path    = nullptr;
+    std::vector<std::string> vcd_filters;
+    std::size_t              vcd_ring            = 0;
+    unsigned long long       host_profile_period = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--trace-window") == 0 && i + 2 < argc) {
+            trace_begin = std::strtoull(argv[++i], nullptr, 10);
+            trace_end   = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--vcd") == 0 && i + 1 < argc) {
+            vcd_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--vcd-filter") == 0 && i + 1 < argc) {
+            vcd_filters.emplace_back(argv[++i]);
+        } else if (std::strcmp(argv[i], "--vcd-ring") == 0 && i + 1 < argc) {
+            vcd_ring = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--host-profile") == 0 && i + 1 < argc) {
+            host_profile_period = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--oldest-first") == 0 && i + 1 < argc) {
+            const char* station = argv[++i];
+            bool        all     = std::strcmp(station, "all") == 0;
+            if (all || std::strcmp(station, "alu") == 0) config.rs_alu_policy = Issue_Policy::OldestFirst;
+            if (all || std::strcmp(station, "bcu") == 0) config.rs_bcu_policy = Issue_Policy::OldestFirst;
+            if (all || std::strcmp(station, "mem") == 0) config.rs_mem_policy = Issue_Policy::OldestFirst;
+        } else if (std::strcmp(argv[i], "--early-recovery") == 0) {
+            config.recovery_policy = Recovery_Policy::AtExecute;
+        } else if (std::strcmp(argv[i], "--dcache") == 0 && i + 1 < argc) {
+            if (!parse_cache_config(argv[++i], config.dcache)) {
+                std::cerr << "Invalid cache configuration: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--icache") == 0 && i + 1 < argc) {
+            if (!parse_cache_config(argv[++i], config.icache)) {
+                std::cerr << "Invalid cache configuration: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--prefetch-distance") == 0 && i + 1 < argc) {
+            config.prefetch_distance = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--fetch-queue") == 0 && i + 1 < argc) {
+            config.fetch_queue_size = std::strtoul(argv[++i], nullptr, 10);
+            if (config.fetch_queue_size == 0) {
+                std::cerr << "The fetch queue needs at least 1 entry" << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--issue-width") == 0 && i + 1 < argc) {
+            config.issue_width = std::strtoul(argv[++i], nullptr, 10);
+            if (config.issue_width == 0 || config.issue_width > ISSUE_WIDTH_MAX) {
+                std::cerr << "The issue width must be between 1 and " << ISSUE_WIDTH_MAX << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--alus") == 0 && i + 1 < argc) {
+            config.alu_count = std::strtoul(argv[++i], nullptr, 10);
+            if (config.alu_count == 0 || config.alu_count > ALU_COUNT_MAX) {
+                std::cerr << "The number of ALUs must be between 1 and " << ALU_COUNT_MAX << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--cdbs") == 0 && i + 1 < argc) {
+            config.cdb_count = std::strtoul(argv[++i], nullptr, 10);
+            if (config.cdb_count == 0 || config.cdb_count > CDB_COUNT_MAX) {
+                std::cerr << "The number of CDBs must be between 1 and " << CDB_COUNT_MAX << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--commit-width") == 0 && i + 1 < argc) {
+            config.commit_width = std::strtoul(argv[++i], nullptr, 10);
+            if (config.commit_width == 0 || config.commit_width > COMMIT_WIDTH_MAX) {
+                std::cerr << "The commit width must be between 1 and " << COMMIT_WIDTH_MAX << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--rename") == 0 && i + 1 < argc) {
+            const char* scheme = argv[++i];
+            if (std::strcmp(scheme, "rob") == 0) {
+                config.rename_policy = Rename_Policy::ReorderBuffer;
+            } else if (std::strcmp(scheme, "prf") == 0) {
+                config.rename_policy = Rename_Policy::PhysicalRegisterFile;
+            } else {
+                std::cerr << "Unknown rename scheme: " << scheme << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--mdu") == 0 && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%u,%u", &config.mul_latency, &config.div_latency) != 2 ||
+                config.mul_latency == 0 || config.div_latency == 0) {
+                std::cerr << "Invalid MDU latencies: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    Simulator simulator(config);
+    if (trace_path) simulator.trace(trace_path, trace_begin, trace_end);
+    if (vcd_path) simulator.dump_vcd(vcd_path, vcd_filters, vcd_ring);
+    if (host_profile_period != 0) simulator.profile_host(host_profile_period);
     simulator.run();
     return 0;
-}
\ No newline at end of file
+}
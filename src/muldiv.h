@@ -0,0 +1,59 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+/// The RV32M instructions, shared by the interpreter and the multiply/divide unit, see RS_MDU::MDU.
+namespace muldiv {
+/// Whether the RV32M instruction of type `funct3` is a division or a remainder, the others being multiplications.
+inline bool is_divide(unsigned funct3) {
+    return (funct3 & 0b100) != 0;
+}
+
+/**
+ * The result of the RV32M instruction of type `funct3` on `a` (rs1) and `b` (rs2).
+ * A division by zero gives all ones, and its remainder the dividend; the signed overflow -2^31 / -1 gives -2^31, and
+ * its remainder 0. Neither traps.
+ */
+inline uint32_t compute(unsigned funct3, uint32_t a, uint32_t b) {
+    auto sa = static_cast<int64_t>(static_cast<int32_t>(a));
+    auto sb = static_cast<int64_t>(static_cast<int32_t>(b));
+    bool overflow = a == 0x80000000u && b == 0xffffffffu;
+    switch (funct3) {
+    case 0b000: // MUL
+        return a * b;
+    case 0b001: // MULH
+        return static_cast<uint64_t>(sa * sb) >> 32;
+    case 0b010: // MULHSU
+        return static_cast<uint64_t>(sa * static_cast<int64_t>(b)) >> 32;
+    case 0b011: // MULHU
+        return static_cast<uint64_t>(a) * b >> 32;
+    case 0b100: // DIV
+        if (b == 0) return ~0u;
+        return overflow ? a : static_cast<uint32_t>(sa / sb);
+    case 0b101: // DIVU
+        return b == 0 ? ~0u : a / b;
+    case 0b110: // REM
+        if (b == 0) return a;
+        return overflow ? 0 : static_cast<uint32_t>(sa % sb);
+    default: // REMU
+        return b == 0 ? a : a % b;
+    }
+}
+
+/**
+ * The quotient bits a radix-2 divider has to produce for the division or remainder of type `funct3` on `a` and `b`,
+ * once it has skipped the leading zeros of both: 0 when the quotient is 0, and at most 32.
+ * A division by zero and the signed overflow need none, as their results are fixed.
+ */
+inline unsigned quotient_bits(unsigned funct3, uint32_t a, uint32_t b) {
+    bool is_signed = (funct3 & 0b001) == 0; // DIV and REM
+    if (b == 0 || (is_signed && a == 0x80000000u && b == 0xffffffffu)) return 0;
+    if (is_signed) {
+        if (static_cast<int32_t>(a) < 0) a = 0u - a;
+        if (static_cast<int32_t>(b) < 0) b = 0u - b;
+    }
+    int bits = std::bit_width(a) - std::bit_width(b) + 1;
+    return bits > 0 ? bits : 0;
+}
+} // namespace muldiv
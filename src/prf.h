@@ -0,0 +1,81 @@
+#pragma once
+
+#include "tools.h"
+#include "common.h"
+#include "entry_mask.h"
+
+namespace prf {
+/// A destination renamed by the decoder, see rename_table::Rename_Table.
+struct Rename_Input {
+    Wire<1>            enabled;
+    Wire<PRF_SIZE_LOG> preg;
+    Wire<ROB_SIZE_LOG> rob_id;
+    Wire<1>            value_ready; // the value is known at issue, as for lui, jal and the return address of jalr
+    Wire<32>           value;
+};
+
+struct PRF_Input {
+    std::array<Rename_Input, ISSUE_WIDTH_MAX> from_decoder; // in program order
+    std::array<CDB_Input, CDB_COUNT_MAX>      cdb_input;    // all the CDBs, see Simulator
+};
+
+struct PRF_Output {
+    dark::RegisterArray<32, PRF_SIZE> value;
+    dark::RegisterArray<1, PRF_SIZE>  ready;
+};
+
+/**
+ * The physical register file, which holds the values of the registers in place of the ROB, see Rename_Policy.
+ * A physical register is not ready from when it is renamed until its result is on a CDB, which carries the ROB entry
+ * of the instruction, so the physical register of each ROB entry is kept.
+ * Nothing is done for a flush or a squash, as the physical registers of the instructions dropped are free again, and
+ * the ones of the committed instructions stay as they are.
+ */
+struct PRF final : dark::Module<PRF_Input, PRF_Output> {
+    PRF() {
+        ready_.fill(1); // every register starts as 0
+        dirty_ = ~Entry_Mask<PRF_SIZE>();
+    }
+
+    void work() {
+        for (const auto& port : from_decoder) {
+            if (port.enabled == 0) continue;
+            auto preg = to_unsigned(port.preg);
+            // The result of a jalr on the CDB is its target, not the value of the register
+            preg_of_[to_unsigned(port.rob_id)] = port.value_ready == 1 ? 0 : preg;
+            if (preg == 0) continue;
+            value_[preg] = port.value;
+            ready_[preg] = port.value_ready;
+            dirty_.set(preg);
+        }
+        for (const auto& cdb : cdb_input) update_cdb(cdb);
+
+        // A register keeps its value until assigned, so only the physical registers changed are written
+        dirty_.for_each([&](std::size_t i) {
+            value[i] <= value_[i];
+            ready[i] <= ready_[i];
+        });
+        dirty_.clear();
+    }
+
+    void update_cdb(const CDB_Input& cdb) {
+        if (cdb.rob_id == 0) return;
+        auto preg = preg_of_[to_unsigned(cdb.rob_id)];
+        if (preg == 0) return;
+        value_[preg] = cdb.value;
+        ready_[preg] = 1;
+        dirty_.set(preg);
+    }
+
+    /// for outputing the result after halting the simulator.
+    unsigned get_data(unsigned preg) const {
+        return to_unsigned(value_[preg]);
+    }
+
+private:
+    std::array<Bit<32>, PRF_SIZE>  value_   = {};
+    std::array<Bit<1>, PRF_SIZE>   ready_   = {};
+    std::array<unsigned, ROB_SIZE> preg_of_ = {}; // the physical register of each ROB entry, 0 if none
+    Entry_Mask<PRF_SIZE>           dirty_;        // physical registers not yet written to the outputs
+};
+} // namespace prf
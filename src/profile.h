@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+/**
+ * Per-static-instruction profile, indexed by PC.
+ *
+ * The entries are kept in a flat open-addressed hash table with linear probing,
+ * so that recording a commit costs a multiplication and (usually) one probe.
+ */
+class Profile {
+public:
+    struct Entry {
+        uint32_t           pc = kEmpty;
+        unsigned long long commit_count   = 0;
+        unsigned long long head_cycles    = 0; // cycles spent at the head of the ROB
+        unsigned long long mispredictions = 0;
+        unsigned long long total_latency  = 0; // sum of issue-to-commit latency
+    };
+
+    Profile() : table_(kInitialCapacity) {}
+
+    void record_commit(uint32_t pc, unsigned long long head_cycles, unsigned long long latency) {
+        auto& entry = find(pc);
+        entry.commit_count += 1;
+        entry.head_cycles += head_cycles;
+        entry.total_latency += latency;
+    }
+
+    void record_misprediction(uint32_t pc) {
+        find(pc).mispredictions += 1;
+    }
+
+    /// Prints the `lines` instructions that spent the most cycles at the head of the ROB.
+    void report(unsigned long long cpu_cycle_count, std::size_t lines = kReportLines) const {
+        std::vector<const Entry*> entries;
+        entries.reserve(size_);
+        for (const auto& entry : table_) {
+            if (entry.pc != kEmpty) entries.push_back(&entry);
+        }
+        std::sort(entries.begin(), entries.end(), [](const Entry* lhs, const Entry* rhs) {
+            if (lhs->head_cycles != rhs->head_cycles) return lhs->head_cycles > rhs->head_cycles;
+            return lhs->pc < rhs->pc;
+        });
+        lines = std::min(lines, entries.size());
+
+        fprintf(stderr, "hot spots (%zu of %zu static instructions, sorted by cycles at rob head):\n",
+                lines, entries.size());
+        fprintf(stderr, "  %8s %12s %12s %8s %12s %12s\n",
+                "pc", "commits", "head cycles", "share", "mispredicts", "avg latency");
+        for (std::size_t i = 0; i < lines; ++i) {
+            const auto& entry = *entries[i];
+            fprintf(stderr, "  %08x %12llu %12llu %7.2Lf%% %12llu %12.2Lf\n",
+                    entry.pc, entry.commit_count, entry.head_cycles,
+                    100.0L * entry.head_cycles / cpu_cycle_count, entry.mispredictions,
+                    static_cast<long double>(entry.total_latency) / entry.commit_count);
+        }
+    }
+
+private:
+    static constexpr uint32_t    kEmpty           = ~0u; // PCs are always even, so this is never a valid PC
+    static constexpr std::size_t kInitialCapacity = 1024;
+    static constexpr std::size_t kReportLines     = 20;
+
+    std::vector<Entry> table_; // capacity is always a power of 2
+    std::size_t        size_ = 0;
+
+    std::size_t index_of(uint32_t pc) const {
+        // the multiplier is odd, so consecutive PCs never collide within the table
+        return ((pc >> 1) * 2654435769u) & (table_.size() - 1);
+    }
+
+    Entry& find(uint32_t pc) {
+        for (std::size_t i = index_of(pc);; i = (i + 1) & (table_.size() - 1)) {
+            if (table_[i].pc == pc) return table_[i];
+            if (table_[i].pc == kEmpty) {
+                if ((size_ + 1) * 2 > table_.size()) {
+                    grow();
+                    return find(pc);
+                }
+                size_ += 1;
+                table_[i].pc = pc;
+                return table_[i];
+            }
+        }
+    }
+
+    void grow() {
+        std::vector<Entry> old(table_.size() * 2);
+        old.swap(table_);
+        for (const auto& entry : old) {
+            if (entry.pc == kEmpty) continue;
+            std::size_t i = index_of(entry.pc);
+            while (table_[i].pc != kEmpty) i = (i + 1) & (table_.size() - 1);
+            table_[i] = entry;
+        }
+    }
+};
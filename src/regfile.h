@@ -5,7 +5,7 @@
 #pragma once
 
 #include "tools.h"
-#include "constants.h"
+#include "common.h"
 
 namespace regfile {
 struct ROB_WB_Input {
@@ -21,10 +21,20 @@ struct Decoder_WB_Input {
     Wire<ROB_SIZE_LOG> rob_id;
 };
 
+/// A branch is issued, so the renaming is saved in case the branch is mispredicted, see Recovery_Policy.
+struct Branch_Input {
+    Wire<1>            enabled;
+    Wire<ROB_SIZE_LOG> rob_id;
+};
+
+/// The renaming ports are indexed by the position of the instruction in the group issued by the decoder, and the
+/// write ports by its position in the group committed by the ROB.
 struct RegFile_Input {
-    ROB_WB_Input     from_rob;
-    Decoder_WB_Input from_decoder;
+    std::array<ROB_WB_Input, COMMIT_WIDTH_MAX>    from_rob;
+    std::array<Decoder_WB_Input, ISSUE_WIDTH_MAX> from_decoder;
+    std::array<Branch_Input, ISSUE_WIDTH_MAX>     from_branch;
     Wire<1> flush_input;
+    Squash_Input     squash_input;
 };
 
 /**
@@ -37,20 +47,34 @@ struct RegFile_Output {
 
 struct RegFile final : dark::Module<RegFile_Input, RegFile_Output> {
     void work() {
+        // In program order, so that the youngest write to a register wins. The instructions committed before a
+        // mispredicted branch in the same cycle are written even in a flush.
+        for (auto& port : from_rob) {
+            if (port.enabled == 0) continue;
+            unsigned reg_id = to_unsigned(port.reg_id);
+            data_[reg_id]   = port.data;
+            if (port.rob_id == rob_id_[reg_id]) {
+                rob_id_[reg_id] = 0;
+            }
+        }
         if (flush_input) {
             return flush();
         }
-        if (from_rob.enabled) {
-            unsigned reg_id = to_unsigned(from_rob.reg_id);
-            data_[reg_id]   = from_rob.data;
-            if (from_rob.rob_id == rob_id_[reg_id]) {
-                rob_id_[reg_id] = 0;
+        if (squash_input.enabled) {
+            // The instruction from the decoder comes after the mispredicted branch, so it is dropped too
+            restore(to_unsigned(squash_input.rob_id));
+        } else {
+            // In program order, so that a branch saves the renaming of the instructions before it only
+            for (int i = 0; i < ISSUE_WIDTH_MAX; ++i) {
+                if (from_decoder[i].enabled) {
+                    unsigned reg_id = to_unsigned(from_decoder[i].reg_id);
+                    rob_id_[reg_id] = from_decoder[i].rob_id;
+                }
+                if (from_branch[i].enabled) {
+                    checkpoints_[to_unsigned(from_branch[i].rob_id)] = rob_id_;
+                }
             }
         }
-        if (from_decoder.enabled) {
-            unsigned reg_id = to_unsigned(from_decoder.reg_id);
-            rob_id_[reg_id] = from_decoder.rob_id;
-        }
         rob_id_[0] = 0; // x0 is always 0.
         data_[0]   = 0;
         for (int i = 0; i < 32; ++i) {
@@ -59,13 +83,31 @@ struct RegFile final : dark::Module<RegFile_Input, RegFile_Output> {
         }
     }
 
+    /**
+     * A checkpoint may refer to instructions committed since the branch was issued, whose ROB entries are free or
+     * reused. Those entries lie after the branch in the ROB, as the ones before it are still the instructions
+     * renamed then, except for the ones committed in this cycle. So the checkpoints are left as they are on a commit,
+     * which would take a walk over all of them.
+     */
+    void restore(unsigned branch) {
+        rob_id_ = checkpoints_[branch];
+        for (auto& id : rob_id_) {
+            if (squash_input.squashes(to_unsigned(id))) id = 0;
+        }
+        for (auto& port : from_rob) {
+            if (port.enabled == 0) continue;
+            unsigned reg_id = to_unsigned(port.reg_id);
+            if (port.rob_id == rob_id_[reg_id]) rob_id_[reg_id] = 0;
+        }
+    }
+
     void flush() {
         for (int i = 0; i < 32; ++i) {
             rob_id_[i] = 0;
         }
         for (int i = 0; i < 32; ++i) {
             rob_id[i] <= rob_id_[i];
-            data[i] <= data[i];
+            data[i] <= data_[i];
         }
     }
 
@@ -77,5 +119,7 @@ struct RegFile final : dark::Module<RegFile_Input, RegFile_Output> {
 private:
     std::array<Bit<ROB_SIZE_LOG>, 32> rob_id_ = {}; // Bit is used to enable combinational logic.
     std::array<Bit<32>, 32>           data_   = {};
+
+    std::array<std::array<Bit<ROB_SIZE_LOG>, 32>, ROB_SIZE> checkpoints_ = {}; // rob_id_ indexed by the branch
 };
 } // namespace regfile
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "constants.h"
+#include "tools.h"
+
+namespace rename_table {
+/**
+ * The register alias table of the physical register file, see Rename_Policy.
+ * The RAT maps each register to its latest physical register, and the committed RAT to the one written by the last
+ * committed instruction. x0 is mapped to the physical register 0, which is always 0 and never allocated.
+ *
+ * The free list is a ring, taken from at the head when a register is renamed and given back to at the tail when an
+ * instruction commits and frees the physical register its destination was mapped to before. Between the committed
+ * head and the head lie the physical registers of the instructions in flight, in program order, so that moving the
+ * head back to where it was when a branch was issued frees those of the instructions after it.
+ */
+class Rename_Table {
+public:
+    Rename_Table() {
+        for (unsigned reg = 0; reg < 32; ++reg) committed_[reg] = reg;
+        for (unsigned i = 0; i < RING_SIZE; ++i) ring_[i] = 32 + i;
+        tail_ = RING_SIZE;
+        flush();
+    }
+
+    unsigned map(unsigned reg) const { return rat_[reg]; }
+
+    unsigned committed(unsigned reg) const { return committed_[reg]; }
+
+    unsigned free_count() const { return static_cast<unsigned>(tail_ - head_); }
+
+    /// Renames `reg`, the destination of the instruction in the ROB entry `rob_id`. Returns the physical register.
+    unsigned allocate(unsigned reg, unsigned rob_id) {
+        dark::debug::assert(reg != 0 && free_count() != 0, "Rename_Table: invalid allocation");
+        unsigned preg    = ring_[head_++ % RING_SIZE];
+        rat_[reg]        = preg;
+        preg_of_[rob_id] = preg;
+        return preg;
+    }
+
+    /// The instruction in the ROB entry `rob_id` commits, writing `reg`.
+    void commit(unsigned reg, unsigned rob_id) {
+        if (reg == 0) return;
+        ring_[tail_++ % RING_SIZE] = committed_[reg];
+        committed_[reg]            = preg_of_[rob_id];
+        ++committed_head_;
+    }
+
+    /// The branch in the ROB entry `rob_id` is issued, after the instructions renamed so far.
+    void checkpoint(unsigned rob_id) { checkpoints_[rob_id] = {rat_, head_}; }
+
+    /// The instructions after the branch in the ROB entry `rob_id` are squashed.
+    void restore(unsigned rob_id) {
+        rat_  = checkpoints_[rob_id].rat;
+        head_ = checkpoints_[rob_id].head;
+    }
+
+    /// Every instruction in flight is flushed.
+    void flush() {
+        rat_  = committed_;
+        head_ = committed_head_;
+    }
+
+private:
+    // x1 - x31 are mapped at any time, and the rest are either free or taken by an instruction in flight
+    static constexpr unsigned RING_SIZE = PRF_SIZE - 32;
+    static_assert(PRF_SIZE >= 32 + ROB_SIZE, "Rename_Table: an instruction in flight may lack a physical register");
+
+    struct Checkpoint {
+        std::array<uint16_t, 32> rat{};
+        unsigned long long      head = 0;
+    };
+
+    std::array<uint16_t, 32>          rat_{};
+    std::array<uint16_t, 32>          committed_{};
+    std::array<uint16_t, RING_SIZE>   ring_{};
+    unsigned long long               head_           = 0;
+    unsigned long long               tail_           = 0;
+    unsigned long long               committed_head_ = 0; // the head before the oldest instruction in flight
+    std::array<uint16_t, ROB_SIZE>    preg_of_{};          // the physical register of each ROB entry
+    std::array<Checkpoint, ROB_SIZE> checkpoints_{};      // indexed by the branch
+};
+} // namespace rename_table
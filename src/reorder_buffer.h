@@ -8,19 +8,27 @@
 #include <iostream>
 
 #include "common.h"
+#include "entry_mask.h"
+#include "profile.h"
 #include "stats.h"
 #include "tools.h"
+#include "tracer.h"
 
 namespace rob {
 struct ROB_Entry {
-    Bit<1>  busy;
     Bit<2>  op;          // 00 for jalr, 01 for branch, 10 for others, 11 for special halt instruction
     Bit<1>  value_ready; // 1 for value acquired, 0 otherwise
     Bit<32> value;       // for jalr, the jump address; for branch and others, the value to write to the register
-    Bit<32> alt_value;   // for jalr, pc + 4; for branch, pc of the branch; for others, unused
+    Bit<32> alt_value;   // for jalr, the next pc; for branch, pc of the branch; for others, unused
     Bit<5>  dest;        // the register to store the value
     Bit<1>  branch_taken;
     Bit<1>  pred_branch_taken;
+    Bit<3>  unit;        // 000 alu, 001 bcu, 010 load, 011 store, 100 mdu, used for stall accounting
+    Bit<32> pc;
+    Bit<1>  violated;    // a load that read the memory before an older store it depends on wrote it
+    Bit<32> history;     // the global history of the branch predictor before it, see fetcher::Fetcher
+
+    unsigned long long issue_cycle; // used for profiling
 };
 
 struct Operation_Input {
@@ -28,9 +36,12 @@ struct Operation_Input {
     Wire<2>  op;        // 00 for jalr, 01 for branch, 10 for others, 11 unused
     Wire<1>  status;    // 1 for value acquired, 0 otherwise
     Wire<32> value;     // for jalr, the jump address; for branch and others, the value to write to the register
-    Wire<32> alt_value; // for jalr, pc + 4; for branch, pc of the branch; for others, unused
+    Wire<32> alt_value; // for jalr, the next pc; for branch, pc of the branch; for others, unused
     Wire<5>  dest;      // the register to store the value
     Wire<1>  predicted_branch_taken;
+    Wire<3>  unit;      // 000 alu, 001 bcu, 010 load, 011 store, 100 mdu, used for stall accounting
+    Wire<32> pc;        // pc of the instruction, used for profiling
+    Wire<32> history;   // the global history of the branch predictor before it
 };
 
 struct Input_From_BCU {
@@ -40,10 +51,12 @@ struct Input_From_BCU {
 };
 
 struct ROB_Input {
-    Operation_Input operation_input;
-    CDB_Input       cdb_input_alu;
-    CDB_Input       cdb_input_mem;
+    std::array<Operation_Input, ISSUE_WIDTH_MAX> operation_input; // in program order
+    std::array<CDB_Input, CDB_COUNT_MAX> cdb_input; // all the CDBs, see Simulator
     Input_From_BCU  bcu_input;
+
+    Wire<ROB_SIZE_LOG> store_input;     // from RS_Mem, a store whose address and data are known, 0 if none
+    Wire<ROB_SIZE_LOG> violation_input; // from RS_Mem, the load to fetch again, 0 if none
 };
 
 struct Output_To_RegFile {
@@ -60,91 +73,121 @@ struct Commit_Output {
 struct Output_To_Fetcher {
     Register<1>  pc_enabled;
     Register<32> pc;
+    Register<32> history; // the global history to go on from at pc
 
     Register<32> branch_pc;
     Register<1>  branch_taken;
     Register<1>  branch_record_enabled;
+    Register<32> branch_history; // the global history the branch was predicted with
 };
 
 struct Output_To_Decoder {
-    std::array<Register<32>, ROB_SIZE> value;
-    std::array<Register<1>, ROB_SIZE>  ready;
+    dark::RegisterArray<32, ROB_SIZE> value;
+    dark::RegisterArray<1, ROB_SIZE>  ready;
 };
 
+/// The commit ports are indexed by the position of the instruction in the group committed in a cycle.
 struct ROB_Output {
-    Output_To_RegFile      to_reg_file;
-    Commit_Output          commit_output; // to RS and Decoder
-    Output_To_Fetcher      to_fetcher;
-    Output_To_Decoder      to_decoder;
+    std::array<Output_To_RegFile, COMMIT_WIDTH_MAX> to_reg_file;
+    std::array<Commit_Output, COMMIT_WIDTH_MAX>     commit_output; // to RS_Mem
+    Output_To_Fetcher                               to_fetcher;
+    Output_To_Decoder                               to_decoder;
     Register<32>           vacancy;          // could have been `bool is_full`, but that requires combinational logic
     Register<ROB_SIZE_LOG> next_tail_output; // could have been `new_tail_id`, but that requires combinational logic
     Register<1>            flush_output;     // to all
+    Squash_Output          squash_output;    // to all, see Recovery_Policy
 };
 
+/**
+ * Up to `commit_width` ready instructions are committed from the head in a cycle, each through its own port to the
+ * register file and to RS_Mem. A group ends after a branch, as the fetcher learns of one branch in a cycle, and a halt
+ * is committed on its own, once the registers written before it have reached the register file.
+ *
+ * With Rename_Policy::PhysicalRegisterFile, the results are kept in the PRF instead, and the ROB only keeps the
+ * targets of jalr and branches. Nothing is then written to the decoder but the vacancy and the tail, and the commit
+ * ports carry no data.
+ */
 struct ROB final : dark::Module<ROB_Input, ROB_Output> {
-    explicit ROB(Stats* stats) : stats_(stats) {}
+    ROB(Stats* stats, Profile* profile, Tracer* tracer, Recovery_Policy policy = Recovery_Policy::AtCommit,
+        unsigned commit_width = 1, Rename_Policy rename_policy = Rename_Policy::ReorderBuffer)
+        : stats_(stats), profile_(profile), tracer_(tracer), policy_(policy), commit_width_(commit_width),
+          holds_values_(rename_policy == Rename_Policy::ReorderBuffer) {
+        dark::debug::assert(commit_width >= 1 && commit_width <= COMMIT_WIDTH_MAX, "ROB: invalid commit width");
+    }
 
     void work() {
+        ++cycle_;
+
         static bool is_first_run = true;
         if (is_first_run) {
-            flush(0x0, 0x0, false, false);
+            flush(0x0, 0x0);
+            stats_->record_commit_slot(CommitSlot::RobEmpty, commit_width_);
             is_first_run = false;
             return;
         }
 
-        if (operation_input.enabled) {
-            if (flush_output == 0) { // The input in the cycle after flushing is invalid
-                add_operation(operation_input);
+        squash_      = false;
+        reg_pending_ = reg_written_;
+        reg_written_ = false;
+
+        // The input in the cycle after flushing or squashing is invalid
+        if (flush_output == 0 && squash_output.enabled == 0) {
+            for (const auto& input : operation_input) {
+                if (input.enabled) add_operation(input);
             }
         }
 
         // Update the reservation station with new inputs from the CDB
-        update_cdb(cdb_input_alu);
-        update_cdb(cdb_input_mem);
+        for (const auto& cdb : cdb_input) update_cdb(cdb);
 
         // Update the reservation station with new inputs from the BCU
         update_bcu(bcu_input);
 
-        if (rob[to_unsigned(head)].busy == 1 && rob[to_unsigned(head)].value_ready == 1) {
-            commit();
-        } else {
-            to_reg_file.enabled <= 0;
-            to_reg_file.reg_id <= 0;
-            to_reg_file.data <= 0;
-            to_reg_file.rob_id <= 0;
-
-            commit_output.reg_id <= 0;
+        // A store is done once it can enter the store buffer, see RS_Mem
+        update_store();
 
-            to_fetcher.pc_enabled <= 0;
-            to_fetcher.pc <= 0;
-            to_fetcher.branch_pc <= 0;
-            to_fetcher.branch_taken <= 0;
-            to_fetcher.branch_record_enabled <= 0;
+        // Mark the load that has read stale data
+        update_violation();
 
-            flush_output <= 0;
-
-            write_to_decoder();
+        if (busy_.test(to_unsigned(head)) && rob[to_unsigned(head)].value_ready == 1
+            && rob[to_unsigned(head)].violated == 1) {
+            // The load and everything after it are fetched again
+            stats_->record_commit_slot(CommitSlot::WaitLoad, commit_width_);
+            flush(rob[to_unsigned(head)].pc, rob[to_unsigned(head)].history);
+        } else {
+            commit_group();
         }
-    }
 
-    void flush(Bit<32> new_pc, Bit<32> branch_pc, bool branch_taken, bool write_branch_record) {
-        to_reg_file.enabled <= 0;
-        to_reg_file.reg_id <= 0;
-        to_reg_file.data <= 0;
-        to_reg_file.rob_id <= 0;
+        squash_output.enabled <= squash_;
+        squash_output.rob_id <= (squash_ ? squash_id_ : Bit<ROB_SIZE_LOG>(0));
+        squash_output.head <= (squash_ ? squash_head_ : Bit<ROB_SIZE_LOG>(0));
+    }
 
-        commit_output.reg_id <= 0;
+    /**
+     * Drops every entry and redirects the fetcher to `new_pc`, with the global history `history`. The mispredicted
+     * `branch` causing it, if any, is recorded for the branch predictor. The commit ports before `first_port` are
+     * taken by the instructions committed before it in the same cycle.
+     */
+    void flush(Bit<32> new_pc, Bit<32> history, const ROB_Entry* branch = nullptr, unsigned first_port = 0) {
+        bool write_branch_record = branch != nullptr;
+        disable_ports(first_port);
 
         to_fetcher.pc_enabled <= 1;
         to_fetcher.pc <= new_pc;
-        to_fetcher.branch_pc <= branch_pc;
-        to_fetcher.branch_taken <= branch_taken;
+        to_fetcher.history <= history;
+        to_fetcher.branch_pc <= (branch ? branch->alt_value : Bit<32>(0));
+        to_fetcher.branch_taken <= (branch ? branch->branch_taken : Bit<1>(0));
         to_fetcher.branch_record_enabled <= write_branch_record;
+        to_fetcher.branch_history <= (branch ? branch->history : Bit<32>(0));
 
         flush_output <= 1;
+        squash_ = false; // a flush covers any squash in the same cycle
 
-        for (auto& entry : rob) {
-            entry.busy              = 0;
+        tracer_->squash();
+        // The free entries are written again when allocated, so only the ones in use are cleared
+        dirty_ |= busy_;
+        busy_.for_each([&](std::size_t i) {
+            auto& entry             = rob[i];
             entry.op                = 0;
             entry.value_ready       = 0;
             entry.value             = 0;
@@ -152,17 +195,25 @@ struct ROB final : dark::Module<ROB_Input, ROB_Output> {
             entry.dest              = 0;
             entry.branch_taken      = 0;
             entry.pred_branch_taken = 0;
-        }
+            entry.violated          = 0;
+        });
+        busy_.clear();
         head = 1;
         tail = 0;
 
+        last_commit_cycle_ = cycle_;
+
+        recovering_ = write_branch_record;
+
         write_to_decoder();
     }
 
     void add_operation(const Operation_Input& op_input) {
-        auto& entry = rob[next_tail(to_unsigned(tail))];
-        dark::debug::assert(entry.busy == 0, "ROB: got instruction when buffer is full!");
-        entry.busy              = 1;
+        auto  index = next_tail(to_unsigned(tail));
+        auto& entry = rob[index];
+        dark::debug::assert(!busy_.test(index), "ROB: got instruction when buffer is full!");
+        busy_.set(index);
+        dirty_.set(index);
         entry.op                = op_input.op;
         entry.value_ready       = op_input.status;
         entry.value             = op_input.value;
@@ -170,56 +221,155 @@ struct ROB final : dark::Module<ROB_Input, ROB_Output> {
         entry.dest              = op_input.dest;
         entry.branch_taken      = 0;
         entry.pred_branch_taken = op_input.predicted_branch_taken;
+        entry.unit              = op_input.unit;
+        entry.pc                = op_input.pc;
+        entry.violated          = 0;
+        entry.history           = op_input.history;
+        entry.issue_cycle       = cycle_;
         tail                    = next_tail(to_unsigned(tail));
+        recovering_             = false;
+        if (entry.value_ready == 1) tracer_->writeback(to_unsigned(tail));
     }
 
-    void update_cdb(const CDB_Input& cdb_input) {
-        if (cdb_input.rob_id == 0) return;
-        for (auto& entry : rob) {
-            if (entry.busy == 1 && entry.value_ready == 0) {
-                if (to_unsigned(cdb_input.rob_id) == &entry - &rob[0]) {
-                    entry.value       = cdb_input.value;
-                    entry.value_ready = 1;
-                }
-            }
+    void update_cdb(const CDB_Input& cdb) {
+        if (cdb.rob_id == 0) return;
+        auto  rob_id = to_unsigned(cdb.rob_id);
+        auto& entry  = rob[rob_id];
+        if (busy_.test(rob_id) && entry.value_ready == 0) {
+            if (holds_values_ || entry.op == 0b00) entry.value = cdb.value;
+            entry.value_ready = 1;
+            dirty_.set(rob_id);
+            tracer_->writeback(rob_id);
         }
     }
 
     void update_bcu(const Input_From_BCU& bcu_input) {
         if (bcu_input.rob_id == 0) return;
-        auto& entry = rob[to_unsigned(bcu_input.rob_id)];
-        if (entry.busy == 1 && entry.value_ready == 0 && entry.op == 0b01) {
+        auto  rob_id = to_unsigned(bcu_input.rob_id);
+        auto& entry  = rob[rob_id];
+        if (busy_.test(rob_id) && entry.value_ready == 0 && entry.op == 0b01) {
             // branch operation
-            if (to_unsigned(bcu_input.rob_id) == &entry - &rob[0]) {
-                entry.value        = bcu_input.value;
-                entry.value_ready  = 1;
-                entry.branch_taken = bcu_input.taken;
+            entry.value        = bcu_input.value;
+            entry.value_ready  = 1;
+            entry.branch_taken = bcu_input.taken;
+            dirty_.set(rob_id);
+            tracer_->writeback(rob_id);
+            if (policy_ == Recovery_Policy::AtExecute && entry.branch_taken != entry.pred_branch_taken) {
+                squash_after(rob_id, entry.value);
             }
         }
     }
 
-    void commit() {
+    void update_store() {
+        if (store_input == 0) return;
+        auto  rob_id = to_unsigned(store_input);
+        auto& entry  = rob[rob_id];
+        if (busy_.test(rob_id) && entry.value_ready == 0) {
+            entry.value       = 0;
+            entry.value_ready = 1;
+            dirty_.set(rob_id);
+            tracer_->writeback(rob_id);
+        }
+    }
+
+    void update_violation() {
+        if (violation_input == 0) return;
+        auto rob_id = to_unsigned(violation_input);
+        if (busy_.test(rob_id)) rob[rob_id].violated = 1;
+    }
+
+    /// Drops the entries after the mispredicted branch `rob_id`, and redirects the fetcher to `new_pc`.
+    void squash_after(unsigned rob_id, Bit<32> new_pc) {
+        for (auto i = rob_id; i != to_unsigned(tail);) {
+            i = next_tail(i);
+            busy_.reset(i);
+            dirty_.set(i);
+            rob[i].value_ready = 0;
+            rob[i].value       = 0;
+            tracer_->squash(i);
+        }
+        tail = rob_id;
+
+        squash_         = true;
+        squash_id_      = rob_id;
+        squash_head_    = head;
+        squash_pc_      = new_pc;
+        squash_history_ = taken_history(rob[rob_id]);
+        recovering_     = true;
+    }
+
+    /// Redirects the fetcher if a mispredicted branch has been resolved in this cycle.
+    void write_redirect() {
+        to_fetcher.pc_enabled <= squash_;
+        to_fetcher.pc <= (squash_ ? squash_pc_ : Bit<32>(0));
+        to_fetcher.history <= (squash_ ? squash_history_ : Bit<32>(0));
+    }
+
+    /// Commits the ready entries from the head, up to `commit_width_` of them, and attributes the slots left.
+    void commit_group() {
+        unsigned         count  = 0;
+        const ROB_Entry* branch = nullptr; // the branch ending the group, if any
+        CommitSlot       stop   = CommitSlot::GroupEnd;
+        while (count < commit_width_) {
+            auto        index = to_unsigned(head);
+            const auto& entry = rob[index];
+            if (!busy_.test(index) || entry.value_ready == 0 || entry.violated == 1) {
+                // A violated load after the head is flushed once it becomes the head
+                stop = stall_reason(index);
+                break;
+            }
+            if (entry.op == 0b11) {
+                // The halt reads the register file, which may not have the writes of the last cycle yet
+                if (count != 0 || reg_pending_) break;
+                stats_->record_commit_slot(CommitSlot::Committed);
+                stats_->record_commit_slot(CommitSlot::GroupEnd, commit_width_ - 1);
+                commit(count);
+                return;
+            }
+            stats_->record_commit_slot(CommitSlot::Committed);
+            if (!commit(count++)) {
+                // A mispredicted branch has flushed the ROB
+                stats_->record_commit_slot(CommitSlot::MispredictRecovery, commit_width_ - count);
+                return;
+            }
+            if (entry.op == 0b01) {
+                branch = &entry;
+                break;
+            }
+        }
+        stats_->record_commit_slot(stop, commit_width_ - count);
+        disable_ports(count);
+
+        write_redirect();
+        // The branch ending the group trains the predictor at its own pc, with the history it was predicted with
+        to_fetcher.branch_pc <= (branch != nullptr ? branch->alt_value : Bit<32>(0));
+        to_fetcher.branch_taken <= (branch != nullptr ? branch->branch_taken : Bit<1>(0));
+        to_fetcher.branch_record_enabled <= (branch != nullptr);
+        to_fetcher.branch_history <= (branch != nullptr ? branch->history : Bit<32>(0));
+
+        flush_output <= 0;
+
+        write_to_decoder();
+    }
+
+    /**
+     * Commits the head through the port `slot`. Returns false if it has flushed the ROB or halted, which leaves the
+     * rest of the outputs written.
+     */
+    bool commit(unsigned slot) {
         auto& entry = rob[to_unsigned(head)];
 
+        // The entry became the head either when it was added or right after the previous commit
+        auto head_since = std::max(entry.issue_cycle, last_commit_cycle_ + 1);
+        profile_->record_commit(to_unsigned(entry.pc), cycle_ + 1 - head_since, cycle_ - entry.issue_cycle);
+        last_commit_cycle_ = cycle_;
+        tracer_->commit(to_unsigned(head));
+
         // Handle different operation types
         switch (to_unsigned(entry.op)) {
         case 0b00: {
-            // jalr operation
-            to_fetcher.pc_enabled <= 0;
-            to_fetcher.pc <= 0;
-            to_fetcher.branch_pc <= 0;
-            to_fetcher.branch_taken <= 0;
-            to_fetcher.branch_record_enabled <= 0;
-
-            commit_output.reg_id <= head;
-
-            // Write the return address to the destination register
-            to_reg_file.enabled <= 1;
-            to_reg_file.reg_id <= entry.dest;
-            to_reg_file.data <= entry.alt_value;
-            to_reg_file.rob_id <= head;
-
-            flush_output <= 0;
+            // jalr operation, the return address is written to the destination register
+            write_port(slot, 1, entry.dest, holds_values_ ? entry.alt_value : Bit<32>(0), head);
 
             // std::cerr << std::hex << "ROB: Committed cmd(" << to_unsigned(head) << ") "
             //     << to_unsigned(entry.alt_value) << " -> reg " << to_unsigned(entry.dest) << std::endl;
@@ -232,49 +382,25 @@ struct ROB final : dark::Module<ROB_Input, ROB_Output> {
                                                     to_unsigned(entry.branch_taken));
             if (entry.branch_taken != entry.pred_branch_taken) {
                 // Mis-predicted branch
-                flush(entry.value, entry.alt_value, to_unsigned(entry.branch_taken), true);
+                profile_->record_misprediction(to_unsigned(entry.pc));
+            }
+            if (entry.branch_taken != entry.pred_branch_taken && policy_ == Recovery_Policy::AtCommit) {
+                flush(entry.value, taken_history(entry), &entry, slot);
 
                 // std::cerr << std::hex << "ROB: Committed cmd(" << to_unsigned(head) << ") Branched to "
                 //     << to_unsigned(entry.value) << " (FLUSHED)" << std::endl;
-                return;
-            } else {
-                // Correctly predicted branch
-                to_fetcher.pc_enabled <= 0;
-                to_fetcher.pc <= 0;
-                to_fetcher.branch_pc <= entry.value;
-                to_fetcher.branch_taken <= entry.branch_taken;
-                to_fetcher.branch_record_enabled <= 1;
-
-                commit_output.reg_id <= head;
-
-                to_reg_file.enabled <= 0;
-                to_reg_file.reg_id <= 0;
-                to_reg_file.data <= 0;
-                to_reg_file.rob_id <= 0;
-
-                flush_output <= 0;
-
-                // std::cerr << std::hex << "ROB: Committed cmd(" << to_unsigned(head) << ") Branched to "
-                //     << to_unsigned(entry.value) << std::endl;
+                return false;
             }
+            // Correctly predicted branch, or already recovered from when the BCU resolved it
+            write_port(slot, 0, 0, 0, 0);
+
+            // std::cerr << std::hex << "ROB: Committed cmd(" << to_unsigned(head) << ") Branched to "
+            //     << to_unsigned(entry.value) << std::endl;
             break;
         }
         case 0b10: {
             // other operations
-            to_reg_file.enabled <= 1;
-            to_reg_file.reg_id <= entry.dest;
-            to_reg_file.data <= entry.value;
-            to_reg_file.rob_id <= head;
-
-            commit_output.reg_id <= head;
-
-            to_fetcher.pc_enabled <= 0;
-            to_fetcher.pc <= 0;
-            to_fetcher.branch_pc <= 0;
-            to_fetcher.branch_taken <= 0;
-            to_fetcher.branch_record_enabled <= 0;
-
-            flush_output <= 0;
+            write_port(slot, 1, entry.dest, holds_values_ ? entry.value : Bit<32>(0), head);
 
             // std::cerr << std::hex << "ROB: Committed cmd(" << to_unsigned(head) << ") "
             //     << to_unsigned(entry.value) << " -> reg " << to_unsigned(entry.dest) << std::endl;
@@ -284,44 +410,92 @@ struct ROB final : dark::Module<ROB_Input, ROB_Output> {
         default: {
             // Special halt instruction
             halt_callback();
-            break;
+            return false;
         }
         }
+        commit_output[slot].reg_id <= head;
 
         // Update the head pointer and mark the entry as not busy
-        entry.busy = 0;
-        head       = next_tail(to_unsigned(head));
+        busy_.reset(to_unsigned(head));
+        head = next_tail(to_unsigned(head));
+        return true;
+    }
 
-        write_to_decoder();
+    void write_port(unsigned slot, Bit<1> enabled, Bit<5> reg_id, Bit<32> data, Bit<ROB_SIZE_LOG> rob_id) {
+        to_reg_file[slot].enabled <= enabled;
+        to_reg_file[slot].reg_id <= reg_id;
+        to_reg_file[slot].data <= data;
+        to_reg_file[slot].rob_id <= rob_id;
+        reg_written_ = reg_written_ || (enabled == 1 && reg_id != 0);
     }
 
-    void write_to_decoder() {
-        unsigned vacancy_count = 0;
-        for (const auto& entry : rob) {
-            if (!to_unsigned(entry.busy)) {
-                vacancy_count++;
-            }
+    /// Writes nothing to the register file and RS_Mem through the ports from `from` on.
+    void disable_ports(unsigned from) {
+        for (unsigned slot = from; slot < commit_width_; ++slot) {
+            write_port(slot, 0, 0, 0, 0);
+            commit_output[slot].reg_id <= 0;
+        }
+    }
+
+    /// The global history after the resolved branch `entry`, to go on fetching from its right successor with.
+    static Bit<32> taken_history(const ROB_Entry& entry) {
+        return (to_unsigned(entry.history) << 1) | to_unsigned(entry.branch_taken);
+    }
+
+    /// The reason why the entry `index` cannot be committed.
+    CommitSlot stall_reason(unsigned index) const {
+        if (!busy_.test(index)) return recovering_ ? CommitSlot::MispredictRecovery : CommitSlot::RobEmpty;
+        switch (to_unsigned(rob[index].unit)) {
+        case 0b000: return CommitSlot::WaitALU;
+        case 0b001: return CommitSlot::WaitBranch;
+        case 0b010: return CommitSlot::WaitLoad;
+        case 0b011: return CommitSlot::WaitStore;
+        default: return CommitSlot::WaitMDU;
         }
-        vacancy <= vacancy_count - 1; // account for the unused entry at position 0
+    }
+
+    void write_to_decoder() {
+        vacancy <= ROB_SIZE - 1 - busy_.count(); // account for the unused entry at position 0
 
         next_tail_output <= next_tail(to_unsigned(tail));
 
-        for (unsigned i = 0; i < ROB_SIZE; i++) {
+        // A register keeps its value until assigned, so only the entries changed since the last call are written
+        if (!holds_values_) dirty_.clear();
+        // A jalr writes its return address to the register, its value being the jump target
+        dirty_.for_each([&](std::size_t i) {
             to_decoder.ready[i] <= rob[i].value_ready;
-            to_decoder.value[i] <= rob[i].value;
-        }
+            to_decoder.value[i] <= (rob[i].op == 0b00 ? rob[i].alt_value : rob[i].value);
+        });
+        dirty_.clear();
     }
 
     static unsigned int next_tail(unsigned int tail) {
-        return (tail == ROB_SIZE - 1) ? 1 : tail + 1;
+        return next_rob_id(tail);
     }
 
     std::function<void()> halt_callback;
 
 private:
     std::array<ROB_Entry, ROB_SIZE> rob; // the pos 0 of rob is unused!
+    Entry_Mask<ROB_SIZE>            busy_;
+    Entry_Mask<ROB_SIZE>            dirty_; // entries whose value or readiness is not yet written to the decoder
     Bit<ROB_SIZE_LOG>               head;
     Bit<ROB_SIZE_LOG>               tail;
     Stats*                          stats_;
+    Profile*                        profile_;
+    Tracer*                         tracer_;
+    unsigned long long              cycle_             = 0;
+    unsigned long long              last_commit_cycle_ = 0;
+    bool                            recovering_ = false; // the ROB has been empty since a misprediction recovery
+    Recovery_Policy                 policy_;
+    bool                            squash_ = false; // a mispredicted branch is resolved in this cycle
+    Bit<ROB_SIZE_LOG>               squash_id_;
+    Bit<ROB_SIZE_LOG>               squash_head_;
+    Bit<32>                         squash_pc_;
+    Bit<32>                         squash_history_; // the global history to go on from at squash_pc_
+    unsigned                        commit_width_;
+    bool                            holds_values_; // see Rename_Policy
+    bool                            reg_written_ = false; // a register is written through the commit ports
+    bool                            reg_pending_ = false; // a register was written through them in the last cycle
 };
 } // namespace rob
@@ -3,12 +3,16 @@
 //
 
 #pragma once
+#include <algorithm>
+
 #include "tools.h"
 #include "common.h"
+#include "entry_mask.h"
+#include "stats.h"
+#include "tracer.h"
 
 namespace RS_ALU {
 struct RS_Entry {
-    Bit<1>            busy;
     Bit<4>            op; // the bit 30 of func7, and func3
     Bit<32>           Vj;
     Bit<32>           Vk;
@@ -28,10 +32,10 @@ struct Operation_Input {
 };
 
 struct RS_Input {
-    Operation_Input operation_input;
-    CDB_Input       cdb_input_alu;
-    CDB_Input       cdb_input_mem;
-    Wire<1>         flush_input; // a flush signal is received on the first cycle, serving as RST
+    std::array<Operation_Input, ISSUE_WIDTH_MAX> operation_input; // in program order
+    std::array<CDB_Input, CDB_COUNT_MAX>         cdb_input; // all the CDBs, see Simulator
+    Wire<1>                                      flush_input; // a flush signal is received on the first cycle, serving as RST
+    Squash_Input                                 squash_input;
 };
 
 struct RS_To_ALU {
@@ -42,11 +46,19 @@ struct RS_To_ALU {
 };
 
 struct RS_Output {
-    Register<32> vacancy; // could have been `bool is_full`, but that requires combinational logic
-    RS_To_ALU    to_alu;
+    Register<32>                         vacancy; // could have been `bool is_full`, but that requires combinational logic
+    std::array<RS_To_ALU, ALU_COUNT_MAX> to_alu;  // one per ALU
 };
 
 struct Reservation_Station final : dark::Module<RS_Input, RS_Output> {
+    /**
+     * Issues a ready entry to each of the `alu_count` ALUs in a cycle, as long as there is a CDB for its result:
+     * the ALUs take the CDBs before the memory unit does, so at most `cdb_count` of them are issued to.
+     */
+    explicit Reservation_Station(Stats* stats, Tracer* tracer, Issue_Policy policy = Issue_Policy::ArrayOrder,
+                                 unsigned alu_count = 1, unsigned cdb_count = 2)
+        : stats_(stats), tracer_(tracer), policy_(policy), alu_count_(alu_count), cdb_count_(cdb_count) {}
+
     void work() {
         // Handle flush signal first
         if (flush_input == 1) {
@@ -54,14 +66,17 @@ struct Reservation_Station final : dark::Module<RS_Input, RS_Output> {
             return;
         }
 
-        // Add new operation if one is provided
-        if (operation_input.enabled) {
-            add_operation(operation_input);
+        // Squash the entries after a mispredicted branch; the new operations come after it too
+        if (squash_input.enabled == 1) {
+            squash();
+        } else {
+            for (const auto& input : operation_input) {
+                if (input.enabled) add_operation(input);
+            }
         }
 
         // Update the reservation station with new inputs from the CDB
-        update_cdb(cdb_input_alu);
-        update_cdb(cdb_input_mem);
+        for (const auto& cdb : cdb_input) update_cdb(cdb);
 
         // Issue operations to the ALU
         issue_operation();
@@ -72,47 +87,53 @@ struct Reservation_Station final : dark::Module<RS_Input, RS_Output> {
 
     void add_operation(const Operation_Input& operation_input) {
         // Look for an available slot in the reservation station
-        for (auto& entry : rs) {
-            if (!to_unsigned(entry.busy)) {
-                // Found an empty slot
-                entry.busy = 1;
-                entry.op   = operation_input.op;
-                entry.Vj   = operation_input.Vj;
-                entry.Vk   = operation_input.Vk;
-                entry.Qj   = operation_input.Qj;
-                entry.Qk   = operation_input.Qk;
-                entry.dest = operation_input.dest;
-                return; // Exit loop once we've added the operation
-            }
+        auto index = (~busy_).first();
+        if (index == Entry_Mask<RS_SIZE>::npos) {
+            dark::debug::assert(false, "RS_ALU: Failed to find an empty slot");
+            dark::debug::unreachable();
         }
-        dark::debug::assert(false, "RS_ALU: Failed to find an empty slot");
-        dark::debug::unreachable();
+        auto& entry = rs[index];
+        if (policy_ == Issue_Policy::OldestFirst) age_.insert(index, busy_);
+        busy_.set(index);
+        entry.op   = operation_input.op;
+        entry.Vj   = operation_input.Vj;
+        entry.Vk   = operation_input.Vk;
+        entry.Qj   = operation_input.Qj;
+        entry.Qk   = operation_input.Qk;
+        entry.dest = operation_input.dest;
+        wait_j_.wait(index, to_unsigned(entry.Qj));
+        wait_k_.wait(index, to_unsigned(entry.Qk));
     }
 
-    void update_cdb(const CDB_Input& cdb_input) {
-        if (cdb_input.rob_id == 0) return;
-        // Iterate through each entry in the reservation station
-        for (auto& entry : rs) {
-            // Check if the entry is busy
-            if (to_unsigned(entry.busy)) {
-                // Check if the entry is waiting for the result that is broadcast on the CDB
-                if (entry.Qj == cdb_input.rob_id) {
-                    // Update the entry with the new value
-                    entry.Vj = cdb_input.value;
-                    entry.Qj = 0; // Qj is now available
-                }
-                if (entry.Qk == cdb_input.rob_id) {
-                    // Update the entry with the new value
-                    entry.Vk = cdb_input.value;
-                    entry.Qk = 0; // Qk is now available
-                }
-            }
-        }
+    void update_cdb(const CDB_Input& cdb) {
+        if (cdb.rob_id == 0) return;
+        // Wake up the entries waiting for the result that is broadcast on the CDB
+        auto rob_id = to_unsigned(cdb.rob_id);
+        wait_j_.wake(rob_id).for_each([&](std::size_t i) {
+            rs[i].Vj = cdb.value;
+            rs[i].Qj = 0; // Qj is now available
+        });
+        wait_k_.wake(rob_id).for_each([&](std::size_t i) {
+            rs[i].Vk = cdb.value;
+            rs[i].Qk = 0; // Qk is now available
+        });
+    }
+
+    void squash() {
+        Entry_Mask<RS_SIZE> squashed;
+        busy_.for_each([&](std::size_t i) {
+            if (squash_input.squashes(to_unsigned(rs[i].dest))) squashed.set(i);
+        });
+        busy_.subtract(squashed);
+        wait_j_.remove(squashed);
+        wait_k_.remove(squashed);
     }
 
     void flush() {
+        busy_.clear();
+        wait_j_.clear();
+        wait_k_.clear();
         for (auto& entry : rs) {
-            entry.busy = 0;
             entry.op   = 0;
             entry.Vj   = 0;
             entry.Vk   = 0;
@@ -121,53 +142,57 @@ struct Reservation_Station final : dark::Module<RS_Input, RS_Output> {
             entry.dest = 0;
         }
         vacancy <= RS_SIZE;
-        to_alu.op <= 0;
-        to_alu.Vj <= 0;
-        to_alu.Vk <= 0;
-        to_alu.dest <= 0;
+        for (unsigned i = 0; i < alu_count_; ++i) disable_alu(i);
     }
 
     void issue_operation() {
-        bool found_operation = false;
-
-        // Iterate through each entry in the reservation station
-        for (auto& entry : rs) {
-            // Check if the entry is busy and ready to be issued
-            if (to_unsigned(entry.busy) && to_unsigned(entry.Qj) == 0 && to_unsigned(entry.Qk) == 0) {
-                // Issue the operation to the ALU
-                to_alu.op <= entry.op;
-                to_alu.Vj <= entry.Vj;
-                to_alu.Vk <= entry.Vk;
-                to_alu.dest <= entry.dest;
-                found_operation = true;
-
-                // Mark the entry as no longer busy
-                entry.busy = 0;
-
-                break; // Only one operation can be issued in a cycle
+        // Issue the entries that are busy and have both operands ready, one to each ALU
+        auto ready = busy_;
+        ready.subtract(wait_j_.pending()).subtract(wait_k_.pending());
+        unsigned issued = 0;
+        for (; issued < alu_count_ && ready.any(); ++issued) {
+            if (issued == cdb_count_) {
+                // The ALUs left idle would have no CDB for their results
+                stats_->record_cdb_conflict(std::min<std::size_t>(ready.count(), alu_count_ - issued));
+                break;
             }
+            auto  index = policy_ == Issue_Policy::OldestFirst ? age_.oldest(ready) : ready.first();
+            auto& entry = rs[index];
+            to_alu[issued].op <= entry.op;
+            to_alu[issued].Vj <= entry.Vj;
+            to_alu[issued].Vk <= entry.Vk;
+            to_alu[issued].dest <= entry.dest;
+            tracer_->dispatch(to_unsigned(entry.dest));
+
+            // Mark the entry as no longer busy
+            busy_.reset(index);
+            ready.reset(index);
         }
-        if (!found_operation) {
-            to_alu.op <= 0;
-            to_alu.Vj <= 0;
-            to_alu.Vk <= 0;
-            to_alu.dest <= 0;
-        }
+        for (unsigned i = issued; i < alu_count_; ++i) disable_alu(i);
+    }
+
+    void disable_alu(unsigned alu) {
+        to_alu[alu].op <= 0;
+        to_alu[alu].Vj <= 0;
+        to_alu[alu].Vk <= 0;
+        to_alu[alu].dest <= 0;
     }
 
     void write_vacancy() {
-        // Count the number of vacant entries in the reservation station
-        unsigned vacancy_count = 0;
-        for (const auto& entry : rs) {
-            if (!to_unsigned(entry.busy)) {
-                vacancy_count++;
-            }
-        }
-        vacancy <= vacancy_count;
+        vacancy <= RS_SIZE - busy_.count();
     }
 
 private:
     std::array<RS_Entry, RS_SIZE> rs;
+    Entry_Mask<RS_SIZE>           busy_;
+    Tag_Wait<RS_SIZE>             wait_j_; // entries waiting for Vj
+    Tag_Wait<RS_SIZE>             wait_k_; // entries waiting for Vk
+    Age_Matrix<RS_SIZE>           age_;    // only maintained for Issue_Policy::OldestFirst
+    Stats*                        stats_;
+    Tracer*                       tracer_;
+    Issue_Policy                  policy_;
+    unsigned                      alu_count_;
+    unsigned                      cdb_count_;
 };
 
 struct ALU_Input {
@@ -188,6 +213,8 @@ struct ALU_Output {
 };
 
 struct ALU final : dark::Module<ALU_Input, ALU_Output> {
+    explicit ALU(Tracer* tracer) : tracer_(tracer) {}
+
     void work() {
         if (dest == 0) {
             cdb_output.rob_id <= 0;
@@ -230,6 +257,10 @@ struct ALU final : dark::Module<ALU_Input, ALU_Output> {
             dark::debug::unreachable();
         }
         cdb_output.rob_id <= dest;
+        tracer_->execute(to_unsigned(dest));
     }
+
+private:
+    Tracer* tracer_;
 };
 } // namespace RS_ALU
@@ -5,10 +5,11 @@
 #pragma once
 #include "tools.h"
 #include "common.h"
+#include "entry_mask.h"
+#include "tracer.h"
 
 namespace RS_BCU {
 struct RS_Entry {
-    Bit<1>            busy;
     Bit<3>            op; // func3
     Bit<32>           Vj;
     Bit<32>           Vk;
@@ -32,10 +33,10 @@ struct Operation_Input {
 };
 
 struct RS_Input {
-    Operation_Input operation_input;
-    CDB_Input       cdb_input_alu;
-    CDB_Input       cdb_input_mem;
-    Wire<1>         flush_input; // a flush signal is received on the first cycle, serving as RST
+    std::array<Operation_Input, ISSUE_WIDTH_MAX> operation_input; // in program order
+    std::array<CDB_Input, CDB_COUNT_MAX>         cdb_input; // all the CDBs, see Simulator
+    Wire<1>                                      flush_input; // a flush signal is received on the first cycle, serving as RST
+    Squash_Input                                 squash_input;
 };
 
 struct RS_To_BCU {
@@ -53,6 +54,9 @@ struct RS_Output {
 };
 
 struct Reservation_Station final : dark::Module<RS_Input, RS_Output> {
+    explicit Reservation_Station(Tracer* tracer, Issue_Policy policy = Issue_Policy::ArrayOrder)
+        : tracer_(tracer), policy_(policy) {}
+
     void work() {
         // Handle flush signal first
         if (flush_input == 1) {
@@ -60,14 +64,17 @@ struct Reservation_Station final : dark::Module<RS_Input, RS_Output> {
             return;
         }
 
-        // Add new operation if one is provided
-        if (operation_input.enabled) {
-            add_operation(operation_input);
+        // Squash the entries after a mispredicted branch; the new operations come after it too
+        if (squash_input.enabled == 1) {
+            squash();
+        } else {
+            for (const auto& input : operation_input) {
+                if (input.enabled) add_operation(input);
+            }
         }
 
         // Update the reservation station with new inputs from the CDB
-        update_cdb(cdb_input_alu);
-        update_cdb(cdb_input_mem);
+        for (const auto& cdb : cdb_input) update_cdb(cdb);
 
         // Issue operations to the BCU
         issue_operation();
@@ -78,49 +85,55 @@ struct Reservation_Station final : dark::Module<RS_Input, RS_Output> {
 
     void add_operation(const Operation_Input& operation_input) {
         // Look for an available slot in the reservation station
-        for (auto& entry : rs) {
-            if (!to_unsigned(entry.busy)) {
-                // Found an empty slot
-                entry.busy           = 1;
-                entry.op             = operation_input.op;
-                entry.Vj             = operation_input.Vj;
-                entry.Vk             = operation_input.Vk;
-                entry.Qj             = operation_input.Qj;
-                entry.Qk             = operation_input.Qk;
-                entry.dest           = operation_input.dest;
-                entry.pc_fallthrough = operation_input.pc_fallthrough;
-                entry.pc_target      = operation_input.pc_target;
-                return; // Exit loop once we've added the operation
-            }
+        auto index = (~busy_).first();
+        if (index == Entry_Mask<RS_SIZE>::npos) {
+            dark::debug::assert(false, "RS_BCU: Failed to find an empty slot");
+            dark::debug::unreachable();
         }
-        dark::debug::assert(false, "RS_BCU: Failed to find an empty slot");
-        dark::debug::unreachable();
+        auto& entry = rs[index];
+        if (policy_ == Issue_Policy::OldestFirst) age_.insert(index, busy_);
+        busy_.set(index);
+        entry.op             = operation_input.op;
+        entry.Vj             = operation_input.Vj;
+        entry.Vk             = operation_input.Vk;
+        entry.Qj             = operation_input.Qj;
+        entry.Qk             = operation_input.Qk;
+        entry.dest           = operation_input.dest;
+        entry.pc_fallthrough = operation_input.pc_fallthrough;
+        entry.pc_target      = operation_input.pc_target;
+        wait_j_.wait(index, to_unsigned(entry.Qj));
+        wait_k_.wait(index, to_unsigned(entry.Qk));
     }
 
-    void update_cdb(const CDB_Input& cdb_input) {
-        if (cdb_input.rob_id == 0) return;
-        // Iterate through each entry in the reservation station
-        for (auto& entry : rs) {
-            // Check if the entry is busy
-            if (to_unsigned(entry.busy)) {
-                // Check if the entry is waiting for the result that is broadcast on the CDB
-                if (entry.Qj == cdb_input.rob_id) {
-                    // Update the entry with the new value
-                    entry.Vj = cdb_input.value;
-                    entry.Qj = 0; // Qj is now available
-                }
-                if (entry.Qk == cdb_input.rob_id) {
-                    // Update the entry with the new value
-                    entry.Vk = cdb_input.value;
-                    entry.Qk = 0; // Qk is now available
-                }
-            }
-        }
+    void update_cdb(const CDB_Input& cdb) {
+        if (cdb.rob_id == 0) return;
+        // Wake up the entries waiting for the result that is broadcast on the CDB
+        auto rob_id = to_unsigned(cdb.rob_id);
+        wait_j_.wake(rob_id).for_each([&](std::size_t i) {
+            rs[i].Vj = cdb.value;
+            rs[i].Qj = 0; // Qj is now available
+        });
+        wait_k_.wake(rob_id).for_each([&](std::size_t i) {
+            rs[i].Vk = cdb.value;
+            rs[i].Qk = 0; // Qk is now available
+        });
+    }
+
+    void squash() {
+        Entry_Mask<RS_SIZE> squashed;
+        busy_.for_each([&](std::size_t i) {
+            if (squash_input.squashes(to_unsigned(rs[i].dest))) squashed.set(i);
+        });
+        busy_.subtract(squashed);
+        wait_j_.remove(squashed);
+        wait_k_.remove(squashed);
     }
 
     void flush() {
+        busy_.clear();
+        wait_j_.clear();
+        wait_k_.clear();
         for (auto& entry : rs) {
-            entry.busy           = 0;
             entry.op             = 0;
             entry.Vj             = 0;
             entry.Vk             = 0;
@@ -140,28 +153,23 @@ struct Reservation_Station final : dark::Module<RS_Input, RS_Output> {
     }
 
     void issue_operation() {
-        bool found_operation = false;
+        // Issue an entry that is busy and has both operands ready
+        auto ready = busy_;
+        ready.subtract(wait_j_.pending()).subtract(wait_k_.pending());
+        auto index = policy_ == Issue_Policy::OldestFirst ? age_.oldest(ready) : ready.first();
+        if (index != Entry_Mask<RS_SIZE>::npos) {
+            auto& entry = rs[index];
+            to_bcu.op <= entry.op;
+            to_bcu.Vj <= entry.Vj;
+            to_bcu.Vk <= entry.Vk;
+            to_bcu.dest <= entry.dest;
+            to_bcu.pc_fallthrough <= entry.pc_fallthrough;
+            to_bcu.pc_target <= entry.pc_target;
+            tracer_->dispatch(to_unsigned(entry.dest));
 
-        // Iterate through each entry in the reservation station
-        for (auto& entry : rs) {
-            // Check if the entry is busy and ready to be issued
-            if (to_unsigned(entry.busy) && to_unsigned(entry.Qj) == 0 && to_unsigned(entry.Qk) == 0) {
-                // Issue the operation to the BCU
-                to_bcu.op <= entry.op;
-                to_bcu.Vj <= entry.Vj;
-                to_bcu.Vk <= entry.Vk;
-                to_bcu.dest <= entry.dest;
-                to_bcu.pc_fallthrough <= entry.pc_fallthrough;
-                to_bcu.pc_target <= entry.pc_target;
-                found_operation = true;
-
-                // Mark the entry as no longer busy
-                entry.busy = 0;
-
-                break; // Only one operation can be issued in a cycle
-            }
-        }
-        if (!found_operation) {
+            // Mark the entry as no longer busy
+            busy_.reset(index);
+        } else {
             to_bcu.op <= 0;
             to_bcu.Vj <= 0;
             to_bcu.Vk <= 0;
@@ -172,18 +180,17 @@ struct Reservation_Station final : dark::Module<RS_Input, RS_Output> {
     }
 
     void write_vacancy() {
-        // Count the number of vacant entries in the reservation station
-        unsigned vacancy_count = 0;
-        for (const auto& entry : rs) {
-            if (!to_unsigned(entry.busy)) {
-                vacancy_count++;
-            }
-        }
-        vacancy <= vacancy_count;
+        vacancy <= RS_SIZE - busy_.count();
     }
 
 private:
     std::array<RS_Entry, RS_SIZE> rs;
+    Entry_Mask<RS_SIZE>           busy_;
+    Tag_Wait<RS_SIZE>             wait_j_; // entries waiting for Vj
+    Tag_Wait<RS_SIZE>             wait_k_; // entries waiting for Vk
+    Age_Matrix<RS_SIZE>           age_;    // only maintained for Issue_Policy::OldestFirst
+    Tracer*                       tracer_;
+    Issue_Policy                  policy_;
 };
 
 struct BCU_Input {
@@ -205,6 +212,8 @@ struct BCU_Output {
 };
 
 struct BCU final : dark::Module<BCU_Input, BCU_Output> {
+    explicit BCU(Tracer* tracer) : tracer_(tracer) {}
+
     void work() {
         if (dest == 0) {
             rob_id <= 0;
@@ -241,6 +250,10 @@ struct BCU final : dark::Module<BCU_Input, BCU_Output> {
         taken <= take_branch;
         value <= (take_branch ? pc_target : pc_fallthrough);
         rob_id <= dest;
+        tracer_->execute(to_unsigned(dest));
     }
+
+private:
+    Tracer* tracer_;
 };
 } // namespace RS_BCU
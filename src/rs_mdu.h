@@ -0,0 +1,340 @@
+#pragma once
+
+#include "tools.h"
+#include "common.h"
+#include "entry_mask.h"
+#include "muldiv.h"
+#include "stats.h"
+#include "tracer.h"
+
+namespace RS_MDU {
+struct RS_Entry {
+    Bit<3>            op; // func3
+    Bit<32>           Vj;
+    Bit<32>           Vk;
+    Bit<ROB_SIZE_LOG> Qj;
+    Bit<ROB_SIZE_LOG> Qk;
+    Bit<ROB_SIZE_LOG> dest;
+};
+
+struct Operation_Input {
+    Wire<1>            enabled;
+    Wire<3>            op; // func3
+    Wire<32>           Vj;
+    Wire<32>           Vk;
+    Wire<ROB_SIZE_LOG> Qj;
+    Wire<ROB_SIZE_LOG> Qk;
+    Wire<ROB_SIZE_LOG> dest;
+};
+
+struct RS_Input {
+    std::array<Operation_Input, ISSUE_WIDTH_MAX> operation_input; // in program order
+    std::array<CDB_Input, CDB_COUNT_MAX>         cdb_input; // all the CDBs, see Simulator
+    Wire<1>      mdu_ready; // From MDU, whether it takes an operation sent in this cycle, see MDU
+    Wire<1>      div_ready; // From MDU, whether it takes a division or a remainder sent in this cycle
+    Wire<1>      flush_input; // a flush signal is received on the first cycle, serving as RST
+    Squash_Input squash_input;
+};
+
+struct RS_To_MDU {
+    Register<3>            op;
+    Register<32>           Vj;
+    Register<32>           Vk;
+    Register<ROB_SIZE_LOG> dest; // 0 means disabled
+};
+
+struct RS_Output {
+    Register<32> vacancy; // could have been `bool is_full`, but that requires combinational logic
+    RS_To_MDU    to_mdu;
+};
+
+struct Reservation_Station final : dark::Module<RS_Input, RS_Output> {
+    /**
+     * Issues the oldest ready entry to the MDU in each cycle it is ready. A division or a remainder is only issued
+     * when the divider takes it, so that a multiplication may pass a division waiting for the divider.
+     * The entries are always issued oldest first: the divider takes one operation at a time, and a younger division
+     * taking it would hold back the older ones the commit waits for.
+     */
+    explicit Reservation_Station(Tracer* tracer) : tracer_(tracer) {}
+
+    void work() {
+        // Handle flush signal first
+        if (flush_input == 1) {
+            flush();
+            return;
+        }
+
+        // Squash the entries after a mispredicted branch; the new operations come after it too
+        if (squash_input.enabled == 1) {
+            squash();
+        } else {
+            for (const auto& input : operation_input) {
+                if (input.enabled) add_operation(input);
+            }
+        }
+
+        // Update the reservation station with new inputs from the CDB
+        for (const auto& cdb : cdb_input) update_cdb(cdb);
+
+        // Issue an operation to the MDU
+        issue_operation();
+
+        // Update the vacancy count
+        write_vacancy();
+    }
+
+    void add_operation(const Operation_Input& operation_input) {
+        // Look for an available slot in the reservation station
+        auto index = (~busy_).first();
+        if (index == Entry_Mask<RS_SIZE>::npos) {
+            dark::debug::assert(false, "RS_MDU: Failed to find an empty slot");
+            dark::debug::unreachable();
+        }
+        auto& entry = rs[index];
+        age_.insert(index, busy_);
+        busy_.set(index);
+        entry.op   = operation_input.op;
+        entry.Vj   = operation_input.Vj;
+        entry.Vk   = operation_input.Vk;
+        entry.Qj   = operation_input.Qj;
+        entry.Qk   = operation_input.Qk;
+        entry.dest = operation_input.dest;
+        wait_j_.wait(index, to_unsigned(entry.Qj));
+        wait_k_.wait(index, to_unsigned(entry.Qk));
+    }
+
+    void update_cdb(const CDB_Input& cdb) {
+        if (cdb.rob_id == 0) return;
+        // Wake up the entries waiting for the result that is broadcast on the CDB
+        auto rob_id = to_unsigned(cdb.rob_id);
+        wait_j_.wake(rob_id).for_each([&](std::size_t i) {
+            rs[i].Vj = cdb.value;
+            rs[i].Qj = 0;
+        });
+        wait_k_.wake(rob_id).for_each([&](std::size_t i) {
+            rs[i].Vk = cdb.value;
+            rs[i].Qk = 0;
+        });
+    }
+
+    void squash() {
+        Entry_Mask<RS_SIZE> squashed;
+        busy_.for_each([&](std::size_t i) {
+            if (squash_input.squashes(to_unsigned(rs[i].dest))) squashed.set(i);
+        });
+        busy_.subtract(squashed);
+        wait_j_.remove(squashed);
+        wait_k_.remove(squashed);
+    }
+
+    void flush() {
+        busy_.clear();
+        wait_j_.clear();
+        wait_k_.clear();
+        for (auto& entry : rs) {
+            entry.op   = 0;
+            entry.Vj   = 0;
+            entry.Vk   = 0;
+            entry.Qj   = 0;
+            entry.Qk   = 0;
+            entry.dest = 0;
+        }
+        vacancy <= RS_SIZE;
+        disable_mdu();
+    }
+
+    void issue_operation() {
+        // The entries that are busy and have both operands ready, leaving out the divisions the divider does not take
+        auto ready = busy_;
+        ready.subtract(wait_j_.pending()).subtract(wait_k_.pending());
+        if (div_ready == 0) {
+            Entry_Mask<RS_SIZE> divisions;
+            ready.for_each([&](std::size_t i) {
+                if (muldiv::is_divide(to_unsigned(rs[i].op))) divisions.set(i);
+            });
+            ready.subtract(divisions);
+        }
+        if (mdu_ready == 0 || !ready.any()) {
+            disable_mdu();
+            return;
+        }
+        auto  index = age_.oldest(ready);
+        auto& entry = rs[index];
+        to_mdu.op <= entry.op;
+        to_mdu.Vj <= entry.Vj;
+        to_mdu.Vk <= entry.Vk;
+        to_mdu.dest <= entry.dest;
+        tracer_->dispatch(to_unsigned(entry.dest));
+        busy_.reset(index);
+    }
+
+    void disable_mdu() {
+        to_mdu.op <= 0;
+        to_mdu.Vj <= 0;
+        to_mdu.Vk <= 0;
+        to_mdu.dest <= 0;
+    }
+
+    void write_vacancy() {
+        vacancy <= RS_SIZE - busy_.count();
+    }
+
+private:
+    std::array<RS_Entry, RS_SIZE> rs;
+    Entry_Mask<RS_SIZE>           busy_;
+    Tag_Wait<RS_SIZE>             wait_j_; // entries waiting for Vj
+    Tag_Wait<RS_SIZE>             wait_k_; // entries waiting for Vk
+    Age_Matrix<RS_SIZE>           age_;
+    Tracer*                       tracer_;
+};
+
+struct MDU_Input {
+    Wire<3>            op; // func3
+    Wire<32>           rs1;
+    Wire<32>           rs2;
+    Wire<ROB_SIZE_LOG> dest;
+    Wire<32>           cdb_taken; // the CDBs taken by the results the ALUs send along with this unit's
+    Wire<1>            flush_input; // a flush signal is received on the first cycle, serving as RST
+    Squash_Input       squash_input;
+};
+
+struct MDU_Output {
+    CDB_Output             cdb_output;
+    Register<1>            ready;       // whether an operation sent in the next cycle is taken
+    Register<1>            div_ready;   // whether a division or a remainder sent in the next cycle is taken
+    Register<ROB_SIZE_LOG> cdb_request; // the result to be sent in the next cycle, if a CDB is free, 0 if none
+};
+
+/// An operation in flight in the MDU.
+struct In_Flight_Operation {
+    Bit<ROB_SIZE_LOG>  rob_id;
+    Bit<32>            value;
+    unsigned long long done; // the cycle the result is sent in, or later if the CDB is taken
+    unsigned long long seq;  // the order the operations are taken in
+};
+
+struct MDU final : dark::Module<MDU_Input, MDU_Output> {
+    /**
+     * The multiply/divide unit. The multiplier is pipelined: it takes an operation in every cycle, and each takes
+     * `mul_latency` cycles. The divider is iterative: it takes one division or remainder at a time, and skips the
+     * leading zeros of the operands, so one takes `div_latency` cycles for a full 32-bit quotient and proportionally
+     * fewer for a shorter one, at least 1, see muldiv::quotient_bits.
+     * The results are sent on the CDB once done, one per cycle, the one done first first, so a multiplication may
+     * overtake an older division. Since the latency varies, the result to be sent in the next cycle is announced in
+     * `cdb_request`, from which the memory unit learns whether this unit takes a CDB, see sends(): the ALUs take the
+     * CDBs first, then this unit, then the memory unit, and a result waits while all `cdb_count` of them are taken.
+     * Being ready promises to take whatever arrives, as in the memory unit.
+     */
+    MDU(Stats* stats, Tracer* tracer, unsigned mul_latency = 3, unsigned div_latency = 32, unsigned cdb_count = 2)
+        : stats(stats), tracer(tracer), mul_latency(mul_latency), div_latency(div_latency), cdb_count(cdb_count) {}
+
+    void work() {
+        ++cycle;
+        if (flush_input == 1) {
+            flush();
+            return;
+        }
+        bool send = sends();
+        if (cdb_request != 0 && !send && !squash_input.squashes(to_unsigned(cdb_request))) {
+            stats->record_cdb_conflict();
+        }
+
+        // A squashed operation is dropped, whether in flight or arriving, and frees the divider if it holds it
+        busy.for_each([&](std::size_t i) {
+            if (squash_input.squashes(to_unsigned(operations[i].rob_id))) busy.reset(i);
+        });
+        if (divider_free > cycle && squash_input.squashes(to_unsigned(divider_rob_id))) divider_free = cycle;
+        if (dest != 0 && !squash_input.squashes(to_unsigned(dest))) execute_operation();
+
+        output_result(send);
+        write_ready();
+    }
+
+    /// Whether the result in `cdb_request` is sent in this cycle, which the memory unit counts in its `cdb_taken`.
+    bool sends() {
+        return cdb_request != 0 && flush_input == 0 && !squash_input.squashes(to_unsigned(cdb_request)) &&
+               to_unsigned(cdb_taken) < cdb_count;
+    }
+
+private:
+    Stats*                                   stats;
+    Tracer*                                  tracer;
+    unsigned                                 mul_latency;
+    unsigned                                 div_latency;
+    unsigned                                 cdb_count;
+    std::array<In_Flight_Operation, RS_SIZE> operations;
+    Entry_Mask<RS_SIZE>                      busy;
+    std::size_t                              request = Entry_Mask<RS_SIZE>::npos; // the slot of `cdb_request`
+    unsigned long long                       cycle          = 0;
+    unsigned long long                       seq            = 0;
+    unsigned long long                       divider_free   = 0; // the cycle the divider takes a new operation from
+    Bit<ROB_SIZE_LOG>                        divider_rob_id;     // the operation in the divider
+    bool                                     promised       = false; // whether `ready` was set in the last cycle
+    bool                                     div_promised   = false; // whether `div_ready` was set in the last cycle
+
+    void flush() {
+        busy.clear();
+        divider_free = cycle;
+        cdb_output.rob_id <= 0;
+        cdb_output.value <= 0;
+        cdb_request <= 0;
+        write_ready();
+    }
+
+    void execute_operation() {
+        tracer->execute(to_unsigned(dest));
+        unsigned op    = to_unsigned(this->op);
+        unsigned a     = to_unsigned(rs1);
+        unsigned b     = to_unsigned(rs2);
+        auto     index = (~busy).first();
+        auto&    entry = operations[index];
+        busy.set(index);
+        entry.rob_id = dest;
+        entry.value  = muldiv::compute(op, a, b);
+        entry.seq    = seq++;
+        if (muldiv::is_divide(op)) {
+            unsigned steps = (div_latency * muldiv::quotient_bits(op, a, b) + 31) / 32;
+            entry.done     = cycle + std::max(steps, 1u);
+            divider_free   = entry.done;
+            divider_rob_id = dest;
+        } else {
+            entry.done = cycle + mul_latency;
+        }
+    }
+
+    /// Sends the result announced in the last cycle if `send` is set, and announces the one done first by the next
+    /// cycle, the oldest one among those done in the same cycle.
+    void output_result(bool send) {
+        if (send) {
+            busy.reset(request);
+            cdb_output.rob_id <= operations[request].rob_id;
+            cdb_output.value <= operations[request].value;
+        } else {
+            cdb_output.rob_id <= 0;
+            cdb_output.value <= 0;
+        }
+
+        request = Entry_Mask<RS_SIZE>::npos;
+        busy.for_each([&](std::size_t i) {
+            if (operations[i].done > cycle + 1) return;
+            if (request == Entry_Mask<RS_SIZE>::npos || operations[i].done < operations[request].done ||
+                (operations[i].done == operations[request].done && operations[i].seq < operations[request].seq)) {
+                request = i;
+            }
+        });
+        cdb_request <= (request == Entry_Mask<RS_SIZE>::npos ? Bit<ROB_SIZE_LOG>{0} : operations[request].rob_id);
+    }
+
+    /**
+     * An operation sent in the next cycle arrives in the one after, so it needs a free slot, besides the one that may
+     * already be on its way. A division also needs the divider to be free by then, and none on its way.
+     */
+    void write_ready() {
+        unsigned needed = promised ? 2 : 1;
+        promised        = RS_SIZE - busy.count() >= needed;
+        div_promised    = promised && !div_promised && divider_free <= cycle + 2;
+        ready <= promised;
+        div_ready <= div_promised;
+    }
+};
+} // namespace RS_MDU
@@ -4,40 +4,94 @@
 
 #pragma once
 #include "tools.h"
+#include "cache.h"
 #include "common.h"
+#include "entry_mask.h"
+#include "stats.h"
+#include "store_set.h"
+#include "tracer.h"
 
 namespace RS_Mem {
 struct RS_Load_Entry {
-    Bit<1>            busy;
     Bit<3>            op; // func3
     Bit<32>           Vj; // rs1, position
     Bit<ROB_SIZE_LOG> Qj;
-    Bit<ROB_SIZE_LOG> Ql; // last store operation
     Bit<ROB_SIZE_LOG> dest;
     Bit<12>           offset;
+    Bit<32>           pc;
+
+    unsigned long long seq;       // the position of the load in program order among the loads
+    unsigned long long store_seq; // the stores with a smaller sequence number are older than the load
+    bool               predicted; // whether the load is predicted to depend on the store dep_seq
+    unsigned long long dep_seq;
+    bool               held;      // whether the load has waited for the address of the store dep_seq
 };
 
 struct RS_Store_Entry {
-    Bit<1>            busy;
     Bit<3>            op; // func3
     Bit<32>           Vj; // rs1, position
     Bit<32>           Vk; // rs2, value
     Bit<ROB_SIZE_LOG> Qj;
     Bit<ROB_SIZE_LOG> Qk;
-    Bit<ROB_SIZE_LOG> Ql; // last store operation
-    Bit<ROB_SIZE_LOG> Qm; // last branch operation
-    Bit<ROB_SIZE_LOG> dest;
+    Bit<ROB_SIZE_LOG> dest; // stale once the store is committed, as the ROB may reuse it
     Bit<12>           offset;
+    Bit<32>           pc;
+
+    unsigned long long seq;       // the position of the store in program order among the stores
+    unsigned           store_set; // in the store set predictor
+};
+
+/// A load sent to the memory while the addresses of some older stores were unknown.
+struct Load_Queue_Entry {
+    Bit<32>           pc;
+    Bit<ROB_SIZE_LOG> dest;
+    unsigned          address;
+    unsigned          width;
+
+    unsigned long long seq;         // as in RS_Load_Entry
+    unsigned long long store_seq;   // as in RS_Load_Entry
+    bool               forwarded;   // whether the value is taken from the store forward_seq
+    unsigned long long forward_seq;
+};
+
+/// The committed stores to a word of the memory, not yet written to it.
+struct Store_Buffer_Entry {
+    unsigned address; // word aligned
+    unsigned data;
+    unsigned mask;    // the bytes written, bit i for the byte at address + i
 };
 
+/// The number of bytes accessed by a load or store of type `op` (func3).
+inline unsigned access_width(unsigned op) {
+    return 1u << (op & 0b11);
+}
+
+/// Whether the accesses of `width_a` bytes at `a` and of `width_b` bytes at `b` share a byte.
+inline bool overlaps(unsigned a, unsigned width_a, unsigned b, unsigned width_b) {
+    return a < b + width_b && b < a + width_a;
+}
+
+/// The value a load of type `op` (func3) gets from `raw`, the bytes at its address in the low bits.
+inline Bit<32> load_value(unsigned op, max_size_t raw) {
+    switch (op) {
+    case 0b000: return sign_extend<8, 32>(raw);  // LB
+    case 0b001: return sign_extend<16, 32>(raw); // LH
+    case 0b010: return raw;                      // LW
+    case 0b100: return zero_extend<8, 32>(raw);  // LBU
+    case 0b101: return zero_extend<16, 32>(raw); // LHU
+    default: dark::debug::unreachable();
+    }
+    return 0;
+}
+
 struct Load_Operation_Input {
     Wire<1>            enabled;
     Wire<3>            op; // func3
     Wire<32>           Vj; // rs1, position
     Wire<ROB_SIZE_LOG> Qj;
-    // Wire<ROB_SIZE_LOG> Ql; // calculated in RS
     Wire<ROB_SIZE_LOG> dest;
     Wire<12>           offset;
+    Wire<32>           pc;
 };
 
 struct Store_Operation_Input {
@@ -47,74 +101,105 @@ struct Store_Operation_Input {
     Wire<32>           Vk; // rs2, value
     Wire<ROB_SIZE_LOG> Qj;
     Wire<ROB_SIZE_LOG> Qk;
-    // Wire<ROB_SIZE_LOG> Ql; // calculated in RS
-    Wire<ROB_SIZE_LOG> Qm;
     Wire<ROB_SIZE_LOG> dest;
     Wire<12>           offset;
+    Wire<32>           pc;
 };
 
 struct RS_Input {
-    Load_Operation_Input  load_input; // At most one of the 2 inputs can be enabled
-    Store_Operation_Input store_input;
-    CDB_Input             cdb_input_alu;
-    CDB_Input             cdb_input_mem;
-    Commit_Info           rob_commit; // From ROB, used to update Qm
-    Wire<1>               recv;
-    // From memory, whether the instruction is received. The RS keeps sending the same instruction until it is received
+    // In program order, at most one of the 2 inputs of the same index can be enabled
+    std::array<Load_Operation_Input, ISSUE_WIDTH_MAX>  load_input;
+    std::array<Store_Operation_Input, ISSUE_WIDTH_MAX> store_input;
+    std::array<CDB_Input, CDB_COUNT_MAX>               cdb_input; // all the CDBs, see Simulator
+    std::array<Commit_Info, COMMIT_WIDTH_MAX>          rob_commit; // From ROB, a committed store moves to the store buffer
+    Wire<1> mem_ready;   // From memory, whether it takes a load or a write sent in this cycle, see MemoryUnit
     Wire<1> flush_input; // a flush signal is received on the first cycle, serving as RST
+    Squash_Input squash_input;
 };
 
 struct RS_To_Mem {
-    Register<1>            typ; // 0 for load, 1 for store
     Register<3>            op;
     Register<32>           Vj;
-    Register<32>           Vk; // 0 for load instruction
+    Register<32>           Vk; // the value forwarded from an older store, if any
     Register<12>           offset;
     Register<ROB_SIZE_LOG> dest; // 0 means disabled
+    Register<1>            forwarded; // Vk is the value forwarded from an older store, memory is not read
+};
+
+struct RS_To_Mem_Write {
+    Register<1>  enabled;
+    Register<32> address; // word aligned
+    Register<32> data;
+    Register<4>  mask;    // the bytes written
 };
 
 struct RS_Output {
-    Register<32> load_vacancy;  // could have been `bool is_full`, but that requires combinational logic
-    Register<32> store_vacancy; // could have been `bool is_full`, but that requires combinational logic
-    RS_To_Mem    to_mem;
+    Register<32>    load_vacancy;  // could have been `bool is_full`, but that requires combinational logic
+    Register<32>    store_vacancy; // could have been `bool is_full`, but that requires combinational logic
+    RS_To_Mem       to_mem;
+    RS_To_Mem_Write to_mem_write;
+
+    Register<ROB_SIZE_LOG> store_done; // to ROB, a store whose address and data are known, 0 if none
+    Register<ROB_SIZE_LOG> violation;  // to ROB, the oldest load found to have read stale data in this cycle, 0 if none
 };
 
 struct Reservation_Station final : dark::Module<RS_Input, RS_Output> {
+    /**
+     * The stores not yet written to the memory form a store queue. A store is done once its address and data are
+     * known; once committed, it moves to the store buffer, where the stores to the same word are coalesced, and which
+     * is written to the memory in the background, see drain_store_buffer.
+     * A load bypasses the older stores that do not overlap it, and takes its value from the youngest one that does if
+     * it covers the load, see check_load.
+     * A load does not wait for the older stores whose addresses are unknown, unless the store set predictor says it
+     * depends on one of them. It is kept in the load queue until those addresses are known, and if one of the stores
+     * turns out to write a byte it has read, the ROB fetches the load again when it reaches the head.
+     * The memory takes a load or a write per cycle while it is ready, so whatever is sent has left the station.
+     * @param policy how ready loads are picked.
+     */
+    Reservation_Station(Stats* stats, Tracer* tracer, Issue_Policy policy = Issue_Policy::ArrayOrder)
+        : stats_(stats), tracer_(tracer), policy_(policy) {}
+
     void work() {
-        // Handle flush signal first
+        // Handle flush signal first, but the stores committed before a mispredicted branch in the same cycle are kept
         if (flush_input == 1) {
+            for (const auto& commit_info : rob_commit) update_commit(commit_info);
             flush();
             return;
         }
 
-        // Add new operation if one is provided
-        if (load_input.enabled) {
-            add_operation(load_input);
-        } else if (store_input.enabled) {
-            add_operation(store_input);
-        }
+        store_sets_.tick();
+        violation_dest_ = 0;
 
-        // The last insruction is already received, so no need to re-send.
-        if (recv) {
-            dark::debug::assert(last_issue_status == 1, "RS_Mem: last instruction is not issued but recv is high");
-            if (last_issue_typ == 1) /* store */ {
-                // the last instruction is issued sucessfully, so the depency is resolved
-                update_last_store_id();
-                update_store_dependency();
+        // Add the new operations if any are provided, unless they come after a mispredicted branch
+        if (squash_input.enabled == 0) {
+            for (int i = 0; i < ISSUE_WIDTH_MAX; ++i) {
+                if (load_input[i].enabled) {
+                    add_operation(load_input[i]);
+                } else if (store_input[i].enabled) {
+                    add_operation(store_input[i]);
+                }
             }
-            clear_last_sent();
+        }
+
+        // Squash the entries after a mispredicted branch
+        if (squash_input.enabled == 1) {
+            squash();
         }
 
         // Update the reservation station with new inputs from the CDB
-        update_cdb(cdb_input_alu);
-        update_cdb(cdb_input_mem);
+        for (const auto& cdb : cdb_input) update_cdb(cdb);
+        violation <= violation_dest_;
 
         // Update the reservation station with new inputs from the ROB
-        update_branch_dependency(rob_commit);
+        for (const auto& commit_info : rob_commit) update_commit(commit_info);
+        move_to_store_buffer();
+
+        // The loads that no longer run ahead of any store leave the load queue
+        retire_load_queue();
 
-        // Issue operations to the Memory
-        // Priority: last operation > load > store
-        issue_operation();
+        // Report a done store to the ROB, and send a load, or else the store buffer head, to the memory
+        complete_store();
+        drain_store_buffer(!issue_operation());
 
         // Update the vacancy count
         write_vacancy();
@@ -122,350 +207,590 @@ struct Reservation_Station final : dark::Module<RS_Input, RS_Output> {
 
     void add_operation(const Load_Operation_Input& operation_input) {
         // Look for an available slot in the load reservation station
-        for (auto& entry : rs_load) {
-            if (!to_unsigned(entry.busy)) {
-                // Found an empty slot
-                entry.busy   = 1;
-                entry.op     = operation_input.op;
-                entry.Vj     = operation_input.Vj;
-                entry.Qj     = operation_input.Qj;
-                entry.Ql     = last_store_id;
-                entry.dest   = operation_input.dest;
-                entry.offset = operation_input.offset;
-                break;
-            }
-        }
+        auto index = (~load_busy_).first();
+        if (index == Entry_Mask<RS_SIZE>::npos) return;
+        auto& entry = rs_load[index];
+        if (policy_ == Issue_Policy::OldestFirst) load_age_.insert(index, load_busy_);
+        load_busy_.set(index);
+        entry.op        = operation_input.op;
+        entry.Vj        = operation_input.Vj;
+        entry.Qj        = operation_input.Qj;
+        entry.dest      = operation_input.dest;
+        entry.offset    = operation_input.offset;
+        entry.pc        = operation_input.pc;
+        entry.seq       = load_seq_++;
+        entry.store_seq = store_seq_;
+        entry.predicted = store_sets_.predict_load(to_unsigned(entry.pc), entry.dep_seq);
+        entry.held      = false;
+        load_wait_j_.wait(index, to_unsigned(entry.Qj));
     }
 
     void add_operation(const Store_Operation_Input& operation_input) {
         // Look for an available slot in the store reservation station
-        for (auto& entry : rs_store) {
-            if (!to_unsigned(entry.busy)) {
-                // Found an empty slot
-                entry.busy   = 1;
-                entry.op     = operation_input.op;
-                entry.Vj     = operation_input.Vj;
-                entry.Vk     = operation_input.Vk;
-                entry.Qj     = operation_input.Qj;
-                entry.Qk     = operation_input.Qk;
-                entry.Ql     = last_store_id;
-                entry.Qm     = operation_input.Qm;
-                entry.dest   = operation_input.dest;
-                entry.offset = operation_input.offset;
-                break;
-            }
-        }
-        // Update the last store id
-        last_store_id = operation_input.dest;
+        auto index = (~store_busy_).first();
+        if (index == Entry_Mask<RS_SIZE>::npos) return;
+        auto& entry = rs_store[index];
+        store_busy_.set(index);
+        entry.op        = operation_input.op;
+        entry.Vj        = operation_input.Vj;
+        entry.Vk        = operation_input.Vk;
+        entry.Qj        = operation_input.Qj;
+        entry.Qk        = operation_input.Qk;
+        entry.dest      = operation_input.dest;
+        entry.offset    = operation_input.offset;
+        entry.pc        = operation_input.pc;
+        entry.seq       = store_seq_++;
+        entry.store_set = store_sets_.add_store(to_unsigned(entry.pc), entry.seq);
+        store_wait_j_.wait(index, to_unsigned(entry.Qj));
+        store_wait_k_.wait(index, to_unsigned(entry.Qk));
     }
 
-    void update_cdb(const CDB_Input& cdb_input) {
-        if (cdb_input.rob_id == 0) return;
-        for (auto& entry : rs_load) {
-            if (to_unsigned(entry.busy)) {
-                if (entry.Qj == cdb_input.rob_id) {
-                    entry.Vj = cdb_input.value;
-                    entry.Qj = 0;
-                }
-            }
-        }
-        for (auto& entry : rs_store) {
-            if (to_unsigned(entry.busy)) {
-                if (entry.Qj == cdb_input.rob_id) {
-                    entry.Vj = cdb_input.value;
-                    entry.Qj = 0;
-                }
-                if (entry.Qk == cdb_input.rob_id) {
-                    entry.Vk = cdb_input.value;
-                    entry.Qk = 0;
-                }
-            }
-        }
+    void update_cdb(const CDB_Input& cdb) {
+        if (cdb.rob_id == 0) return;
+        auto rob_id = to_unsigned(cdb.rob_id);
+        load_wait_j_.wake(rob_id).for_each([&](std::size_t i) {
+            rs_load[i].Vj = cdb.value;
+            rs_load[i].Qj = 0;
+        });
+        store_wait_j_.wake(rob_id).for_each([&](std::size_t i) {
+            rs_store[i].Vj = cdb.value;
+            rs_store[i].Qj = 0;
+            check_violation(rs_store[i]);
+        });
+        store_wait_k_.wake(rob_id).for_each([&](std::size_t i) {
+            rs_store[i].Vk = cdb.value;
+            rs_store[i].Qk = 0;
+        });
+    }
+
+    void squash() {
+        Entry_Mask<RS_SIZE> loads, stores;
+        load_busy_.for_each([&](std::size_t i) {
+            if (squash_input.squashes(to_unsigned(rs_load[i].dest))) loads.set(i);
+        });
+        // A committed store is older than any branch, and its ROB id may have been reused
+        auto uncommitted = store_busy_;
+        uncommitted.subtract(store_committed_);
+        uncommitted.for_each([&](std::size_t i) {
+            if (squash_input.squashes(to_unsigned(rs_store[i].dest))) stores.set(i);
+        });
+        load_busy_.subtract(loads);
+        store_busy_.subtract(stores);
+        store_done_.subtract(stores);
+        load_wait_j_.remove(loads);
+        store_wait_j_.remove(stores);
+        store_wait_k_.remove(stores);
+
+        Entry_Mask<RS_SIZE> queued;
+        load_queue_busy_.for_each([&](std::size_t i) {
+            if (squash_input.squashes(to_unsigned(load_queue_[i].dest))) queued.set(i);
+        });
+        load_queue_busy_.subtract(queued);
     }
 
     void flush() {
+        // The committed stores are kept, as they are written to the memory in any case
+        load_busy_.clear();
+        store_busy_ = store_committed_;
+        store_done_ = store_committed_;
+        load_wait_j_.clear();
+        store_wait_j_.clear();
+        store_wait_k_.clear();
+        load_queue_busy_.clear();
+        store_sets_.flush();
+
         for (auto& entry : rs_load) {
-            entry.busy   = 0;
-            entry.op     = 0;
-            entry.Vj     = 0;
-            entry.Qj     = 0;
-            entry.Ql     = 0;
-            entry.dest   = 0;
-            entry.offset = 0;
+            entry.op        = 0;
+            entry.Vj        = 0;
+            entry.Qj        = 0;
+            entry.dest      = 0;
+            entry.offset    = 0;
+            entry.pc        = 0;
+            entry.seq       = 0;
+            entry.store_seq = 0;
+            entry.predicted = false;
+            entry.dep_seq   = 0;
+            entry.held      = false;
         }
 
-        for (auto& entry : rs_store) {
-            entry.busy   = 0;
-            entry.op     = 0;
-            entry.Vj     = 0;
-            entry.Vk     = 0;
-            entry.Qj     = 0;
-            entry.Qk     = 0;
-            entry.Ql     = 0;
-            entry.Qm     = 0;
-            entry.dest   = 0;
-            entry.offset = 0;
-        }
+        (~store_committed_).for_each([&](std::size_t i) {
+            auto& entry     = rs_store[i];
+            entry.op        = 0;
+            entry.Vj        = 0;
+            entry.Vk        = 0;
+            entry.Qj        = 0;
+            entry.Qk        = 0;
+            entry.dest      = 0;
+            entry.offset    = 0;
+            entry.pc        = 0;
+            entry.seq       = 0;
+            entry.store_set = store_set::Store_Set_Predictor::kNoSet;
+        });
 
-        to_mem.typ <= 0;
         to_mem.op <= 0;
         to_mem.Vj <= 0;
         to_mem.Vk <= 0;
         to_mem.dest <= 0;
         to_mem.offset <= 0;
+        to_mem.forwarded <= 0;
+        store_done <= 0;
+        violation <= 0;
+        drain_store_buffer(false);
 
-        last_store_id     = 0;
-        last_issue_status = 0;
-        last_issue_typ    = 0;
-        last_issue_rs_id  = 0;
+        load_seq_ = 0; // store_seq_ goes on, as the committed stores are older than the loads to come
         load_vacancy <= RS_SIZE;
-        store_vacancy <= RS_SIZE;
-    }
-
-    void issue_operation() {
-        if (last_issue_status == 1) {
-            // Resend last operation
-            if (last_issue_typ == 1) {
-                // Store
-                issue_store_entry(
-                    rs_store[to_unsigned(last_issue_rs_id)]);
-            } else {
-                // Load
-                issue_load_entry(
-                    rs_load[to_unsigned(last_issue_rs_id)]);
+        store_vacancy <= RS_SIZE - store_busy_.count();
+    }
+
+    /// Sends a ready load to the memory if it is ready. Returns whether one is sent.
+    bool issue_operation() {
+        // A full store buffer leaves the memory to the writes, so that the committed stores can enter it
+        bool buffer_blocked = store_buffer_size_ == STORE_BUFFER_SIZE && store_committed_.any();
+
+        // The loads that may bypass the older stores
+        auto load_ready = load_busy_;
+        load_ready.subtract(load_wait_j_.pending());
+        Entry_Mask<RS_SIZE> load_blocked; // by an older store
+        load_ready.for_each([&](std::size_t i) {
+            auto check = check_load(rs_load[i]);
+            if (!check.ready) load_blocked.set(i);
+            if (check.held) rs_load[i].held = true;
+        });
+        load_ready.subtract(load_blocked);
+        auto index = policy_ == Issue_Policy::OldestFirst ? load_age_.oldest(load_ready) : load_ready.first();
+        if (index != Entry_Mask<RS_SIZE>::npos && !buffer_blocked && mem_ready == 1) {
+            auto check = check_load(rs_load[index]);
+            if (check.speculative) add_to_load_queue(rs_load[index], check);
+            record_dependence(rs_load[index]);
+            issue_load_entry(rs_load[index], check);
+            tracer_->dispatch(to_unsigned(rs_load[index].dest));
+            load_busy_.reset(index);
+            return true;
+        }
+
+        // Don't issue
+        to_mem.op <= 0;
+        to_mem.Vj <= 0;
+        to_mem.Vk <= 0;
+        to_mem.offset <= 0;
+        to_mem.dest <= 0;
+        to_mem.forwarded <= 0;
+        return false;
+    }
+
+    /// Whether a load whose address is known can be sent, and the value it takes from an older store, if any.
+    struct Disambiguation {
+        bool               ready       = false;
+        bool               forwarded   = false;
+        Bit<32>            value       = 0;
+        bool               speculative = false; // the load runs ahead of older stores whose addresses are unknown
+        unsigned long long forward_seq = 0;     // the store the value is taken from, 0 for the store buffer
+        bool               held        = false; // the load waits for the store it is predicted to depend on
+    };
+
+    /**
+     * Checks a load against the older stores in the store queue. It runs ahead of the ones whose addresses are
+     * unknown, unless it is predicted to depend on one of them, as long as the load queue has room to track it.
+     * It bypasses the ones that do not overlap it. If some do, the youngest of them must cover the load and have its
+     * data known, which is then forwarded to the load; otherwise the load waits for it to be written to the memory.
+     * If none do, the store buffer is checked the same way, see check_store_buffer.
+     */
+    Disambiguation check_load(const RS_Load_Entry& load) {
+        unsigned            address     = load_address(load);
+        unsigned            width       = access_width(to_unsigned(load.op));
+        bool                blocked     = false;
+        bool                speculative = false;
+        Entry_Mask<RS_SIZE> overlapping;
+        store_busy_.for_each([&](std::size_t i) {
+            const auto& store = rs_store[i];
+            if (store.seq >= load.store_seq) return; // younger than the load
+            if (store_wait_j_.pending().test(i)) {
+                // The address is unknown
+                if (load.predicted && store.seq == load.dep_seq) blocked = true;
+                else speculative = true;
+                return;
             }
-        } else {
-            // Issue load instructions first
-            for (auto& entry : rs_load) {
-                if (try_issue_entry(entry)) {
-                    return;
-                }
+            if (overlaps(address, width, store_address(store), access_width(to_unsigned(store.op)))) {
+                overlapping.set(i);
             }
-
-            if (can_store()) {
-                for (auto& entry : rs_store) {
-                    if (try_issue_entry(entry)) {
-                        return;
-                    }
-                }
+        });
+        if (blocked) return {.held = true};
+        if (speculative && !(~load_queue_busy_).any()) return {};
+
+        auto index = youngest_store(overlapping);
+        if (index == Entry_Mask<RS_SIZE>::npos) {
+            unsigned raw = 0;
+            switch (check_store_buffer(address, width, raw)) {
+            case Buffer_Hit::None: return {true, false, 0, speculative, 0};
+            case Buffer_Hit::Full: return {true, true, load_value(to_unsigned(load.op), raw), speculative, 0};
+            default: return {}; // wait for the store buffer to write the memory
             }
-
-            // Don't issue
-            to_mem.typ <= 0;
-            to_mem.op <= 0;
-            to_mem.Vj <= 0;
-            to_mem.Vk <= 0;
-            to_mem.offset <= 0;
-            to_mem.dest <= 0;
-
-            last_issue_status = 0;
-            last_issue_typ    = 0;
-            last_issue_rs_id  = 0;
         }
+        const auto& store = rs_store[index];
+        unsigned    base  = store_address(store);
+        bool covered = base <= address && address + width <= base + access_width(to_unsigned(store.op));
+        if (!covered || store_wait_k_.pending().test(index)) return {};
+        auto raw = to_unsigned(store.Vk) >> (8 * (address - base));
+        return {true, true, load_value(to_unsigned(load.op), raw), speculative, store.seq};
     }
 
-    bool can_store() {
-        for (auto& entry : rs_load) {
-            if (to_unsigned(entry.busy) && to_unsigned(entry.Ql) == 0) {
-                // There is a load instruction whose store depenency has been resolved
-                // this instruction must be issued before any store instruction
-                return false;
+    enum class Buffer_Hit { None, Partial, Full };
+
+    /// Which of the `width` bytes at `address` the store buffer holds. If it holds all of them, they are put in `raw`.
+    Buffer_Hit check_store_buffer(unsigned address, unsigned width, unsigned& raw) {
+        unsigned found = 0;
+        raw            = 0;
+        // The later entries of a word are younger, see add_to_store_buffer
+        for (unsigned k = 0; k < store_buffer_size_; ++k) {
+            const auto& entry = store_buffer_[(store_buffer_head_ + k) % STORE_BUFFER_SIZE];
+            for (unsigned i = 0; i < width; ++i) {
+                unsigned byte = address + i;
+                if ((byte & ~3u) != entry.address || !(entry.mask >> (byte & 3) & 1)) continue;
+                found |= 1u << i;
+                raw = (raw & ~(0xffu << (8 * i))) | (((entry.data >> (8 * (byte & 3))) & 0xff) << (8 * i));
             }
         }
-        return true;
+        if (found == 0) return Buffer_Hit::None;
+        return found == (1u << width) - 1 ? Buffer_Hit::Full : Buffer_Hit::Partial;
     }
 
-    bool try_issue_entry(RS_Load_Entry& entry) {
-        if (to_unsigned(entry.busy) && to_unsigned(entry.Qj) == 0 && to_unsigned(entry.Ql) == 0) {
-            issue_load_entry(entry);
-            return true;
-        }
-        return false;
+    /// Tracks a load sent ahead of older stores whose addresses are unknown, see check_violation.
+    void add_to_load_queue(const RS_Load_Entry& load, const Disambiguation& check) {
+        auto  index = (~load_queue_busy_).first();
+        auto& entry = load_queue_[index];
+        load_queue_busy_.set(index);
+        entry.pc          = load.pc;
+        entry.dest        = load.dest;
+        entry.address     = load_address(load);
+        entry.width       = access_width(to_unsigned(load.op));
+        entry.seq         = load.seq;
+        entry.store_seq   = load.store_seq;
+        entry.forwarded   = check.forwarded;
+        entry.forward_seq = check.forward_seq;
     }
 
-    bool try_issue_entry(RS_Store_Entry& entry) {
-        if (to_unsigned(entry.busy) && to_unsigned(entry.Qj) == 0 && to_unsigned(entry.Qk) == 0
-            && to_unsigned(entry.Ql) == 0 && to_unsigned(entry.Qm) == 0) {
-            issue_store_entry(entry);
-            return true;
-        }
-        return false;
+    /**
+     * Called when the address of `store` is known. A load in the load queue that is younger than the store and has
+     * read a byte it writes has read stale data, unless that byte came from a store between the two.
+     * The store sets of the two are merged, and the oldest such load is reported to the ROB.
+     */
+    void check_violation(const RS_Store_Entry& store) {
+        unsigned            address = store_address(store);
+        unsigned            width   = access_width(to_unsigned(store.op));
+        Entry_Mask<RS_SIZE> violated;
+        load_queue_busy_.for_each([&](std::size_t i) {
+            const auto& load = load_queue_[i];
+            if (store.seq >= load.store_seq) return;                     // younger than the load
+            if (load.forwarded && load.forward_seq > store.seq) return;  // the value comes from a younger store
+            if (!overlaps(load.address, load.width, address, width)) return;
+            violated.set(i);
+            stats_->record_memory_order_violation();
+            store_sets_.record_violation(to_unsigned(load.pc), to_unsigned(store.pc));
+            if (violation_dest_ == 0 || load.seq < violation_seq_) {
+                violation_dest_ = load.dest;
+                violation_seq_  = load.seq;
+            }
+        });
+        load_queue_busy_.subtract(violated);
     }
 
-    void issue_store_entry(RS_Store_Entry& entry) {
-        to_mem.typ <= 1;
-        to_mem.op <= entry.op;
-        to_mem.Vj <= entry.Vj;
-        to_mem.Vk <= entry.Vk;
-        to_mem.offset <= entry.offset;
-        to_mem.dest <= entry.dest;
+    /// A load leaves the load queue once the addresses of all the older stores are known.
+    void retire_load_queue() {
+        Entry_Mask<RS_SIZE> settled;
+        load_queue_busy_.for_each([&](std::size_t i) {
+            bool pending = false;
+            store_wait_j_.pending().for_each([&](std::size_t j) {
+                if (rs_store[j].seq < load_queue_[i].store_seq) pending = true;
+            });
+            if (!pending) settled.set(i);
+        });
+        load_queue_busy_.subtract(settled);
+    }
+
+    /// Counts a load that has waited for the store it is predicted to depend on, which turns out not to overlap it.
+    void record_dependence(const RS_Load_Entry& load) {
+        if (!load.held) return;
+        store_busy_.for_each([&](std::size_t i) {
+            const auto& store = rs_store[i];
+            if (store.seq != load.dep_seq || store_wait_j_.pending().test(i)) return;
+            if (!overlaps(load_address(load), access_width(to_unsigned(load.op)), store_address(store),
+                          access_width(to_unsigned(store.op)))) {
+                stats_->record_false_dependence();
+            }
+        });
+    }
+
+    static unsigned load_address(const RS_Load_Entry& load) {
+        return to_unsigned(load.Vj + to_signed(load.offset));
+    }
+
+    static unsigned store_address(const RS_Store_Entry& store) {
+        return to_unsigned(store.Vj + to_signed(store.offset));
+    }
 
-        last_issue_status = 1;
-        last_issue_typ    = 1;                        // store
-        last_issue_rs_id  = &entry - rs_store.data(); // Calculate index
+    /// The youngest of the stores in `stores`, or npos.
+    std::size_t youngest_store(const Entry_Mask<RS_SIZE>& stores) {
+        std::size_t result = Entry_Mask<RS_SIZE>::npos;
+        stores.for_each([&](std::size_t i) {
+            if (result == Entry_Mask<RS_SIZE>::npos || rs_store[i].seq > rs_store[result].seq) result = i;
+        });
+        return result;
     }
 
-    void issue_load_entry(RS_Load_Entry& entry) {
-        to_mem.typ <= 0;
+    void issue_load_entry(const RS_Load_Entry& entry, const Disambiguation& check) {
         to_mem.op <= entry.op;
         to_mem.Vj <= entry.Vj;
-        to_mem.Vk <= 0;
+        to_mem.Vk <= check.value;
         to_mem.offset <= entry.offset;
         to_mem.dest <= entry.dest;
-
-        last_issue_status = 1;
-        last_issue_typ    = 0;                       // load
-        last_issue_rs_id  = &entry - rs_load.data(); // Calculate index
+        to_mem.forwarded <= check.forwarded;
     }
 
-    void clear_last_sent() {
-        last_issue_status = 0;
-        if (last_issue_typ == 0) { // load
-            rs_load[to_unsigned(last_issue_rs_id)].busy = 0;
-        } else { // store
-            rs_store[to_unsigned(last_issue_rs_id)].busy = 0;
+    /// Reports to the ROB a store whose address and data are known, one per cycle.
+    void complete_store() {
+        auto ready = store_busy_;
+        ready.subtract(store_done_).subtract(store_wait_j_.pending()).subtract(store_wait_k_.pending());
+        auto index = ready.first();
+        if (index == Entry_Mask<RS_SIZE>::npos) {
+            store_done <= 0;
+            return;
         }
+        store_done_.set(index);
+        store_done <= rs_store[index].dest;
+        tracer_->dispatch(to_unsigned(rs_store[index].dest));
+        tracer_->execute(to_unsigned(rs_store[index].dest));
     }
 
-    /// Called when a store instruction is received by the memory, i.e. issued sucessfully
-    void update_last_store_id() {
-        if (last_store_id == to_mem.dest) {
-            last_store_id = 0;
-        }
+    void update_commit(const Commit_Info& commit_info) {
+        if (commit_info.rob_id == 0) return;
+        auto uncommitted = store_done_;
+        uncommitted.subtract(store_committed_);
+        uncommitted.for_each([&](std::size_t i) {
+            if (to_unsigned(rs_store[i].dest) == to_unsigned(commit_info.rob_id)) store_committed_.set(i);
+        });
     }
 
-    /// Called when a store instruction is received by the memory, i.e. issued sucessfully
-    void update_store_dependency() {
-        for (auto& entry : rs_load) {
-            if (entry.Ql == to_mem.dest) {
-                entry.Ql = 0;
-            }
-        }
-        for (auto& entry : rs_store) {
-            if (entry.Ql == to_mem.dest) {
-                entry.Ql = 0;
-            }
+    /// The committed stores enter the store buffer in program order, as long as it has room for them.
+    void move_to_store_buffer() {
+        while (store_committed_.any()) {
+            std::size_t index = Entry_Mask<RS_SIZE>::npos;
+            store_committed_.for_each([&](std::size_t i) {
+                if (index == Entry_Mask<RS_SIZE>::npos || rs_store[i].seq < rs_store[index].seq) index = i;
+            });
+            if (!add_to_store_buffer(rs_store[index])) return;
+            store_busy_.reset(index);
+            store_done_.reset(index);
+            store_committed_.reset(index);
+            store_sets_.remove_store(rs_store[index].store_set, rs_store[index].seq);
         }
     }
 
-    void update_branch_dependency(const Commit_Info& commit_info) {
-        if (commit_info.rob_id == 0) return;
-
-        for (auto& entry : rs_store) {
-            if (entry.Qm == commit_info.rob_id) {
-                entry.Qm = 0;
+    /**
+     * Writes the bytes of `store` into the entries of their words, adding entries for the words not in the buffer.
+     * Returns false if there is no room.
+     */
+    bool add_to_store_buffer(const RS_Store_Entry& store) {
+        unsigned address = store_address(store);
+        unsigned width   = access_width(to_unsigned(store.op));
+        unsigned value   = to_unsigned(store.Vk);
+        unsigned words   = ((address + width - 1) & ~3u) == (address & ~3u) ? 1 : 2;
+        unsigned needed  = 0;
+        for (unsigned w = 0; w < words; ++w) {
+            if (find_in_store_buffer((address & ~3u) + 4 * w) == STORE_BUFFER_SIZE) ++needed;
+        }
+        if (store_buffer_size_ + needed > STORE_BUFFER_SIZE) return false;
+        if (needed < words) stats_->record_coalesced_store();
+
+        for (unsigned i = 0; i < width; ++i) {
+            unsigned byte  = address + i;
+            auto     index = find_in_store_buffer(byte & ~3u);
+            if (index == STORE_BUFFER_SIZE) {
+                index = (store_buffer_head_ + store_buffer_size_++) % STORE_BUFFER_SIZE;
+                store_buffer_[index] = {byte & ~3u, 0, 0};
             }
+            auto&    entry = store_buffer_[index];
+            unsigned shift = 8 * (byte & 3);
+            entry.data     = (entry.data & ~(0xffu << shift)) | (((value >> (8 * i)) & 0xff) << shift);
+            entry.mask |= 1u << (byte & 3);
         }
+        return true;
     }
 
-    void write_vacancy() {
-        unsigned load_vacancy_count = 0;
-        for (const auto& entry : rs_load) {
-            if (!to_unsigned(entry.busy)) {
-                load_vacancy_count++;
-            }
+    /// The position of the youngest entry of the word at `address`, or STORE_BUFFER_SIZE.
+    unsigned find_in_store_buffer(unsigned address) {
+        unsigned result = STORE_BUFFER_SIZE;
+        for (unsigned k = 0; k < store_buffer_size_; ++k) {
+            auto index = (store_buffer_head_ + k) % STORE_BUFFER_SIZE;
+            if (store_buffer_[index].address == address) result = index;
         }
+        return result;
+    }
 
-        unsigned store_vacancy_count = 0;
-        for (const auto& entry : rs_store) {
-            if (!to_unsigned(entry.busy)) {
-                store_vacancy_count++;
-            }
+    /**
+     * Sends the head of the store buffer to the memory if it is ready and `send` is set, i.e. no load is sent.
+     * The head leaves the buffer at once: a load sent from the next cycle on reaches the memory after the write.
+     */
+    void drain_store_buffer(bool send) {
+        if (!send || mem_ready == 0 || store_buffer_size_ == 0) {
+            to_mem_write.enabled <= 0;
+            to_mem_write.address <= 0;
+            to_mem_write.data <= 0;
+            to_mem_write.mask <= 0;
+            return;
         }
+        const auto& entry = store_buffer_[store_buffer_head_];
+        to_mem_write.enabled <= 1;
+        to_mem_write.address <= entry.address;
+        to_mem_write.data <= entry.data;
+        to_mem_write.mask <= entry.mask;
+        store_buffer_head_ = (store_buffer_head_ + 1) % STORE_BUFFER_SIZE;
+        --store_buffer_size_;
+    }
 
-        load_vacancy <= load_vacancy_count;
-        store_vacancy <= store_vacancy_count;
+    void write_vacancy() {
+        load_vacancy <= RS_SIZE - load_busy_.count();
+        store_vacancy <= RS_SIZE - store_busy_.count();
     }
 
 private:
     std::array<RS_Load_Entry, RS_SIZE>  rs_load;
     std::array<RS_Store_Entry, RS_SIZE> rs_store;
-    Bit<ROB_SIZE_LOG>                   last_store_id; // the ROB id of the latest store instruction, used to update Ql
-    Bit<1>                              last_issue_status; // 0 for not issued, 1 for issued
-    Bit<1>                              last_issue_typ; // 0 for load, 1 for store
-    Bit<RS_SIZE_LOG>                    last_issue_rs_id; // the RS id of the latest issued instruction, used to re-send
+    Entry_Mask<RS_SIZE>                 load_busy_;
+    Entry_Mask<RS_SIZE>                 store_busy_;
+    Entry_Mask<RS_SIZE>                 store_done_;      // stores reported to the ROB
+    Entry_Mask<RS_SIZE>                 store_committed_; // stores waiting for room in the store buffer
+    std::array<Load_Queue_Entry, RS_SIZE> load_queue_;
+    Entry_Mask<RS_SIZE>                 load_queue_busy_;
+    Tag_Wait<RS_SIZE>                   load_wait_j_;  // loads waiting for the address
+    Tag_Wait<RS_SIZE>                   store_wait_j_; // stores waiting for the address
+    Tag_Wait<RS_SIZE>                   store_wait_k_; // stores waiting for the value
+    Age_Matrix<RS_SIZE>                 load_age_;     // only maintained for Issue_Policy::OldestFirst
+    unsigned long long                  load_seq_  = 0; // the sequence number of the next load
+    unsigned long long                  store_seq_ = 0; // the sequence number of the next store
+    store_set::Store_Set_Predictor      store_sets_;
+    Bit<ROB_SIZE_LOG>                   violation_dest_; // the oldest load found to have read stale data in this cycle
+    unsigned long long                  violation_seq_ = 0;
+    std::array<Store_Buffer_Entry, STORE_BUFFER_SIZE> store_buffer_; // a ring, oldest first
+    unsigned                            store_buffer_head_ = 0;
+    unsigned                            store_buffer_size_ = 0;
+    Stats*                              stats_;
+    Tracer*                             tracer_;
+    Issue_Policy                        policy_;
 };
 
 struct Mem_Operation_Input {
-    Wire<1>            typ; // 0 for load, 1 for store
     Wire<3>            op;
     Wire<32>           rs1;
-    Wire<32>           rs2; // 0 for load instruction
+    Wire<32>           rs2; // the value forwarded from an older store, if any
     Wire<12>           offset;
     Wire<ROB_SIZE_LOG> dest;
+    Wire<1>            forwarded; // rs2 is the value forwarded from an older store
+};
+
+struct Mem_Write_Input {
+    Wire<1>  enabled;
+    Wire<32> address; // word aligned
+    Wire<32> data;
+    Wire<4>  mask;    // the bytes written
 };
 
 struct Mem_Input {
-    Mem_Operation_Input operation_input;
+    Mem_Operation_Input operation_input; // loads
+    Mem_Write_Input     write_input;     // the store buffer head, never sent along with a load
+    Wire<32>            cdb_taken;       // the CDBs taken by the results the ALUs send along with this unit's
     Wire<1>             flush_input; // a flush signal is received on the first cycle, serving as RST
+    Squash_Input        squash_input;
 };
 
 struct Mem_Output {
     CDB_Output  cdb_output;
-    Register<1> recv;
-    // whether the instruction is received. The RS keeps sending the same instruction until it is received
+    Register<1> ready; // whether a load or a write sent in the next cycle is taken
+};
+
+/// A load in flight in the memory unit.
+struct In_Flight_Load {
+    Bit<ROB_SIZE_LOG>  rob_id;
+    Bit<32>            value;
+    unsigned long long done; // the cycle the result is sent in, or later if the CDB is taken
+    unsigned long long seq;  // the order the loads are taken in
 };
 
 struct MemoryUnit final : dark::Module<Mem_Input, Mem_Output> {
-    explicit MemoryUnit(Memory* memory) : memory(memory), state(0) {}
+    /**
+     * A pipelined unit: it takes a load or a write in every cycle it is ready, and every access takes the latency the
+     * data cache gives it. The loads send their results on the CDB once done, one per cycle, the one done first first,
+     * so a hit may overtake an older miss.
+     * Being ready promises to take whatever arrives: the RS sends in the cycle after `ready` is set, so it is only set
+     * when there is room for that request, and for the one that may already be on its way.
+     * The ALUs take the CDBs first, and a result waits while all `cdb_count` of them are taken.
+     */
+    MemoryUnit(Memory* memory, cache::Cache* dcache, Stats* stats, Tracer* tracer, unsigned cdb_count = 2)
+        : memory(memory), dcache(dcache), stats(stats), tracer(tracer), cdb_count(cdb_count) {}
 
     void work() {
+        ++cycle;
+        // A write holds committed stores, and the RS has already let it go, so it is taken even in a flush
+        if (write_input.enabled == 1) {
+            write_data(write_input);
+            dcache->access(to_unsigned(write_input.address), true, cycle);
+        }
+
         if (flush_input == 1) {
             flush();
             return;
         }
 
-        if (state == 0) {
-            // Idle state
-            if (operation_input.dest != 0) {
-                execute_operation(operation_input);
-                state++;
-                recv <= 1; // Operation received
-            } else {
-                recv <= 0; // No operation
-            }
-            cdb_output.rob_id <= 0;
-            cdb_output.value <= 0;
-        } else if (state == MEMORY_LATENCY) {
-            output_result();
-            state = 0; // Back to idle
-        } else {
-            state++;
-            recv <= 0; // Still in execution delay
-            cdb_output.rob_id <= 0;
-            cdb_output.value <= 0;
+        // A squashed load is dropped, whether in flight or arriving
+        busy.for_each([&](std::size_t i) {
+            if (squash_input.squashes(to_unsigned(loads[i].rob_id))) busy.reset(i);
+        });
+        if (operation_input.dest != 0 && !squash_input.squashes(to_unsigned(operation_input.dest))) {
+            execute_operation(operation_input);
         }
+
+        output_result();
+        write_ready();
     }
 
 private:
-    Memory*           memory;
-    unsigned int      state;  // 0 for idle, 1, 2, ... MEM_LATENCY for busy. Specially, reset the state if flushed
-    Bit<ROB_SIZE_LOG> rob_id; // cached for delayed output
-    Bit<32>           value;  // cached for delayed output
+    Memory*                             memory;
+    cache::Cache*                       dcache;
+    Stats*                              stats;
+    Tracer*                             tracer;
+    unsigned                            cdb_count;
+    std::array<In_Flight_Load, RS_SIZE> loads;
+    Entry_Mask<RS_SIZE>                 busy;
+    unsigned long long                  cycle    = 0;
+    unsigned long long                  load_seq = 0;
+    bool                                promised = false; // whether `ready` was set in the last cycle
 
     void flush() {
-        state  = 0;
-        rob_id = 0;
-        value  = 0;
-        recv <= 0;
+        busy.clear();
         cdb_output.rob_id <= 0;
         cdb_output.value <= 0;
+        write_ready();
     }
 
     void execute_operation(const Mem_Operation_Input& input) {
-        rob_id = input.dest;
-        if (input.typ == 0) {
-            // Load
-            value = load_data(input);
+        tracer->execute(to_unsigned(input.dest));
+        auto  index = (~busy).first();
+        auto& load  = loads[index];
+        busy.set(index);
+        load.rob_id = input.dest;
+        load.seq    = load_seq++;
+        if (input.forwarded == 1) {
+            // Forwarded by the reservation station: the memory is not accessed, and the result is sent in the next cycle
+            load.value = input.rs2;
+            load.done  = cycle + 1;
         } else {
-            // Store
-            value = 0;
-            store_data(input);
+            load.value = load_data(input);
+            load.done  = cycle + dcache->access(to_unsigned(input.rs1 + to_signed(input.offset)), false, cycle);
         }
     }
-
     Bit<32> load_data(const Mem_Operation_Input& input) {
         unsigned address = to_unsigned(input.rs1 + to_signed(input.offset));
+        // A load after a mispredicted branch may compute any address, and is squashed before it could fault
+        if (address > MEMORY_SIZE - access_width(to_unsigned(input.op))) return 0;
         switch (to_unsigned(input.op)) {
         case 0b000: // LB
             return sign_extend<8, 32>(memory->get_byte(address));
@@ -483,27 +808,41 @@ private:
         return 0;
     }
 
-    void store_data(const Mem_Operation_Input& input) {
-        unsigned address = to_unsigned(input.rs1 + to_signed(input.offset));
-        switch (to_unsigned(input.op)) {
-        case 0b000: // SB
-            memory->get_byte(address) = to_unsigned(input.rs2);
-            break;
-        case 0b001: // SH
-            memory->get_half(address) = to_unsigned(input.rs2);
-            break;
-        case 0b010: // SW
-            memory->get_word(address) = to_unsigned(input.rs2);
-            break;
-        default:
-            dark::debug::unreachable();
+    void write_data(const Mem_Write_Input& input) {
+        unsigned address = to_unsigned(input.address);
+        unsigned data    = to_unsigned(input.data);
+        for (unsigned i = 0; i < 4; ++i) {
+            if (to_unsigned(input.mask) >> i & 1) memory->get_byte(address + i) = data >> (8 * i);
         }
     }
 
+    /// Sends the load done first to a CDB if one is free, the oldest one among those done in the same cycle.
     void output_result() {
-        cdb_output.rob_id <= rob_id;
-        cdb_output.value <= value;
-        recv <= 0; // Operation complete
+        auto index = Entry_Mask<RS_SIZE>::npos;
+        busy.for_each([&](std::size_t i) {
+            if (loads[i].done > cycle) return;
+            if (index == Entry_Mask<RS_SIZE>::npos || loads[i].done < loads[index].done ||
+                (loads[i].done == loads[index].done && loads[i].seq < loads[index].seq)) {
+                index = i;
+            }
+        });
+        bool cdb_free = to_unsigned(cdb_taken) < cdb_count;
+        if (index != Entry_Mask<RS_SIZE>::npos && !cdb_free) stats->record_cdb_conflict();
+        if (index == Entry_Mask<RS_SIZE>::npos || !cdb_free) {
+            cdb_output.rob_id <= 0;
+            cdb_output.value <= 0;
+            return;
+        }
+        busy.reset(index);
+        cdb_output.rob_id <= loads[index].rob_id;
+        cdb_output.value <= loads[index].value;
+    }
+
+    /// Any request may be a load that misses, so it needs a free slot and a free MSHR.
+    void write_ready() {
+        unsigned needed = promised ? 2 : 1;
+        promised        = RS_SIZE - busy.count() >= needed && dcache->free_mshrs(cycle) >= needed;
+        ready <= promised;
     }
 };
 } // namespace RS_Mem
@@ -4,109 +4,181 @@
 
 #pragma once
 
+#include "cache.h"
 #include "fetcher.h"
 #include "memory.h"
+#include "prf.h"
 #include "regfile.h"
 #include "rs_alu.h"
 #include "rs_bcu.h"
+#include "rs_mdu.h"
 #include "rs_mem.h"
 #include "reorder_buffer.h"
 #include "decoder.h"
 #include "tools.h"
 #include "stats.h"
+#include "profile.h"
+#include "tracer.h"
 #include <iostream>
+#include <string>
+#include <vector>
+
+/// Microarchitecture options chosen at run time. The defaults are the original design.
+struct Simulator_Config {
+    Issue_Policy rs_alu_policy = Issue_Policy::ArrayOrder;
+    Issue_Policy rs_bcu_policy = Issue_Policy::ArrayOrder;
+    Issue_Policy rs_mem_policy = Issue_Policy::ArrayOrder;
+
+    Recovery_Policy recovery_policy = Recovery_Policy::AtCommit;
+    Rename_Policy   rename_policy   = Rename_Policy::ReorderBuffer;
+
+    cache::Cache_Config dcache; // disabled: every access takes MEMORY_LATENCY cycles
+
+    unsigned            fetch_queue_size = FETCH_QUEUE_SIZE;
+    cache::Cache_Config icache{.hit_latency = 1}; // disabled: every fetch takes a cycle
+    unsigned            prefetch_distance = 4;    // in lines along the predicted path, 0 for no prefetching
+
+    unsigned issue_width = 1; // instructions fetched and issued in a cycle, at most ISSUE_WIDTH_MAX
+    unsigned alu_count   = 1; // at most ALU_COUNT_MAX
+    unsigned cdb_count   = 2; // at most CDB_COUNT_MAX, taken by the ALUs, then the MDU, then the memory unit
+
+    unsigned mul_latency = 3;  // cycles of a multiplication, which is pipelined
+    unsigned div_latency = 32; // cycles of a division with a 32-bit quotient, shorter quotients take fewer
+
+    unsigned commit_width = 1; // instructions committed in a cycle, at most COMMIT_WIDTH_MAX
+};
 
 class Simulator {
 public:
-    Simulator() : memory_(std::make_unique<Memory>()), fetcher_(memory_.get()), mem_(memory_.get()),
-                  reorder_buffer_(&stats_) {
+    explicit Simulator(const Simulator_Config& config = {})
+        : memory_(std::make_unique<Memory>()), icache_(config.icache),
+          fetcher_(memory_.get(), &icache_, &tracer_, config.prefetch_distance, config.issue_width),
+          decoder_(&stats_, &tracer_, config.fetch_queue_size, config.issue_width, config.rename_policy),
+          rs_alu_(&stats_, &tracer_, config.rs_alu_policy, config.alu_count, config.cdb_count),
+          rs_mdu_(&tracer_),
+          mdu_(&stats_, &tracer_, config.mul_latency, config.div_latency, config.cdb_count),
+          rs_bcu_(&tracer_, config.rs_bcu_policy), bcu_(&tracer_), rs_mem_(&stats_, &tracer_, config.rs_mem_policy),
+          dcache_(config.dcache), mem_(memory_.get(), &dcache_, &stats_, &tracer_, config.cdb_count),
+          reorder_buffer_(&stats_, &profile_, &tracer_, config.recovery_policy, config.commit_width,
+                          config.rename_policy),
+          stats_(config.issue_width, config.commit_width), rename_policy_(config.rename_policy),
+          tracer_(&cpu_) {
+        for (unsigned i = 0; i < config.alu_count; ++i) alus_.push_back(std::make_unique<RS_ALU::ALU>(&tracer_));
+
         // Add modules to the CPU
-        cpu_.add_module(&fetcher_);
-        cpu_.add_module(&decoder_);
-        cpu_.add_module(&rs_alu_);
-        cpu_.add_module(&alu_);
-        cpu_.add_module(&rs_bcu_);
-        cpu_.add_module(&bcu_);
-        cpu_.add_module(&rs_mem_);
-        cpu_.add_module(&mem_);
-        cpu_.add_module(&reg_file_);
-        cpu_.add_module(&reorder_buffer_);
+        cpu_.add_module(&fetcher_, "fetcher");
+        cpu_.add_module(&decoder_, "decoder");
+        cpu_.add_module(&rs_alu_, "rs_alu");
+        for (unsigned i = 0; i < alus_.size(); ++i) cpu_.add_module(alus_[i].get(), alu_name(i));
+        cpu_.add_module(&rs_mdu_, "rs_mdu");
+        cpu_.add_module(&mdu_, "mdu");
+        cpu_.add_module(&rs_bcu_, "rs_bcu");
+        cpu_.add_module(&bcu_, "bcu");
+        cpu_.add_module(&rs_mem_, "rs_mem");
+        cpu_.add_module(&mem_, "mem");
+        if (rename_policy_ == Rename_Policy::PhysicalRegisterFile) {
+            cpu_.add_module(&prf_, "prf");
+        } else {
+            cpu_.add_module(&reg_file_, "reg_file");
+        }
+        cpu_.add_module(&reorder_buffer_, "rob");
 
         // Connecting the modules
 
         // To Fetcher
-        // Fetcher -> Fetcher
-        fetcher_.last_PC_plus_4 = [&] { return fetcher_.program_counter + 4; };
         // Decoder -> Fetcher
         fetcher_.pc_from_decoder         = decoder_.to_fetcher.pc;
         fetcher_.pc_from_decoder_enabled = decoder_.to_fetcher.enabled;
+        fetcher_.queue_vacancy           = decoder_.to_fetcher.queue_vacancy;
         // ROB -> Fetcher
         fetcher_.pc_from_ROB           = reorder_buffer_.to_fetcher.pc;
         fetcher_.pc_from_ROB_enabled   = reorder_buffer_.to_fetcher.pc_enabled;
+        fetcher_.history_from_ROB      = reorder_buffer_.to_fetcher.history;
         fetcher_.pc_of_branch          = reorder_buffer_.to_fetcher.branch_pc;
         fetcher_.branch_taken          = reorder_buffer_.to_fetcher.branch_taken;
         fetcher_.branch_record_enabled = reorder_buffer_.to_fetcher.branch_record_enabled;
+        fetcher_.branch_history        = reorder_buffer_.to_fetcher.branch_history;
 
         // To Decoder
         // Fetcher -> Decoder
-        decoder_.from_fetcher.instruction            = fetcher_.instruction;
-        decoder_.from_fetcher.program_counter        = fetcher_.program_counter;
-        decoder_.from_fetcher.predicted_branch_taken = fetcher_.predicted_branch_taken;
+        dark::connect(decoder_.from_fetcher, static_cast<fetcher::Fetcher_Output&>(fetcher_));
         // CDB -> Decoder
-        dark::connect(decoder_.cdb_input_alu, alu_.cdb_output);
-        dark::connect(decoder_.cdb_input_mem, mem_.cdb_output);
+        connect_cdb(decoder_.cdb_input);
         // RegFile -> Decoder
         dark::connect(decoder_.from_regfile, static_cast<regfile::RegFile_Output&>(reg_file_));
-        // Reservation Stations -> Decoder
-        decoder_.rs_alu_full = [&] {
-            return (rs_alu_.vacancy == 0) || (rs_alu_.vacancy == 1 && decoder_.to_rs_alu.enabled == 1);
+        // Reservation Stations -> Decoder, the instructions issued in the last cycle are not added yet
+        decoder_.rs_alu_free = [&] { return to_unsigned(rs_alu_.vacancy) - enabled_count(decoder_.to_rs_alu); };
+        decoder_.rs_mdu_free = [&] { return to_unsigned(rs_mdu_.vacancy) - enabled_count(decoder_.to_rs_mdu); };
+        decoder_.rs_bcu_free = [&] { return to_unsigned(rs_bcu_.vacancy) - enabled_count(decoder_.to_rs_bcu); };
+        decoder_.rs_mem_load_free = [&] {
+            return to_unsigned(rs_mem_.load_vacancy) - enabled_count(decoder_.to_rs_mem_load);
         };
-        decoder_.rs_bcu_full = [&] {
-            return (rs_bcu_.vacancy == 0) || (rs_bcu_.vacancy == 1 && decoder_.to_rs_bcu.enabled == 1);
-        };
-        decoder_.rs_mem_load_full = [&] {
-            return (rs_mem_.load_vacancy == 0) || (rs_mem_.load_vacancy == 1 && decoder_.to_rs_mem_load.enabled == 1);
-        };
-        decoder_.rs_mem_store_full = [&] {
-            return (rs_mem_.store_vacancy == 0) || (rs_mem_.store_vacancy == 1 && decoder_.to_rs_mem_store.enabled ==
-                1);
+        decoder_.rs_mem_store_free = [&] {
+            return to_unsigned(rs_mem_.store_vacancy) - enabled_count(decoder_.to_rs_mem_store);
         };
+        // PRF -> Decoder
+        dark::connect(decoder_.from_prf, static_cast<prf::PRF_Output&>(prf_));
         // ROB -> Decoder
         dark::connect(decoder_.from_rob, reorder_buffer_.to_decoder);
-        decoder_.rob_full = [&] {
-            return (reorder_buffer_.vacancy == 0) || (reorder_buffer_.vacancy == 1 && decoder_.to_rob.enabled == 1);
+        for (int i = 0; i < COMMIT_WIDTH_MAX; ++i) {
+            decoder_.from_commit[i].enabled = reorder_buffer_.to_reg_file[i].enabled;
+            decoder_.from_commit[i].reg_id  = reorder_buffer_.to_reg_file[i].reg_id;
+            decoder_.from_commit[i].rob_id  = reorder_buffer_.to_reg_file[i].rob_id;
+        }
+        decoder_.rob_free = [&] { return to_unsigned(reorder_buffer_.vacancy) - enabled_count(decoder_.to_rob); };
+        decoder_.first_rob_id = [&] {
+            auto id = to_unsigned(reorder_buffer_.next_tail_output);
+            for (auto issued = enabled_count(decoder_.to_rob); issued > 0; --issued) id = next_rob_id(id);
+            return id;
         };
-        decoder_.rob_id = [&] {
-            return decoder_.to_rob.enabled == 1
-                       ? rob::ROB::next_tail(to_unsigned(reorder_buffer_.next_tail_output))
-                       : to_unsigned(reorder_buffer_.next_tail_output);
-        };
-        dark::connect(decoder_.commit_info, reorder_buffer_.commit_output);
         decoder_.flush_input = reorder_buffer_.flush_output;
+        dark::connect(decoder_.squash_input, reorder_buffer_.squash_output);
 
         // To RS_ALU
         dark::connect(rs_alu_.operation_input, decoder_.to_rs_alu);
-        dark::connect(rs_alu_.cdb_input_alu, alu_.cdb_output);
-        dark::connect(rs_alu_.cdb_input_mem, mem_.cdb_output);
+        connect_cdb(rs_alu_.cdb_input);
         rs_alu_.flush_input = reorder_buffer_.flush_output;
+        dark::connect(rs_alu_.squash_input, reorder_buffer_.squash_output);
 
-        // To ALU
-        alu_.dest = [&] {
-            return reorder_buffer_.flush_output == 1 ? 0 : to_unsigned(rs_alu_.to_alu.dest);
-        };
-        alu_.op  = rs_alu_.to_alu.op;
-        alu_.rs1 = rs_alu_.to_alu.Vj;
-        alu_.rs2 = rs_alu_.to_alu.Vk;
+        // To ALUs
+        for (unsigned i = 0; i < alus_.size(); ++i) {
+            auto& alu = *alus_[i];
+            alu.dest  = [&, i] {
+                auto dest = to_unsigned(rs_alu_.to_alu[i].dest);
+                return reorder_buffer_.flush_output == 1 || rs_alu_.squash_input.squashes(dest) ? 0 : dest;
+            };
+            alu.op  = rs_alu_.to_alu[i].op;
+            alu.rs1 = rs_alu_.to_alu[i].Vj;
+            alu.rs2 = rs_alu_.to_alu[i].Vk;
+        }
+
+        // To RS_MDU
+        dark::connect(rs_mdu_.operation_input, decoder_.to_rs_mdu);
+        connect_cdb(rs_mdu_.cdb_input);
+        rs_mdu_.mdu_ready   = mdu_.ready;
+        rs_mdu_.div_ready   = mdu_.div_ready;
+        rs_mdu_.flush_input = reorder_buffer_.flush_output;
+        dark::connect(rs_mdu_.squash_input, reorder_buffer_.squash_output);
+
+        // To MDU
+        mdu_.op          = rs_mdu_.to_mdu.op;
+        mdu_.rs1         = rs_mdu_.to_mdu.Vj;
+        mdu_.rs2         = rs_mdu_.to_mdu.Vk;
+        mdu_.dest        = rs_mdu_.to_mdu.dest;
+        mdu_.cdb_taken   = [&] { return alu_cdb_taken(); }; // the ALUs take the CDBs first
+        mdu_.flush_input = reorder_buffer_.flush_output;
+        dark::connect(mdu_.squash_input, reorder_buffer_.squash_output);
 
         // To RS_BCU
         dark::connect(rs_bcu_.operation_input, decoder_.to_rs_bcu);
-        dark::connect(rs_bcu_.cdb_input_alu, alu_.cdb_output);
-        dark::connect(rs_bcu_.cdb_input_mem, mem_.cdb_output);
+        connect_cdb(rs_bcu_.cdb_input);
         rs_bcu_.flush_input = reorder_buffer_.flush_output;
+        dark::connect(rs_bcu_.squash_input, reorder_buffer_.squash_output);
 
         // To BCU
         bcu_.dest = [&] {
-            return reorder_buffer_.flush_output == 1 ? 0 : to_unsigned(rs_bcu_.to_bcu.dest);
+            auto dest = to_unsigned(rs_bcu_.to_bcu.dest);
+            return reorder_buffer_.flush_output == 1 || rs_bcu_.squash_input.squashes(dest) ? 0 : dest;
         };
         bcu_.op             = rs_bcu_.to_bcu.op;
         bcu_.rs1            = rs_bcu_.to_bcu.Vj;
@@ -118,26 +190,78 @@ public:
         // To RS_Mem
         dark::connect(rs_mem_.load_input, decoder_.to_rs_mem_load);
         dark::connect(rs_mem_.store_input, decoder_.to_rs_mem_store);
-        dark::connect(rs_mem_.cdb_input_alu, alu_.cdb_output);
-        dark::connect(rs_mem_.cdb_input_mem, mem_.cdb_output);
+        connect_cdb(rs_mem_.cdb_input);
         rs_mem_.flush_input = reorder_buffer_.flush_output;
+        dark::connect(rs_mem_.squash_input, reorder_buffer_.squash_output);
         dark::connect(rs_mem_.rob_commit, reorder_buffer_.commit_output);
-        rs_mem_.recv = mem_.recv;
+        rs_mem_.mem_ready = mem_.ready;
 
         // To Mem
         dark::connect(mem_.operation_input, rs_mem_.to_mem);
+        dark::connect(mem_.write_input, rs_mem_.to_mem_write);
+        // The ALUs and the MDU sending results in the next cycle, which take the CDBs first
+        mem_.cdb_taken   = [&] { return alu_cdb_taken() + mdu_.sends(); };
         mem_.flush_input = reorder_buffer_.flush_output;
+        dark::connect(mem_.squash_input, reorder_buffer_.squash_output);
 
         // To RegFile
         dark::connect(reg_file_.from_decoder, decoder_.to_reg_file);
         dark::connect(reg_file_.from_rob, reorder_buffer_.to_reg_file);
         reg_file_.flush_input = reorder_buffer_.flush_output;
+        dark::connect(reg_file_.squash_input, reorder_buffer_.squash_output);
+        // Decoder -> RegFile, a branch issued to the BCU is checkpointed
+        for (int i = 0; i < ISSUE_WIDTH_MAX; ++i) {
+            reg_file_.from_branch[i].enabled = decoder_.to_rs_bcu[i].enabled;
+            reg_file_.from_branch[i].rob_id  = decoder_.to_rs_bcu[i].dest;
+        }
+
+        // To PRF
+        dark::connect(prf_.from_decoder, decoder_.to_prf);
+        connect_cdb(prf_.cdb_input);
 
         // To ROB
         dark::connect(reorder_buffer_.operation_input, decoder_.to_rob);
-        dark::connect(reorder_buffer_.cdb_input_alu, alu_.cdb_output);
-        dark::connect(reorder_buffer_.cdb_input_mem, mem_.cdb_output);
+        connect_cdb(reorder_buffer_.cdb_input);
         dark::connect(reorder_buffer_.bcu_input, static_cast<RS_BCU::BCU_Output&>(bcu_));
+        reorder_buffer_.store_input     = rs_mem_.store_done;
+        reorder_buffer_.violation_input = rs_mem_.violation;
+    }
+
+    /// Logs the pipeline into `path` in the Kanata format, see Tracer.
+    void trace(const char* path, unsigned long long begin = 0, unsigned long long end = 0) {
+        tracer_.open(path, begin, end);
+    }
+
+    /**
+     * Dumps the output registers of every module into `path` in the VCD format, see dark::VCDWriter.
+     * @param filters glob patterns of the signals to dump, e.g. `rob.to_fetcher.*`; empty means all.
+     * @param ring_cycles 0 to dump every cycle, otherwise only the last `ring_cycles` cycles before the halt or a failure.
+     */
+    void dump_vcd(const char* path, const std::vector<std::string>& filters = {}, std::size_t ring_cycles = 0) {
+        for (const auto& filter : filters) vcd_.add_filter(filter);
+        vcd_.add_module("fetcher", fetcher_);
+        vcd_.add_module("decoder", decoder_);
+        vcd_.add_module("rs_alu", rs_alu_);
+        for (unsigned i = 0; i < alus_.size(); ++i) vcd_.add_module(alu_name(i), *alus_[i]);
+        vcd_.add_module("rs_mdu", rs_mdu_);
+        vcd_.add_module("mdu", mdu_);
+        vcd_.add_module("rs_bcu", rs_bcu_);
+        vcd_.add_module("bcu", bcu_);
+        vcd_.add_module("rs_mem", rs_mem_);
+        vcd_.add_module("mem", mem_);
+        if (rename_policy_ == Rename_Policy::PhysicalRegisterFile) {
+            vcd_.add_module("prf", prf_);
+        } else {
+            vcd_.add_module("reg_file", reg_file_);
+        }
+        vcd_.add_module("rob", reorder_buffer_);
+        vcd_.open(path, ring_cycles);
+        cpu_.add_observer(&vcd_);
+    }
+
+    /// Reports the host time spent in each module at halt, measured in 1 of every `sample_period` cycles.
+    void profile_host(unsigned long long sample_period) {
+        cpu_.enable_host_profile(sample_period);
     }
 
     void run() {
@@ -145,9 +269,15 @@ public:
         memory_->load_data(std::cin);
 
         std::function halt_callback = [&] {
-            unsigned int output = reg_file_.get_data(10) & 0xFF;
+            unsigned int output = register_value(10) & 0xFF;
             auto cpu_cycle_count = cpu_.get_cycle_count();
             stats_.report(cpu_cycle_count);
+            icache_.report("icache");
+            dcache_.report("dcache");
+            profile_.report(cpu_cycle_count);
+            cpu_.report_host_profile(stats_.committed_instructions());
+            tracer_.close();
+            vcd_.close();
             std::cout << output << std::endl;
             exit(0);
         };
@@ -160,17 +290,80 @@ public:
     }
 
 private:
-    std::unique_ptr<Memory>     memory_;
-    fetcher::Fetcher            fetcher_;
-    decoder::Decoder            decoder_;
-    RS_ALU::Reservation_Station rs_alu_;
-    RS_ALU::ALU                 alu_;
-    RS_BCU::Reservation_Station rs_bcu_;
-    RS_BCU::BCU                 bcu_;
-    RS_Mem::Reservation_Station rs_mem_;
-    RS_Mem::MemoryUnit          mem_;
-    regfile::RegFile            reg_file_;
-    rob::ROB                    reorder_buffer_;
-    dark::CPU                   cpu_;
-    Stats                       stats_;
+    /// The committed value of `reg`.
+    unsigned register_value(unsigned reg) {
+        if (rename_policy_ == Rename_Policy::PhysicalRegisterFile) {
+            return prf_.get_data(decoder_.committed_register(reg));
+        }
+        return reg_file_.get_data(reg);
+    }
+
+    static std::string alu_name(unsigned i) {
+        return i == 0 ? "alu" : "alu" + std::to_string(i);
+    }
+
+    /**
+     * The result on the CDB `bus` in this cycle, if any. The results of the ALUs take the CDBs in order, then the one
+     * of the MDU, then the one of the memory unit; the reservation station and the units make sure there are enough.
+     */
+    const CDB_Output* cdb_source(unsigned bus) const {
+        for (const auto& alu : alus_) {
+            if (alu->cdb_output.rob_id != 0 && bus-- == 0) return &alu->cdb_output;
+        }
+        if (mdu_.cdb_output.rob_id != 0 && bus-- == 0) return &mdu_.cdb_output;
+        if (mem_.cdb_output.rob_id != 0 && bus == 0) return &mem_.cdb_output;
+        return nullptr;
+    }
+
+    /// The CDBs taken by the results the ALUs send in the next cycle.
+    unsigned alu_cdb_taken() const {
+        unsigned taken = 0;
+        for (const auto& alu : alus_) taken += alu->dest != 0;
+        return taken;
+    }
+
+    /// Every consumer snoops all the CDBs.
+    void connect_cdb(std::array<CDB_Input, CDB_COUNT_MAX>& cdb_input) {
+        for (unsigned bus = 0; bus < CDB_COUNT_MAX; ++bus) {
+            cdb_input[bus].rob_id = [this, bus] {
+                const auto* source = cdb_source(bus);
+                return source ? to_unsigned(source->rob_id) : 0;
+            };
+            cdb_input[bus].value = [this, bus] {
+                const auto* source = cdb_source(bus);
+                return source ? to_unsigned(source->value) : 0;
+            };
+        }
+    }
+
+    /// The number of the enabled ports of a group issued by the decoder.
+    template <typename Port>
+    static unsigned enabled_count(const std::array<Port, ISSUE_WIDTH_MAX>& ports) {
+        unsigned count = 0;
+        for (const auto& port : ports) count += port.enabled == 1;
+        return count;
+    }
+
+    std::unique_ptr<Memory>                   memory_;
+    cache::Cache                              icache_;
+    fetcher::Fetcher                          fetcher_;
+    decoder::Decoder                          decoder_;
+    RS_ALU::Reservation_Station               rs_alu_;
+    std::vector<std::unique_ptr<RS_ALU::ALU>> alus_;
+    RS_MDU::Reservation_Station               rs_mdu_;
+    RS_MDU::MDU                               mdu_;
+    RS_BCU::Reservation_Station               rs_bcu_;
+    RS_BCU::BCU                               bcu_;
+    RS_Mem::Reservation_Station               rs_mem_;
+    cache::Cache                              dcache_;
+    RS_Mem::MemoryUnit                        mem_;
+    regfile::RegFile                          reg_file_;
+    prf::PRF                                  prf_;
+    rob::ROB                                  reorder_buffer_;
+    dark::CPU                                 cpu_;
+    Stats                                     stats_;
+    Rename_Policy                             rename_policy_;
+    Profile                                   profile_;
+    Tracer                                    tracer_;
+    dark::VCDWriter                           vcd_;
 };
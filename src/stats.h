@@ -4,8 +4,51 @@
 
 #pragma once
 
+#include <array>
+#include <cstdio>
+
+/**
+ * The reason why the decoder did or did not issue an instruction in a slot of a cycle, of which there are as many as
+ * the issue width. Every slot is attributed to exactly one of these.
+ */
+enum class IssueSlot {
+    Issued,
+    FetchRedirect, // the bubble after RET and JALR, which redirect the fetcher (State::SkipOneCycle)
+    FetchEmpty,    // the fetch queue is empty, e.g. after a flush or an instruction cache miss
+    WaitForJalr,
+    FlushRecovery,
+    RobFull,
+    RsAluFull,
+    RsMduFull,
+    RsBcuFull,
+    RsLoadFull,
+    RsStoreFull,
+    Halt,          // the last cycle, when the halt stops the simulation before the decoder has worked in it
+    Count
+};
+
+/**
+ * The reason why the ROB did or did not commit an instruction in a slot of a cycle, of which there are as many as the
+ * commit width. Every slot is attributed to exactly one of these.
+ */
+enum class CommitSlot {
+    Committed,
+    GroupEnd,           // the group has ended at a branch, or before a halt which is committed on its own
+    RobEmpty,           // the front end did not deliver any instruction
+    MispredictRecovery, // the ROB is empty after a branch misprediction flush
+    WaitALU,            // the head is waiting for the ALU (including JALR)
+    WaitMDU,            // the head is waiting for the multiply/divide unit
+    WaitBranch,         // the head is a branch waiting for the BCU
+    WaitLoad,           // the head is a load waiting for the memory
+    WaitStore,          // the head is a store waiting for the memory
+    Count
+};
+
 class Stats {
 public:
+    explicit Stats(unsigned issue_width = 1, unsigned commit_width = 1)
+        : issue_width_(issue_width), commit_width_(commit_width) {}
+
     void record_branch_prediction_result(bool prediction, bool actual) {
         branch_count += 1;
         if (prediction == actual) {
@@ -13,6 +56,22 @@ public:
         }
     }
 
+    void record_memory_order_violation() { memory_order_violations += 1; }
+
+    void record_false_dependence() { false_dependences += 1; }
+
+    void record_coalesced_store() { coalesced_stores += 1; }
+
+    void record_cdb_conflict(unsigned long long count = 1) { cdb_conflicts += count; }
+
+    void record_issue_slot(IssueSlot slot, unsigned count = 1) { issue_slots[static_cast<int>(slot)] += count; }
+
+    void record_commit_slot(CommitSlot slot, unsigned count = 1) { commit_slots[static_cast<int>(slot)] += count; }
+
+    unsigned long long committed_instructions() const {
+        return commit_slots[static_cast<int>(CommitSlot::Committed)];
+    }
+
     void report(unsigned long long cpu_cycle_count) {
         fprintf(stderr, "CPU simulator halted successfully.\n");
         fprintf(stderr, "branch count: %llu\n", branch_count);
@@ -20,9 +79,72 @@ public:
         fprintf(stderr, "branch prediction accuracy: %Lf\n", static_cast<long double>(correct_count) / branch_count);
         fprintf(stderr, "cpu cycle count: %llu\n", cpu_cycle_count);
         fprintf(stderr, "cpu cycle per branch: %Lf\n", static_cast<long double>(cpu_cycle_count) / branch_count);
+        fprintf(stderr, "memory order violations: %llu\n", memory_order_violations);
+        fprintf(stderr, "false memory dependences: %llu\n", false_dependences);
+        fprintf(stderr, "coalesced stores: %llu\n", coalesced_stores);
+        fprintf(stderr, "cdb conflicts: %llu\n", cdb_conflicts);
+        report_cpi_stack(cpu_cycle_count);
     }
 
 private:
+    unsigned issue_width_;  // the issue slots in a cycle
+    unsigned commit_width_; // the commit slots in a cycle
+
     unsigned long long correct_count = 0;
     unsigned long long branch_count  = 0;
+
+    unsigned long long memory_order_violations = 0; // loads fetched again, as they ran ahead of a store they depend on
+    unsigned long long false_dependences       = 0; // loads held back for a store predicted wrongly to overlap them
+    unsigned long long coalesced_stores        = 0; // stores merged into a store buffer entry of an older one
+    unsigned long long cdb_conflicts           = 0; // results held back for a cycle, as every CDB is taken
+
+    std::array<unsigned long long, static_cast<int>(IssueSlot::Count)>  issue_slots  = {};
+    std::array<unsigned long long, static_cast<int>(CommitSlot::Count)> commit_slots = {};
+
+    static constexpr const char* issue_slot_names[] = {
+        "issued", "fetch redirect", "fetch empty", "wait for jalr", "flush recovery",
+        "rob full", "rs_alu full", "rs_mdu full", "rs_bcu full", "rs_load full", "rs_store full", "halt"
+    };
+    static constexpr const char* commit_slot_names[] = {
+        "committed", "group end", "rob empty", "mispredict recovery",
+        "wait alu", "wait mdu", "wait branch", "wait load", "wait store"
+    };
+
+    /**
+     * Each slot count divided by the number of committed instructions is its contribution to the CPI,
+     * so that the rows of each table sum up to the CPI. An issue or commit slot is a fraction of a cycle for a wider
+     * issue or commit.
+     */
+    void report_cpi_stack(unsigned long long cpu_cycle_count) {
+        unsigned long long committed = commit_slots[static_cast<int>(CommitSlot::Committed)];
+        unsigned long long issued    = issue_slots[static_cast<int>(IssueSlot::Issued)];
+        if (committed == 0) return;
+        // The halt exits within the ROB's work, and the modules work in any order, so the slots of the last cycle are
+        // not recorded if the decoder has not worked in it yet.
+        unsigned long long recorded = 0;
+        for (int i = 0; i < static_cast<int>(IssueSlot::Count); ++i) recorded += issue_slots[i];
+        issue_slots[static_cast<int>(IssueSlot::Halt)] += cpu_cycle_count * issue_width_ - recorded;
+        auto cpi = [&](unsigned long long slots) { return static_cast<long double>(slots) / committed; };
+        auto issue_cpi  = [&](unsigned long long slots) { return cpi(slots) / issue_width_; };
+        auto commit_cpi = [&](unsigned long long slots) { return cpi(slots) / commit_width_; };
+
+        fprintf(stderr, "committed instructions: %llu\n", committed);
+        fprintf(stderr, "cpu cycle per instruction: %Lf\n", cpi(cpu_cycle_count));
+
+        fprintf(stderr, "issue slots (CPI stack):\n");
+        fprintf(stderr, "  %-20s %12llu %10Lf\n", "issued (retired)", committed, issue_cpi(committed));
+        fprintf(stderr, "  %-20s %12llu %10Lf\n", "issued (squashed)", issued - committed,
+                issue_cpi(issued - committed));
+        for (int i = 1; i < static_cast<int>(IssueSlot::Count); ++i) {
+            fprintf(stderr, "  %-20s %12llu %10Lf\n", issue_slot_names[i], issue_slots[i], issue_cpi(issue_slots[i]));
+        }
+
+        fprintf(stderr, "commit slots (CPI stack):\n");
+        for (int i = 0; i < static_cast<int>(CommitSlot::Count); ++i) {
+            fprintf(stderr, "  %-20s %12llu %10Lf\n", commit_slot_names[i], commit_slots[i],
+                    commit_cpi(commit_slots[i]));
+        }
+        fprintf(stderr, "commit slot utilization: %Lf\n",
+                static_cast<long double>(committed) / (cpu_cycle_count * commit_width_));
+    }
 };
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+
+namespace store_set {
+/**
+ * The store set memory dependence predictor.
+ * The SSIT maps the pc of a load or a store to its store set, and the LFST maps a store set to the last store of the
+ * set that entered the store queue. A load in a store set is predicted to depend on that store, and waits for its
+ * address; the other loads run ahead of the older stores whose addresses are unknown.
+ * A load and a store are put into the same store set when the load has run ahead of the store and read stale data.
+ */
+class Store_Set_Predictor {
+public:
+    static constexpr unsigned kNoSet = ~0u;
+
+    Store_Set_Predictor() {
+        clear();
+        flush();
+    }
+
+    /// A store enters the store queue with the sequence number `seq`. Returns its store set, or kNoSet.
+    unsigned add_store(unsigned pc, unsigned long long seq) {
+        auto set = ssit_[index(pc)];
+        if (set != kNoSet) lfst_[set] = {true, seq};
+        return set;
+    }
+
+    /// A load enters the store queue. Returns whether it is predicted to depend on a store, and if so which one.
+    bool predict_load(unsigned pc, unsigned long long& store_seq) const {
+        auto set = ssit_[index(pc)];
+        if (set == kNoSet || !lfst_[set].valid) return false;
+        store_seq = lfst_[set].seq;
+        return true;
+    }
+
+    /// The store `seq` of the store set `set` leaves the store queue.
+    void remove_store(unsigned set, unsigned long long seq) {
+        if (set != kNoSet && lfst_[set].valid && lfst_[set].seq == seq) lfst_[set].valid = false;
+    }
+
+    /// The load at `load_pc` has run ahead of the store at `store_pc` that it depends on.
+    void record_violation(unsigned load_pc, unsigned store_pc) {
+        auto& load_set  = ssit_[index(load_pc)];
+        auto& store_set = ssit_[index(store_pc)];
+        if (load_set == kNoSet && store_set == kNoSet) {
+            load_set  = index(load_pc) % LFST_SIZE;
+            store_set = load_set;
+        } else if (load_set == kNoSet) {
+            load_set = store_set;
+        } else if (store_set == kNoSet) {
+            store_set = load_set;
+        } else {
+            // Merge the two sets into the smaller one, so that repeated merges converge
+            load_set  = std::min(load_set, store_set);
+            store_set = load_set;
+        }
+    }
+
+    /// Called every cycle: the store sets are forgotten periodically, so that stale ones do not hold loads back.
+    void tick() {
+        if (++cycles_ % CLEAR_PERIOD == 0) clear();
+    }
+
+    /// The store queue is flushed.
+    void flush() {
+        lfst_.fill({});
+    }
+
+    void clear() {
+        ssit_.fill(kNoSet);
+    }
+
+private:
+    struct LFST_Entry {
+        bool               valid = false;
+        unsigned long long seq   = 0;
+    };
+
+    static constexpr int                SSIT_SIZE    = 1024;
+    static constexpr int                LFST_SIZE    = 128;
+    static constexpr unsigned long long CLEAR_PERIOD = 1 << 20; // in cycles
+
+    std::array<unsigned, SSIT_SIZE>   ssit_{};
+    std::array<LFST_Entry, LFST_SIZE> lfst_{};
+    unsigned long long                cycles_ = 0;
+
+    static unsigned index(unsigned pc) { return (pc >> 2) % SSIT_SIZE; }
+};
+} // namespace store_set
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string_view>
+
+#include "constants.h"
+#include "cpu.h"
+
+/**
+ * A minimal buffered writer for trace files.
+ * Formatting is done by hand into a large buffer, which is written out with a single fwrite when it fills up.
+ */
+class BufferedWriter {
+public:
+    explicit BufferedWriter(const char* path)
+        : file_(std::fopen(path, "wb")), buffer_(std::make_unique<char[]>(kBufferSize)) {
+        dark::debug::assert(file_ != nullptr, "BufferedWriter: failed to open the file");
+    }
+
+    ~BufferedWriter() { close(); }
+
+    BufferedWriter(const BufferedWriter&)            = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    BufferedWriter& put(char c) {
+        reserve(1);
+        buffer_[size_++] = c;
+        return *this;
+    }
+
+    BufferedWriter& put(std::string_view str) {
+        reserve(str.size());
+        for (char c : str) buffer_[size_++] = c;
+        return *this;
+    }
+
+    BufferedWriter& put_dec(unsigned long long value) {
+        char digits[20];
+        int  length = 0;
+        do {
+            digits[length++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        reserve(length);
+        while (length > 0) buffer_[size_++] = digits[--length];
+        return *this;
+    }
+
+    BufferedWriter& put_hex(uint32_t value, int width = 8) {
+        reserve(width);
+        for (int shift = (width - 1) * 4; shift >= 0; shift -= 4) {
+            buffer_[size_++] = "0123456789abcdef"[(value >> shift) & 0xF];
+        }
+        return *this;
+    }
+
+    void flush() {
+        if (file_ && size_ != 0) std::fwrite(buffer_.get(), 1, size_, file_);
+        size_ = 0;
+    }
+
+    void close() {
+        flush();
+        if (file_) std::fclose(file_);
+        file_ = nullptr;
+    }
+
+private:
+    static constexpr std::size_t kBufferSize = 1 << 20;
+
+    std::FILE*              file_;
+    std::unique_ptr<char[]> buffer_;
+    std::size_t             size_ = 0;
+
+    void reserve(std::size_t length) {
+        if (size_ + length > kBufferSize) flush();
+    }
+};
+
+/**
+ * Logs the lifecycle of every instruction in the Kanata format, so that the pipeline can be viewed in Konata.
+ *
+ * An instruction is identified by the cycle it was fetched in until the decoder picks it up,
+ * and by its ROB id once it is issued. Stages:
+ * F (fetched), Is (in the decoder), Rs (waiting for operands), Ds (dispatched to a functional unit),
+ * Ex (executing), Wb (result written back to the ROB).
+ *
+ * Tracing is disabled unless `open` is called, in which case every hook costs a single branch.
+ */
+class Tracer {
+public:
+    explicit Tracer(const dark::CPU* cpu) : cpu_(cpu) {}
+
+    /**
+     * Starts tracing into `path`. Only the instructions fetched in cycles [begin, end) are traced,
+     * and nothing is written from cycle `end` on.
+     * @param end 0 means no limit.
+     */
+    void open(const char* path, unsigned long long begin = 0, unsigned long long end = 0) {
+        writer_ = std::make_unique<BufferedWriter>(path);
+        begin_  = begin;
+        end_    = end;
+        writer_->put("Kanata\t0004\n");
+    }
+
+    void close() {
+        if (writer_) writer_->close();
+        writer_.reset();
+    }
+
+    /// Fetcher: an instruction is fetched in this cycle.
+    void fetch(uint32_t pc, uint32_t instruction) {
+        if (!writer_) return;
+        auto  now  = cpu_->get_cycle_count();
+        auto& slot = fetched_.emplace_back(Fetch_Slot{now, {}});
+        if (now < begin_ || !writable()) return;
+
+        slot.record.id = next_id_++;
+        begin_event('I', slot.record.id).put('\t').put_dec(slot.record.id).put("\t0\n");
+        begin_event('L', slot.record.id).put("\t0\t").put_hex(pc).put(": ").put_hex(instruction).put('\n');
+        stage(slot.record, "F");
+    }
+
+    /// Decoder: the head of the fetch queue, the oldest instruction fetched and not yet issued, is being decoded.
+    void decode() {
+        if (!writer_ || fetched_.empty()) return;
+        auto& record = fetched_.front().record;
+        if (record.stage != kDecodeStage) stage(record, kDecodeStage); // it may wait there for several cycles
+    }
+
+    /// Decoder: the instruction being decoded is issued to the ROB entry `rob_id`.
+    void issue(unsigned rob_id) {
+        if (!writer_ || fetched_.empty()) return;
+        retire(issued_[rob_id], true); // stale entry left over from a flush
+        issued_[rob_id] = fetched_.front().record;
+        fetched_.pop_front();
+        stage(issued_[rob_id], "Rs");
+    }
+
+    /// Reservation stations: the instruction is sent to its functional unit.
+    void dispatch(unsigned rob_id) {
+        if (writer_) stage(issued_[rob_id], "Ds");
+    }
+
+    /// Functional units: the instruction starts executing.
+    void execute(unsigned rob_id) {
+        if (writer_) stage(issued_[rob_id], "Ex");
+    }
+
+    /// ROB: the result of the instruction is written to the ROB.
+    void writeback(unsigned rob_id) {
+        if (writer_) stage(issued_[rob_id], "Wb");
+    }
+
+    /// ROB: the instruction is committed.
+    void commit(unsigned rob_id) {
+        if (writer_) retire(issued_[rob_id], false);
+    }
+
+    /// ROB and decoder: every issued instruction is squashed, and so is every one fetched before this cycle.
+    void squash() {
+        if (!writer_) return;
+        for (auto& record : issued_) retire(record, true);
+        squash_decoding();
+    }
+
+    /// ROB: the instruction in the ROB entry `rob_id` is squashed after a mispredicted branch.
+    void squash(unsigned rob_id) {
+        if (writer_) retire(issued_[rob_id], true);
+    }
+
+    /// Decoder: the instructions fetched before this cycle and not yet issued are squashed, as the fetcher is
+    /// redirected.
+    void squash_decoding() {
+        if (!writer_) return;
+        auto now = cpu_->get_cycle_count();
+        while (!fetched_.empty() && fetched_.front().cycle < now) {
+            retire(fetched_.front().record, true);
+            fetched_.pop_front();
+        }
+    }
+
+private:
+    static constexpr unsigned long long kUntraced    = ~0ull;
+    static constexpr const char*        kDecodeStage = "Is";
+
+    struct Record {
+        unsigned long long id    = kUntraced;
+        const char*        stage = nullptr; // the current stage, which is ended by the next one
+    };
+
+    struct Fetch_Slot {
+        unsigned long long cycle = ~0ull;
+        Record             record;
+    };
+
+    const dark::CPU*                 cpu_;
+    std::unique_ptr<BufferedWriter>  writer_;
+    unsigned long long               begin_      = 0;
+    unsigned long long               end_        = 0;
+    unsigned long long               last_cycle_ = ~0ull; // the cycle of the last event written
+    unsigned long long               next_id_    = 0;
+    unsigned long long               retired_    = 0;
+    std::deque<Fetch_Slot>           fetched_; // fetched and not yet issued, oldest first
+    std::array<Record, ROB_SIZE>     issued_     = {}; // indexed by the ROB id
+
+    bool writable() const {
+        return end_ == 0 || cpu_->get_cycle_count() < end_;
+    }
+
+    BufferedWriter& begin_event(char command, unsigned long long id) {
+        auto now = cpu_->get_cycle_count();
+        if (last_cycle_ == ~0ull) {
+            writer_->put("C=\t").put_dec(now).put('\n');
+        } else if (now != last_cycle_) {
+            writer_->put("C\t").put_dec(now - last_cycle_).put('\n');
+        }
+        last_cycle_ = now;
+        return writer_->put(command).put('\t').put_dec(id);
+    }
+
+    void end_stage(const Record& record) {
+        if (record.stage) begin_event('E', record.id).put("\t0\t").put(record.stage).put('\n');
+    }
+
+    void stage(Record& record, const char* name) {
+        if (record.id == kUntraced || !writable()) return;
+        end_stage(record);
+        begin_event('S', record.id).put("\t0\t").put(name).put('\n');
+        record.stage = name;
+    }
+
+    void retire(Record& record, bool flushed) {
+        if (record.id != kUntraced && writable()) {
+            end_stage(record);
+            begin_event('R', record.id).put('\t').put_dec(retired_++).put('\t').put(flushed ? '1' : '0').put('\n');
+        }
+        record = {};
+    }
+};